@@ -27,16 +27,6 @@ static uint8_t bit_array_2d_get_col_8bit_bitmask(int j)
 	return bit_index_to_8bit_bitmask(j%BITS_IN_BYTE);
 }
 
-/**
- * @brief Get the bit at row i, column j of the 2D bit array.
- */
-static bool bit_array_2d_get(uint8_t *bit_array, int ncols, int nrows, int i, int j)
-{
-	uint8_t *byte = bit_array_2d_get_byte(bit_array, ncols, i, j);
-	uint8_t bitmask = bit_array_2d_get_col_8bit_bitmask(j);
-	return *byte & bitmask;
-}
-
 void bit_array_2d_set(uint8_t *bit_array, int ncols, int nrows, int i, int j, bool value)
 {
 	if ((i >= 0 && i < nrows) && (j >= 0 && j < ncols)) {
@@ -50,16 +40,88 @@ void bit_array_2d_set(uint8_t *bit_array, int ncols, int nrows, int i, int j, bo
 	}
 }
 
+/** @brief Get the bitmask of the bits of byte index b of a row that are in columns [first, end). */
+static uint8_t bit_array_2d_span_8bit_bitmask(int b, int first, int end)
+{
+	const int lo = first > b*BITS_IN_BYTE ? first - b*BITS_IN_BYTE : 0;
+	const int hi = end < (b+1)*BITS_IN_BYTE ? end - b*BITS_IN_BYTE : BITS_IN_BYTE;
+
+	return (0xFF>>lo) & (0xFF<<(BITS_IN_BYTE-hi));
+}
+
+/**
+ * @brief Get the 8 bits of a row of nbyte_cols bytes from column j, which may be negative or not at the
+ *        start of a byte, with the bits outside of the row zero.
+ */
+static uint8_t bit_array_2d_row_get_8bits(const uint8_t *row, int nbyte_cols, int j)
+{
+	/* Round down for negative columns. */
+	const int shift = (j%BITS_IN_BYTE + BITS_IN_BYTE) % BITS_IN_BYTE;
+	const int byte_index = (j-shift) / BITS_IN_BYTE;
+	/* The two bytes the 8 bits straddle, as a big-endian 16-bit word so that they shift across. */
+	uint16_t word = 0;
+
+	if (byte_index >= 0 && byte_index < nbyte_cols)
+		word |= row[byte_index]<<BITS_IN_BYTE;
+	if (byte_index+1 >= 0 && byte_index+1 < nbyte_cols)
+		word |= row[byte_index+1];
+	return (uint16_t)(word<<shift) >> BITS_IN_BYTE;
+}
+
 void bit_array_2d_copy(uint8_t *dest_bit_array, int dest_ncols, int dest_nrows,
 		       uint8_t *src_bit_array, int src_ncols, int src_nrows,
 		       struct write_coord coord)
 {
-	for (int i = 0; i < src_nrows; ++i) {
-		for (int j = 0; j < src_ncols; ++j) {
-			bool bit = bit_array_2d_get(src_bit_array, src_ncols, src_nrows, i, j);
-			bit_array_2d_set(dest_bit_array, dest_ncols, dest_nrows,
-					 coord.row+i, coord.col+j, bit);
+	const int dest_nbyte_cols = dest_ncols/BITS_IN_BYTE;
+	const int src_nbyte_cols = src_ncols/BITS_IN_BYTE;
+	/* Rows of the source and columns of the destination that the clipped source covers. */
+	const int first_row = coord.row < 0 ? -coord.row : 0;
+	const int end_row = coord.row+src_nrows < dest_nrows ? src_nrows : dest_nrows-coord.row;
+	const int first_col = coord.col < 0 ? 0 : coord.col;
+	const int end_col = coord.col+src_ncols < dest_ncols ? coord.col+src_ncols : dest_ncols;
+
+	if (first_row >= end_row || first_col >= end_col)
+		return;
+	for (int i = first_row; i < end_row; ++i) {
+		uint8_t *dest_row = dest_bit_array + (coord.row+i)*dest_nbyte_cols;
+		const uint8_t *src_row = src_bit_array + i*src_nbyte_cols;
+
+		for (int b = first_col/BITS_IN_BYTE; b <= (end_col-1)/BITS_IN_BYTE; ++b) {
+			const uint8_t bitmask = bit_array_2d_span_8bit_bitmask(b, first_col, end_col);
+			const uint8_t bits = bit_array_2d_row_get_8bits(src_row, src_nbyte_cols, 
+									b*BITS_IN_BYTE - coord.col);
+
+			dest_row[b] = (dest_row[b] & ~bitmask) | (bits & bitmask);
+		}
+	}
+}
+
+void bit_array_2d_fill_rect(uint8_t *bit_array, int ncols, int nrows, struct write_coord coord,
+			    int width, int height, bool value)
+{
+	const int nbyte_cols = ncols/BITS_IN_BYTE;
+	const int first_row = coord.row < 0 ? 0 : coord.row;
+	const int end_row = coord.row+height < nrows ? coord.row+height : nrows;
+	const int first_col = coord.col < 0 ? 0 : coord.col;
+	const int end_col = coord.col+width < ncols ? coord.col+width : ncols;
+
+	if (first_row >= end_row || first_col >= end_col)
+		return;
+	for (int i = first_row; i < end_row; ++i) {
+		uint8_t *row = bit_array + i*nbyte_cols;
+
+		for (int b = first_col/BITS_IN_BYTE; b <= (end_col-1)/BITS_IN_BYTE; ++b) {
+			const uint8_t bitmask = bit_array_2d_span_8bit_bitmask(b, first_col, end_col);
+
+			if (value)
+				row[b] |= bitmask;
+			else
+				row[b] &= ~bitmask;
 		}
 	}
 }
 
+void bit_array_2d_fill_span(uint8_t *bit_array, int ncols, int nrows, int i, int j, int len, bool value)
+{
+	bit_array_2d_fill_rect(bit_array, ncols, nrows, (struct write_coord){i, j}, len, 1, value);
+}
@@ -3,12 +3,15 @@
  * SPDX-License-Identifier: GPL-2.0
  */
 #include <stdint.h>
+#include <dsp/basic_math_functions.h>
 #include "adc.h"
 
 #define ADC_UINT12_MAX 4095
 #define ADC_UINT12_ZERO_VAL 2047.5
 #define ADC_UINT12_MIN_NEG -2047.5
 #define ADC_UINT12_MAX_POS  2047.5
+/* Number of bits to shift the 12-bit value up by to span the range of a signed 16-bit integer. */
+#define ADC_UINT12_TO_S16_SHIFT 4
 
 float32_t convert_adc_u12_sample_to_s16(uint16_t u12_sample)
 {
@@ -34,3 +37,54 @@ float32_t convert_adc_u12_sample_to_s16(uint16_t u12_sample)
 	}
 	return s16_sample;
 }
+
+q15_t convert_adc_u12_sample_to_q15(uint16_t u12_sample)
+{
+	/* See convert_adc_u12_sample_to_s16() for the DC bias, here taken as the integer 2048. */
+	return (q15_t)((u12_sample-(ADC_UINT12_MAX+1)/2)*(1 << ADC_UINT12_TO_S16_SHIFT));
+}
+
+/* Raw sample of the nominal DC bias, with ADC_DC_FRAC_BITS fractional bits. */
+#define ADC_DC_NOMINAL ((int32_t)(ADC_UINT12_ZERO_VAL*(1 << ADC_DC_FRAC_BITS)))
+
+void adc_converter_init(struct adc_converter *conv)
+{
+	conv->dc = ADC_DC_NOMINAL;
+}
+
+void convert_adc_u12_samples(struct adc_converter *conv, const uint16_t *u12_samples, sample_t *samples, int len)
+{
+	uint32_t sum = 0;
+	int32_t mean;
+#if FIXED_POINT
+	/* The DC offset in the same units as a raw sample shifted up to q15. */
+	const int32_t dc = conv->dc >> (ADC_DC_FRAC_BITS-ADC_UINT12_TO_S16_SHIFT);
+
+	for (int i = 0; i < len; ++i) {
+		int32_t sample = ((int32_t)u12_samples[i] << ADC_UINT12_TO_S16_SHIFT)-dc;
+
+		/* 
+		 * Saturate rather than wrap around should the estimate be far off, e.g. right after power on,
+		 * with the single SSAT instruction on the MCU rather than compares and branches.
+		 */
+		samples[i] = __SSAT(sample, 16);
+		sum += u12_samples[i];
+	}
+#else
+	/* 
+	 * A single scale either side of the DC offset, rather than the two of convert_adc_u12_sample_to_s16()
+	 * that map the ends exactly to INT16_MIN and INT16_MAX, which differ by less than a 16-bit step.
+	 */
+	const float32_t scale = INT16_MAX/ADC_UINT12_MAX_POS;
+	const float32_t dc = (float32_t)conv->dc/(1 << ADC_DC_FRAC_BITS);
+
+	for (int i = 0; i < len; ++i) {
+		samples[i] = (u12_samples[i]-dc)*scale;
+		sum += u12_samples[i];
+	}
+#endif
+	if (len == 0)
+		return;
+	mean = (int32_t)(((int64_t)sum << ADC_DC_FRAC_BITS)/len);
+	conv->dc += (mean-conv->dc) >> ADC_DC_RATE_SHIFT;
+}
@@ -5,19 +5,22 @@
 # objects for the core library, and objects dependent on it.
 #
 # This makefile asserts the following variables are set.
-# - arm_arch_profile: A for Cortex-A or M for Cortex-M
+# - arm_arch_profile: A for Cortex-A, M for Cortex-M, or native for the host itself (not ARM), 
+#   e.g. x86-64, which builds the portable C of CMSIS DSP.
 # - cross_prefix: cross compilation prefix. Required for Cortex-M. 
 # - cpu: processor to target. Only for Cortex-M, and required for it.
 
-arm_arch_profile_error_msg = "Variable arm_arch_profile not defined or set correctly: set it to either A for Cortex-A or M for Cortex-M"
+arm_arch_profile_error_msg = "Variable arm_arch_profile not defined or set correctly: set it to either A for Cortex-A, M for Cortex-M or native for the host"
 ifndef arm_arch_profile
 $(error $(arm_arch_profile_error_msg))
 endif
 ifneq ($(arm_arch_profile), A)
 ifneq ($(arm_arch_profile), M)
+ifneq ($(arm_arch_profile), native)
 $(error $(arm_arch_profile_error_msg))
 endif
 endif
+endif
 
 ifeq ($(arm_arch_profile), M)
 ifndef cross_prefix
@@ -33,11 +36,20 @@ include ../core/dsp_params.mk
 export CC = $(cross_prefix)gcc
 export CFLAGS = -iquote ../include -I../CMSIS-DSP/Include -I../CMSIS_6/CMSIS/Core/Include \
 		-DSAMPLING_RATE_FROM_MAKEFILE=$(sampling_rate) \
-		-DOVERSAMPLING_FACTOR_FROM_MAKEFILE=$(oversampling_factor)
+		-DOVERSAMPLING_FACTOR_FROM_MAKEFILE=$(oversampling_factor) \
+		-DNR_TAPS=$(nr_taps) \
+		-DMAX_LINKED_FRAME_LEN_FROM_MAKEFILE=$(max_frame_len) \
+		-DHALFBAND_NR_TAPS_FROM_MAKEFILE=$(halfband_nr_taps) \
+		-DFIXED_POINT_FROM_MAKEFILE=$(fixed_point)
 # Only explicitly define __ARM_ARCH_PROFILE for Cortex-A because Cortex-M has it
 # implicitly defined through its -mcpu option, and we don't want to redefine it.
-ifneq ($(arm_arch_profile), M)
+# A native build defines __GNUC_PYTHON__ instead, as the host build of CMSIS DSP 
+# for its Python wrapper does, for CMSIS DSP to use generic GCC definitions in 
+# place of those of cmsis_compiler.h, which are ARM only.
+ifeq ($(arm_arch_profile), A)
 CFLAGS += -D__ARM_ARCH_PROFILE="'$(arm_arch_profile)'"
+else ifeq ($(arm_arch_profile), native)
+CFLAGS += -D__GNUC_PYTHON__
 else
 CFLAGS += -mcpu=$(cpu)
 endif
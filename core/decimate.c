@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ */
+#include <dsp/support_functions.h>
+#include <string.h>
+#include "decimate.h"
+#include "dsp.h"
+
+extern const float32_t filter_coefficients[NR_TAPS];
+extern const float32_t halfband_filter_coefficients[HALFBAND_NR_TAPS];
+
+#if FIXED_POINT
+/* 
+ * Shared by all decimators and converted by the first decimate_init(), so that later ones, e.g. resetting
+ * the context of a worker thread on the host, don't write them while other decimators read them.
+ */
+static q15_t filter_coefficients_q15[NR_TAPS];
+static q15_t halfband_filter_coefficients_q15[HALFBAND_NR_TAPS];
+static bool coefficients_q15_converted;
+#endif
+
+void halfband_decimator_init(struct halfband_decimator *hbd, sample_t *state)
+{
+	hbd->state = state;
+	memset(state, 0, (HALFBAND_NR_TAPS-1)*sizeof(sample_t));
+}
+
+#if FIXED_POINT
+/** @brief Convert a q30 accumulator (product of q15s) back to q15, saturating. */
+static q15_t q30_to_q15_sat(q63_t acc)
+{
+	acc >>= 15;
+	if (acc > INT16_MAX)
+		return INT16_MAX;
+	if (acc < INT16_MIN)
+		return INT16_MIN;
+	return acc;
+}
+#endif
+
+void halfband_decimate(struct halfband_decimator *hbd, const sample_t *samples, 
+		       sample_t *decimated_samples, int nsamples)
+{
+#if FIXED_POINT
+	const q15_t *coeffs = halfband_filter_coefficients_q15;
+	q63_t acc;
+#else
+	const float32_t *coeffs = halfband_filter_coefficients;
+	float32_t acc;
+#endif
+	const int centre = (HALFBAND_NR_TAPS-1)/2;
+	/* The HALFBAND_NR_TAPS samples the current decimated sample is filtered from. */
+	sample_t *window = hbd->state;
+
+	/* 
+	 * The new samples are copied into the state before any decimated samples are written, 
+	 * which is what allows decimating in place. 
+	 */
+	memcpy(hbd->state+HALFBAND_NR_TAPS-1, samples, nsamples*sizeof(sample_t));
+	for (int i = 0; i < nsamples/2; ++i) {
+		acc = coeffs[centre]*window[centre];
+		/* 
+		 * Every second coefficient either side of the centre coefficient is zero, so skip them. 
+		 * The coefficients are also symmetric about the centre, so add the two samples which 
+		 * share a coefficient before multiplying, to halve the multiplies.
+		 */
+		for (int j = 1; j <= centre; j += 2)
+			acc += coeffs[centre-j]*(window[centre-j]+window[centre+j]);
+#if FIXED_POINT
+		decimated_samples[i] = q30_to_q15_sat(acc);
+#else
+		decimated_samples[i] = acc;
+#endif
+		window += 2;
+	}
+	/* Keep the last HALFBAND_NR_TAPS-1 samples for the next call. */
+	memmove(hbd->state, window, (HALFBAND_NR_TAPS-1)*sizeof(sample_t));
+}
+
+void decimate_init(struct decimator *dec)
+{
+#if NR_HALFBAND_STAGES
+	sample_t *state = dec->halfband_states;
+	int max_nsamples = MAX_CHUNK_NSAMPLES;
+
+	for (int i = 0; i < NR_HALFBAND_STAGES; ++i) {
+		halfband_decimator_init(&dec->halfband_decimators[i], state);
+		state += HALFBAND_DECIMATOR_STATE_LEN(max_nsamples);
+		max_nsamples /= 2;
+	}
+#endif
+#if FIXED_POINT
+	if (!coefficients_q15_converted) {
+		arm_float_to_q15(filter_coefficients, filter_coefficients_q15, NR_TAPS);
+		arm_float_to_q15(halfband_filter_coefficients, halfband_filter_coefficients_q15, HALFBAND_NR_TAPS);
+		coefficients_q15_converted = true;
+	}
+	arm_fir_decimate_init_q15(&dec->fir_decimate_instance, NR_TAPS, 2, filter_coefficients_q15, 
+				  dec->fir_state, 2*DECIMATE_CHUNK_LEN);
+#else
+	arm_fir_decimate_init_f32(&dec->fir_decimate_instance, NR_TAPS, 2, filter_coefficients, 
+				  dec->fir_state, 2*DECIMATE_CHUNK_LEN);
+#endif
+}
+
+void decimate(struct decimator *dec, const sample_t *samples, sample_t *decimated_samples, int nsamples)
+{
+	for (int i = 0; i < nsamples; i += MAX_CHUNK_NSAMPLES) {
+		const sample_t *stage_samples = samples+i;
+		int stage_nsamples = nsamples-i < MAX_CHUNK_NSAMPLES ? nsamples-i : MAX_CHUNK_NSAMPLES;
+
+#if NR_HALFBAND_STAGES
+		for (int j = 0; j < NR_HALFBAND_STAGES; ++j) {
+			halfband_decimate(&dec->halfband_decimators[j], stage_samples, dec->halfband_decimated_samples, 
+					  stage_nsamples);
+			stage_samples = dec->halfband_decimated_samples;
+			stage_nsamples /= 2;
+		}
+#endif
+		/* Apply band-pass filter and decimate down to the SAMPLING_RATE. */
+#if FIXED_POINT
+		arm_fir_decimate_q15(&dec->fir_decimate_instance, stage_samples, decimated_samples, stage_nsamples);
+#else
+		arm_fir_decimate_f32(&dec->fir_decimate_instance, stage_samples, decimated_samples, stage_nsamples);
+#endif
+		decimated_samples += stage_nsamples/2;
+	}
+}
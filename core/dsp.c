@@ -2,56 +2,382 @@
  * Copyright (C) 2024 Petar Turukalo
  * SPDX-License-Identifier: GPL-2.0
  */
-#include <dsp/filtering_functions.h>
 #include <dsp/transform_functions.h>
 #include <dsp/complex_math_functions.h>
 #include <dsp/statistics_functions.h>
+#include <dsp/basic_math_functions.h>
+#include <dsp/fast_math_functions.h>
+#include <dsp/support_functions.h>
 #include "dsp.h"
+#include "decimate.h"
+#include "arena.h"
 #include "note.h"
 #include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
 
-extern const float32_t filter_coefficients[NR_TAPS];
+/* 
+ * Memory of the default context, which the functions that don't take a context run on. It's laid out
+ * for the longest frame length that can be selected, and carved at compile time so that the context
+ * needs no initialisation before use, e.g. for harmonic_product_spectrum().
+ */
+ARENA_DEFINE(default_ctx_mem, DSP_CTX_MEM_SIZE(MAX_LINKED_FRAME_LEN));
 
-static arm_fir_decimate_instance_f32 fir_decimate_instance;
-static arm_rfft_fast_instance_f32 fft_instance;
+static struct dsp_ctx default_ctx = {
+	.decimator = ARENA_AT(struct decimator, default_ctx_mem, 0),
+	.hop_frame = ARENA_AT(sample_t, default_ctx_mem, DSP_CTX_FRAME_OFFSET),
+	.buf = ARENA_AT(magnitude_t, default_ctx_mem, DSP_CTX_BUF_OFFSET(MAX_LINKED_FRAME_LEN)),
+	.fft_complex_nrs = ARENA_AT(magnitude_t, default_ctx_mem, DSP_CTX_PHASE_OFFSET(MAX_LINKED_FRAME_LEN)),
+	.hps = ARENA_AT(magnitude_t, default_ctx_mem, DSP_CTX_PHASE_OFFSET(MAX_LINKED_FRAME_LEN)),
+	.downsampled_spectrum = ARENA_AT(magnitude_t, default_ctx_mem, 
+					 DSP_CTX_DOWNSAMPLED_SPECTRUM_OFFSET(MAX_LINKED_FRAME_LEN)),
+	.spectrum = ARENA_AT(magnitude_t, default_ctx_mem, DSP_CTX_SPECTRUM_OFFSET(MAX_LINKED_FRAME_LEN)),
+	.scratch = ARENA_AT(void, default_ctx_mem, DSP_CTX_PHASE_OFFSET(MAX_LINKED_FRAME_LEN))
+};
 
-void samples_to_freq_bin_magnitudes_init(enum frame_length frame_len)
+struct dsp_ctx *dsp_default_ctx(void)
 {
-	static float32_t fir_state[NR_TAPS+(OVERSAMPLING_FACTOR*MAX_FRAME_LEN)-1];
-	arm_fir_decimate_init_f32(&fir_decimate_instance, NR_TAPS, OVERSAMPLING_FACTOR, filter_coefficients, 
-				  fir_state, OVERSAMPLING_FACTOR*frame_len);
-	arm_rfft_fast_init_f32(&fft_instance, frame_len);
+	return &default_ctx;
 }
 
-float32_t *samples_to_freq_bin_magnitudes(float32_t *samples, enum frame_length frame_len)
+/* Fails if the FFT tables for the frame length weren't linked. See frame_lengths in core/dsp_params.mk. */
+static bool fft_init(struct dsp_ctx *ctx, enum frame_length frame_len)
 {
-	/*
-	 * Each processing step below interleaves between using `buf` and `samples` as input/output
-	 * buffers instead of allocating memory for each, in order to save MCU RAM space.
+#if FIXED_POINT
+	return arm_rfft_init_q31(&ctx->fft_instance, frame_len, 0, 1) == ARM_MATH_SUCCESS;
+#else
+	return arm_rfft_fast_init_f32(&ctx->fft_instance, frame_len) == ARM_MATH_SUCCESS;
+#endif
+}
+
+/* Coefficients of the alpha max plus beta min magnitude approximation with the least max error (~3.96%). */
+#define ALPHA_MAX_BETA_MIN_ALPHA 0.960433870
+#define ALPHA_MAX_BETA_MIN_BETA  0.397824735
+
+/**
+ * Get the magnitudes of the complex numbers at the bins in range (a complex number per bin), exactly, 
+ * or with the alpha max plus beta min approximation, which is cheaper as it doesn't need a square root.
+ */
+static void cmplx_mag_range(const magnitude_t *fft_complex_nrs, magnitude_t *freq_bin_magnitudes, 
+			    struct bin_range range, bool approximate)
+{
+	if (!approximate) {
+#if FIXED_POINT
+		arm_cmplx_mag_q31(fft_complex_nrs+2*range.first, freq_bin_magnitudes+range.first, range.end-range.first);
+#else
+		arm_cmplx_mag_f32(fft_complex_nrs+2*range.first, freq_bin_magnitudes+range.first, range.end-range.first);
+#endif
+		return;
+	}
+	for (int i = range.first; i < range.end; ++i) {
+#if FIXED_POINT
+		static const q31_t alpha = ALPHA_MAX_BETA_MIN_ALPHA*2147483648.0;
+		static const q31_t beta = ALPHA_MAX_BETA_MIN_BETA*2147483648.0;
+		/* Saturate as the absolute of the most negative q31 doesn't fit in a q31. */
+		q31_t re = fft_complex_nrs[2*i] == INT32_MIN ? INT32_MAX : abs(fft_complex_nrs[2*i]);
+		q31_t im = fft_complex_nrs[2*i+1] == INT32_MIN ? INT32_MAX : abs(fft_complex_nrs[2*i+1]);
+
+		/* Shift by an extra bit for the 2.30 format of arm_cmplx_mag_q31(). */
+		freq_bin_magnitudes[i] = ((q63_t)(re > im ? re : im)*alpha + (q63_t)(re > im ? im : re)*beta) >> 32;
+#else
+		float32_t re = fabsf(fft_complex_nrs[2*i]);
+		float32_t im = fabsf(fft_complex_nrs[2*i+1]);
+
+		freq_bin_magnitudes[i] = ALPHA_MAX_BETA_MIN_ALPHA*fmaxf(re, im) + ALPHA_MAX_BETA_MIN_BETA*fminf(re, im);
+#endif
+	}
+}
+
+/* Range of all the frequency bins. */
+static struct bin_range all_bins(enum frame_length frame_len)
+{
+	return (struct bin_range){ 0, nr_bins(frame_len) };
+}
+
+/* 
+ * Initialise the state of a context whose buffers are already assigned. The FFT is initialised first so 
+ * that a frame length whose tables weren't linked is rejected before its buffers are written to.
+ */
+static bool ctx_reset(struct dsp_ctx *ctx, enum frame_length frame_len, int hop_len)
+{
+	if (!fft_init(ctx, frame_len))
+		return false;
+	decimate_init(ctx->decimator);
+	memset(ctx->hop_frame, 0, frame_len*sizeof(sample_t));
+	ctx->frame_len = frame_len;
+	ctx->hop_len = hop_len;
+	ctx->nr_filtered_samples = 0;
+	ctx->hop_sum_of_squares = 0;
+	ctx->nr_hop_energy_samples = 0;
+	ctx->block_energy = 0;
+	ctx->newest_filtered_samples_end = ctx->hop_frame+frame_len;
+	ctx->nr_frame_samples = 0;
+	return true;
+}
+
+size_t dsp_ctx_mem_size(enum frame_length frame_len)
+{
+	return DSP_CTX_MEM_SIZE(frame_len);
+}
+
+bool dsp_ctx_init(struct dsp_ctx *ctx, enum frame_length frame_len, int hop_len, void *mem)
+{
+	ctx->decimator = ARENA_AT(struct decimator, mem, 0);
+	ctx->hop_frame = ARENA_AT(sample_t, mem, DSP_CTX_FRAME_OFFSET);
+	ctx->buf = ARENA_AT(magnitude_t, mem, DSP_CTX_BUF_OFFSET(frame_len));
+	ctx->fft_complex_nrs = ARENA_AT(magnitude_t, mem, DSP_CTX_PHASE_OFFSET(frame_len));
+	ctx->hps = ARENA_AT(magnitude_t, mem, DSP_CTX_PHASE_OFFSET(frame_len));
+	ctx->downsampled_spectrum = ARENA_AT(magnitude_t, mem, DSP_CTX_DOWNSAMPLED_SPECTRUM_OFFSET(frame_len));
+	ctx->spectrum = ARENA_AT(magnitude_t, mem, DSP_CTX_SPECTRUM_OFFSET(frame_len));
+	ctx->scratch = ARENA_AT(void, mem, DSP_CTX_PHASE_OFFSET(frame_len));
+	return ctx_reset(ctx, frame_len, hop_len);
+}
+
+void dsp_ctx_destroy(struct dsp_ctx *ctx)
+{
+	memset(ctx, 0, sizeof(*ctx));
+}
+
+void dsp_ctx_push_block(struct dsp_ctx *ctx, const sample_t *samples, int block_len)
+{
+	const int frame_len = ctx->frame_len;
+	const int hop_len = ctx->hop_len;
+	sample_t *new_filtered_samples = ctx->hop_frame+(frame_len-hop_len);
+	const int nr_new_filtered_samples = block_len/OVERSAMPLING_FACTOR;
+#if FIXED_POINT
+	q63_t block_sum_of_squares;
+#else
+	float32_t block_sum_of_squares;
+#endif
+
+	/* A full hop that wasn't finished, e.g. one gated out by its energy, is simply dropped. */
+	if (ctx->nr_filtered_samples == hop_len)
+		ctx->nr_filtered_samples = 0;
+	/* If this is the first block of a new hop, make room for the new hop by shifting out the oldest. */
+	if (ctx->nr_filtered_samples == 0) {
+		memmove(ctx->hop_frame, ctx->hop_frame+hop_len, (frame_len-hop_len)*sizeof(sample_t));
+		ctx->hop_sum_of_squares = 0;
+		ctx->nr_hop_energy_samples = 0;
+	}
+	/* 
+	 * Only the new hop needs filtering and decimating: the rest of the frame was already 
+	 * filtered and decimated by the previous calls. Apply band-pass filter and decimate down
+	 * from the OVERSAMPLING_RATE to SAMPLING_RATE.
+	 */
+	decimate(ctx->decimator, samples, new_filtered_samples+ctx->nr_filtered_samples, block_len);
+	/* 
+	 * The samples are still in cache, so get their energy now rather than in another pass at the end. 
+	 * The q15 samples are in the same units as the float ones (those of a signed 16-bit integer), 
+	 * and arm_power_q15() sums their raw products, so both versions give the same energy.
 	 */
-	static float32_t buf[MAX_FRAME_LEN]; 
-	float32_t *filtered_samples = buf;
-	float32_t *fft_complex_nrs, *freq_bin_magnitudes;
+#if FIXED_POINT
+	arm_power_q15(new_filtered_samples+ctx->nr_filtered_samples, nr_new_filtered_samples, &block_sum_of_squares);
+#else
+	arm_power_f32(new_filtered_samples+ctx->nr_filtered_samples, nr_new_filtered_samples, &block_sum_of_squares);
+#endif
+	ctx->hop_sum_of_squares += block_sum_of_squares;
+	ctx->nr_hop_energy_samples += nr_new_filtered_samples;
+	ctx->block_energy = (float32_t)block_sum_of_squares/nr_new_filtered_samples;
+	ctx->nr_filtered_samples += nr_new_filtered_samples;
+	ctx->newest_filtered_samples_end = new_filtered_samples+ctx->nr_filtered_samples;
+	ctx->nr_frame_samples += nr_new_filtered_samples;
+	if (ctx->nr_frame_samples > frame_len)
+		ctx->nr_frame_samples = frame_len;
+}
+
+float32_t dsp_ctx_hop_energy(const struct dsp_ctx *ctx)
+{
+	return ctx->nr_hop_energy_samples ? (float32_t)ctx->hop_sum_of_squares/ctx->nr_hop_energy_samples : 0;
+}
 
-	/* Apply band-pass filter and decimate down from the OVERSAMPLING_RATE to SAMPLING_RATE. */
-	arm_fir_decimate_f32(&fir_decimate_instance, samples, filtered_samples, OVERSAMPLING_FACTOR*frame_len);
+float32_t dsp_ctx_block_energy(const struct dsp_ctx *ctx)
+{
+	return ctx->block_energy;
+}
+
+void dsp_ctx_restart_hop(struct dsp_ctx *ctx, int block_len, int first_hop_len)
+{
+	const int frame_len = ctx->frame_len;
+	const int nr_block_filtered_samples = block_len/OVERSAMPLING_FACTOR;
+	const sample_t *block = ctx->hop_frame+(frame_len-ctx->hop_len)+ctx->nr_filtered_samples-nr_block_filtered_samples;
+
+	/* 
+	 * Move the block to the start of the last first_hop_len samples of the frame and pretend the hop 
+	 * was already filled up to it, so that the hop is full after first_hop_len samples.
+	 */
+	memmove(ctx->hop_frame+(frame_len-first_hop_len), block, nr_block_filtered_samples*sizeof(sample_t));
+	/* 
+	 * Silence the samples before the block: they're of the noise or the previous note, which would 
+	 * otherwise pull the pitch of the frames that still overlap them away from the new note. 
+	 */
+	memset(ctx->hop_frame, 0, (frame_len-first_hop_len)*sizeof(sample_t));
+	ctx->nr_filtered_samples = ctx->hop_len-first_hop_len+nr_block_filtered_samples;
+	ctx->newest_filtered_samples_end = ctx->hop_frame+(frame_len-first_hop_len)+nr_block_filtered_samples;
+	ctx->hop_sum_of_squares = ctx->block_energy*nr_block_filtered_samples;
+	ctx->nr_hop_energy_samples = nr_block_filtered_samples;
+	ctx->nr_frame_samples = nr_block_filtered_samples;
+}
+
+const sample_t *dsp_ctx_newest(const struct dsp_ctx *ctx, int len)
+{
+	return ctx->newest_filtered_samples_end-len;
+}
+
+magnitude_t *dsp_ctx_finish(struct dsp_ctx *ctx, struct bin_range range, bool approximate)
+{
+	const int frame_len = ctx->frame_len;
+
+	ctx->nr_filtered_samples = 0;
+	/* The FFT trashes its input so give it a copy to keep the frame intact for the next hop. */
+#if FIXED_POINT
+	/* 
+	 * Convert from time domain to frequency domain. The FFT scales its output down by frame_len/2 to
+	 * make room for its bit growth, so the samples are converted to q31 for the bits to spare. 
+	 */
+	arm_q15_to_q31(ctx->hop_frame, ctx->buf, frame_len);
+	arm_rfft_q31(&ctx->fft_instance, ctx->buf, ctx->fft_complex_nrs);
+	/* Zero the first complex number because it's the DC offset (its imaginary part is 0). */
+	ctx->fft_complex_nrs[0] = 0;
+#else
 	/* Convert from time domain to frequency domain. */
-	fft_complex_nrs = samples;
-	arm_rfft_fast_f32(&fft_instance, filtered_samples, fft_complex_nrs, 0);
+	memcpy(ctx->buf, ctx->hop_frame, frame_len*sizeof(float32_t));
+	arm_rfft_fast_f32(&ctx->fft_instance, ctx->buf, ctx->fft_complex_nrs, 0);
 	/* 
 	 * Zero the first complex number because it's the DC offset and value at the Nyquist frequency 
 	 * masquerading as a complex number.
 	 */
-	fft_complex_nrs[0] = fft_complex_nrs[1] = 0;
+	ctx->fft_complex_nrs[0] = ctx->fft_complex_nrs[1] = 0;
+#endif
 	/* 
-	 * Get the energy of the spectra. Use regular mag over mag squared because the numbers mag
-	 * squared ouput are too big and cause the result of HPS to overflow and give wrong results. 
+	 * Get the energy of the spectra, reusing the FFT input for it. Use regular mag over mag squared 
+	 * because the numbers mag squared ouput are too big and cause the result of HPS to overflow and 
+	 * give wrong results. 
 	 */
-	freq_bin_magnitudes = buf;
-	arm_cmplx_mag_f32(fft_complex_nrs, freq_bin_magnitudes, MAX_NR_BINS);
-	return freq_bin_magnitudes;
+	cmplx_mag_range(ctx->fft_complex_nrs, ctx->buf, range, approximate);
+	return ctx->buf;
+}
+
+#if !FIXED_POINT
+
+float32_t *dsp_ctx_autocorrelation_finish(struct dsp_ctx *ctx, const float32_t **window)
+{
+	const int frame_len = ctx->frame_len;
+	const int window_len = frame_len/2;
+	float32_t *buf = ctx->buf;
+	float32_t *fft_complex_nrs = ctx->fft_complex_nrs;
+
+	ctx->nr_filtered_samples = 0;
+	*window = ctx->hop_frame+window_len;
+	/* 
+	 * Zero pad the window to the frame length so the product in the frequency domain is the linear
+	 * and not the circular autocorrelation, i.e. lags don't wrap around the end of the window.
+	 */
+	memcpy(buf, *window, window_len*sizeof(float32_t));
+	memset(buf+window_len, 0, window_len*sizeof(float32_t));
+	arm_rfft_fast_f32(&ctx->fft_instance, buf, fft_complex_nrs, 0);
+	/* 
+	 * The autocorrelation is the inverse FFT of the power spectrum (Wiener-Khinchin theorem). The first 
+	 * complex number is the real DC offset and value at the Nyquist frequency, which are squared separately.
+	 */
+	fft_complex_nrs[0] *= fft_complex_nrs[0];
+	fft_complex_nrs[1] *= fft_complex_nrs[1];
+	for (int i = 2; i < frame_len; i += 2) {
+		fft_complex_nrs[i] = fft_complex_nrs[i]*fft_complex_nrs[i] + fft_complex_nrs[i+1]*fft_complex_nrs[i+1];
+		fft_complex_nrs[i+1] = 0;
+	}
+	arm_rfft_fast_f32(&ctx->fft_instance, fft_complex_nrs, buf, 1);
+	return buf;
+}
+#endif
+
+/*
+ * The functions below that don't take a context are the original API, kept as wrappers that run on
+ * the default context. The frame and hop lengths they take after initialisation are those it was
+ * initialised with, and a whole frame is a hop of the frame length.
+ */
+
+/* The memory of the default context only fits frame lengths up to the longest linked. */
+static bool default_ctx_reset(enum frame_length frame_len, int hop_len)
+{
+	return frame_len <= MAX_LINKED_FRAME_LEN && ctx_reset(&default_ctx, frame_len, hop_len);
+}
+
+bool samples_to_freq_bin_magnitudes_init(enum frame_length frame_len)
+{
+	return default_ctx_reset(frame_len, frame_len);
+}
+
+void samples_to_freq_bin_magnitudes_push_block(const sample_t *samples, int block_len)
+{
+	dsp_ctx_push_block(&default_ctx, samples, block_len);
+}
+
+magnitude_t *samples_to_freq_bin_magnitudes_finish(enum frame_length frame_len)
+{
+	return dsp_ctx_finish(&default_ctx, all_bins(frame_len), false);
+}
+
+magnitude_t *samples_to_freq_bin_magnitudes(const sample_t *samples, enum frame_length frame_len)
+{
+	samples_to_freq_bin_magnitudes_push_block(samples, OVERSAMPLING_FACTOR*frame_len);
+	return samples_to_freq_bin_magnitudes_finish(frame_len);
+}
+
+bool hop_samples_to_freq_bin_magnitudes_init(enum frame_length frame_len, int hop_len)
+{
+	return default_ctx_reset(frame_len, hop_len);
+}
+
+void hop_samples_to_freq_bin_magnitudes_push_block(const sample_t *samples, int block_len)
+{
+	dsp_ctx_push_block(&default_ctx, samples, block_len);
+}
+
+float32_t hop_samples_energy(void)
+{
+	return dsp_ctx_hop_energy(&default_ctx);
+}
+
+float32_t hop_samples_block_energy(void)
+{
+	return dsp_ctx_block_energy(&default_ctx);
+}
+
+void hop_samples_restart_hop(int block_len, int first_hop_len)
+{
+	dsp_ctx_restart_hop(&default_ctx, block_len, first_hop_len);
+}
+
+const sample_t *hop_samples_newest(int len)
+{
+	return dsp_ctx_newest(&default_ctx, len);
+}
+
+magnitude_t *hop_samples_to_freq_bin_magnitudes_finish(enum frame_length frame_len)
+{
+	return dsp_ctx_finish(&default_ctx, all_bins(frame_len), false);
+}
+
+magnitude_t *hop_samples_to_freq_bin_magnitudes_range_finish(enum frame_length frame_len, struct bin_range range,
+							     bool approximate)
+{
+	return dsp_ctx_finish(&default_ctx, range, approximate);
+}
+
+magnitude_t *hop_samples_to_freq_bin_magnitudes(const sample_t *samples, enum frame_length frame_len, int hop_len)
+{
+	hop_samples_to_freq_bin_magnitudes_push_block(samples, OVERSAMPLING_FACTOR*hop_len);
+	return hop_samples_to_freq_bin_magnitudes_finish(frame_len);
 }
 
+#if !FIXED_POINT
+float32_t *hop_samples_to_autocorrelation_finish(enum frame_length frame_len, const float32_t **window)
+{
+	return dsp_ctx_autocorrelation_finish(&default_ctx, window);
+}
+#endif
+
 int nr_bins(enum frame_length frame_len)
 {
 	return frame_len/2;
@@ -83,12 +409,144 @@ float32_t bin_index_to_freq(int bin_index, float32_t binwidth)
 	return bin_index*binwidth;
 }
 
+/** @brief Get sin(pi*x)/(pi*x). */
+static float32_t sinc(float32_t x)
+{
+	return x == 0 ? 1 : sinf(PI*x)/(PI*x);
+}
+
+/**
+ * Interpolate the peak for a frame whose newest window_fraction of samples are of the signal and the
+ * rest are zeros, i.e. which has a rectangular window that much shorter than the frame.
+ */
+static float32_t interpolate_peak_freq_in_window(const magnitude_t *freq_bin_magnitudes, int bin_index, 
+						 enum frame_length frame_len, int sampling_rate, 
+						 float32_t window_fraction)
+{
+	float32_t binwidth = bin_width(frame_len, sampling_rate);
+	float32_t peak_mag = freq_bin_magnitudes[bin_index];
+	float32_t neighbour_mag;
+	float32_t ratio, offset, lo, hi;
+	int side;
+
+	if (bin_index < 1 || bin_index >= nr_bins(frame_len)-1)
+		return bin_index_to_freq(bin_index, binwidth);
+	/* The true peak lies on the side of the larger neighbour. */
+	if (freq_bin_magnitudes[bin_index+1] >= freq_bin_magnitudes[bin_index-1]) {
+		neighbour_mag = freq_bin_magnitudes[bin_index+1];
+		side = 1;
+	} else {
+		neighbour_mag = freq_bin_magnitudes[bin_index-1];
+		side = -1;
+	}
+	/*
+	 * The frame isn't windowed before the FFT (it has a rectangular window), so the magnitudes
+	 * of a sinusoid at fractional bin index k+d (0 <= d < 1) fall off either side of it like a sinc:
+	 * the magnitude of bin k is proportional to sin(pi*d)/(pi*d) and that of bin k+1 to
+	 * sin(pi*d)/(pi*(1-d)). Their ratio is d/(1-d), which rearranged gives
+	 * d = mag(k+1)/(mag(k)+mag(k+1)).
+	 */
+	if (window_fraction >= 1)
+		return (bin_index+side*neighbour_mag/(peak_mag+neighbour_mag))*binwidth;
+	/*
+	 * A window of a fraction r of the frame widens the sinc by 1/r bins: the ratio is 
+	 * sinc(r*(1-d))/sinc(r*d), which has no closed form inverse, but grows from sinc(r) at d = 0 to 1 
+	 * at d = 1/2, so bisect for d.
+	 */
+	ratio = peak_mag > 0 ? (float32_t)neighbour_mag/peak_mag : 0;
+	lo = 0;
+	hi = 0.5f;
+	for (int i = 0; i < 16; ++i) {
+		offset = (lo+hi)/2;
+		if (sinc(window_fraction*(1-offset)) < ratio*sinc(window_fraction*offset))
+			lo = offset;
+		else
+			hi = offset;
+	}
+	return (bin_index+side*(lo+hi)/2)*binwidth;
+}
+
+float32_t interpolate_peak_freq(const magnitude_t *freq_bin_magnitudes, int bin_index, enum frame_length frame_len,
+				int sampling_rate)
+{
+	return interpolate_peak_freq_in_window(freq_bin_magnitudes, bin_index, frame_len, sampling_rate, 1);
+}
+
+float32_t dsp_ctx_interpolate_peak_freq(const struct dsp_ctx *ctx, const magnitude_t *freq_bin_magnitudes, 
+					int bin_index)
+{
+	return interpolate_peak_freq_in_window(freq_bin_magnitudes, bin_index, ctx->frame_len, SAMPLING_RATE, 
+					       (float32_t)ctx->nr_frame_samples/ctx->frame_len);
+}
+
 int nyquist_frequency(int sampling_rate)
 {
 	return sampling_rate/2;
 }
 
-/*
+float32_t magnitude_to_float(magnitude_t magnitude, enum frame_length frame_len)
+{
+#if FIXED_POINT
+	/* 
+	 * The q15 samples are the float samples scaled down by 2^15, the FFT output is scaled down by 
+	 * frame_len/2 and converted to q31, and the magnitudes are output in 2.30 format, i.e. halved.
+	 */
+	return magnitude*(float32_t)frame_len/(1 << 16);
+#else
+	return magnitude;
+#endif
+}
+
+#if FIXED_POINT
+#define NO_MAGNITUDE 0
+#else
+/* The log of a magnitude of 0. */
+#define NO_MAGNITUDE (-INFINITY)
+#endif
+
+static void fill_no_magnitude(magnitude_t *freq_bin_magnitudes, int len)
+{
+	for (int i = 0; i < len; ++i)
+		freq_bin_magnitudes[i] = NO_MAGNITUDE;
+}
+
+struct bin_range hps_candidate_bin_range(enum frame_length frame_len, int sampling_rate, int nharmonics)
+{
+	const float32_t binwidth = bin_width(frame_len, sampling_rate);
+	struct bin_range candidates;
+	
+	/* Skip the frequencies below the lowest note. */
+	candidates.first = freq_to_bin_index((int)lowest_note_frequency(), binwidth);
+	/* 
+	 * And skip the frequencies above the highest note. The bins with fewer than nharmonics harmonics 
+	 * in the bandwidth are still candidates, see hps_with_buffers().
+	 */
+	candidates.end = nr_bins(frame_len);
+	if (candidates.end > freq_to_bin_index(highest_note_frequency(), binwidth)+1)
+		candidates.end = freq_to_bin_index(highest_note_frequency(), binwidth)+1;
+	if (candidates.end < candidates.first)
+		candidates.end = candidates.first;
+	return candidates;
+}
+
+struct bin_range hps_magnitude_bin_range(enum frame_length frame_len, int sampling_rate, int nharmonics)
+{
+	struct bin_range candidates = hps_candidate_bin_range(frame_len, sampling_rate, nharmonics);
+	struct bin_range range;
+
+	if (candidates.first == candidates.end)
+		return candidates;
+	/* The neighbours of the candidates are for interpolate_peak_freq(). */
+	range.first = candidates.first > 0 ? candidates.first-1 : 0;
+	range.end = nharmonics*(candidates.end-1)+1;
+	if (range.end < candidates.end+1)
+		range.end = candidates.end+1;
+	if (range.end > nr_bins(frame_len))
+		range.end = nr_bins(frame_len);
+	return range;
+}
+
+/**
  * This implements A. Michael Noll's Harmonic Product Spectrum formula
  *
  *	HPS(f) = Π_{k=1}^K |F(k*f)|
@@ -98,51 +556,135 @@ int nyquist_frequency(int sampling_rate)
  *
  * See also the Harmonic Product Spectrum paper by A. Michael Noll, linked to in the 
  * "Resources" section of the top-level README.
+ *
+ * The harmonics of the upper candidates that are above the bandwidth are taken to be at the mean 
+ * magnitude of the bins read, which is about the noise floor as the harmonic peaks are only a few 
+ * bins each. So an upper candidate only wins if its harmonics in the bandwidth stand out as much as 
+ * all those of a lower candidate, rather than when the single harmonic it has left does.
+ *
+ * @param hps Buffer for the HPS of the candidate fundamentals, of at least nr_bins().
+ * @param downsampled_spectrum Buffer for the spectrum downsampled for a harmonic, of at least nr_bins()/2.
  */
-void harmonic_product_spectrum(float32_t *freq_bin_magnitudes, enum frame_length frame_len, 
-			       int sampling_rate)
+static void hps_with_buffers(magnitude_t *freq_bin_magnitudes, enum frame_length frame_len, int sampling_rate, 
+			     int nharmonics, magnitude_t *hps, magnitude_t *downsampled_spectrum)
 {
 	const int nbins = nr_bins(frame_len);
-	int i;  /* Bin index. */
+	const struct bin_range candidates = hps_candidate_bin_range(frame_len, sampling_rate, nharmonics);
+	const int first_bin_index = candidates.first;
+	const int end_bin_index = candidates.end;
+	const int ncandidates = end_bin_index-first_bin_index;
+	/* End of the bins read: those of the candidates and their harmonics in the bandwidth. */
+	const int end_harmonic_bin_index = hps_magnitude_bin_range(frame_len, sampling_rate, nharmonics).end;
+	magnitude_t floor_magnitude;
+#if FIXED_POINT
+	q31_t max;
+	uint32_t max_index;
+#endif
 
-	/* Skip the frequencies below the lowest note. */
-	i = freq_to_bin_index((int)lowest_note_frequency(), bin_width(frame_len, sampling_rate));
-	for (bool finished = false; !finished; ++i) {
-		/* Start at 2 because the current bin is the 1st harmonic. */
-		for (int harmonic = 2; harmonic <= NHARMONICS; ++harmonic) {
-			/* 
-			 * The frequency of current bin, bin at index i, is i*bin_width(). The frequency of
-			 * the kth harmonic is k times the frequency of the current bin, k*(i*bin_width()).
-			 * But this is also the same as (k*i)*bin_width(), the frequency of bin at index k*i,
-			 * so the bin index of the harmonic is k*i (or harmonic*i).
-			 *
-			 * Note this is equivalent to downsampling/compression at a factor k for each harmonic
-			 * and then taking the product at index i because the compression is shifting the bin
-			 * index of the harmonic from index k*i down to index i.
-			 */
-			int harmonic_bin_index = harmonic*i;
-			if (harmonic_bin_index >= nbins) {
-				/* 
-				 * The frequency of the harmonic is higher than the total bandwidth and
-				 * not in the array, so can't use it in product. If it's the 2nd harmonic,
-				 * the even higher (3rd, 4th, etc.) harmonics won't be in the bandwidth either, 
-				 * and because the bins that follow span higher frequencies than the current bin, 
-				 * their 2nd harmonics also won't be in bounds, so terminate.
-				 */
-				if (harmonic == 2)
-					finished = true;
-				break;
-			}
-			freq_bin_magnitudes[i] *= freq_bin_magnitudes[harmonic_bin_index];
-		}
+	if (ncandidates == 0) {
+		fill_no_magnitude(freq_bin_magnitudes, nbins);
+		return;
+	}
+#if FIXED_POINT
+	/* 
+	 * The q31 magnitudes are all less than 1 so their products can't overflow. Scale them up to use 
+	 * as many of the bits as possible, as the products would otherwise lose most of their precision 
+	 * on the quieter frames.
+	 */
+	arm_max_q31(freq_bin_magnitudes+first_bin_index, end_harmonic_bin_index-first_bin_index, &max, &max_index);
+	if (max > 0) {
+		arm_shift_q31(freq_bin_magnitudes+first_bin_index, __builtin_clz(max)-1, freq_bin_magnitudes+first_bin_index, 
+			      end_harmonic_bin_index-first_bin_index);
+	}
+	arm_mean_q31(freq_bin_magnitudes+first_bin_index, end_harmonic_bin_index-first_bin_index, &floor_magnitude);
+#else
+	/* 
+	 * Sum the logs of the magnitudes rather than multiply them, as the product of more than a 
+	 * handful of magnitudes overflows.
+	 */
+	arm_mean_f32(freq_bin_magnitudes+first_bin_index, end_harmonic_bin_index-first_bin_index, &floor_magnitude);
+	floor_magnitude = logf(floor_magnitude);
+	arm_vlog_f32(freq_bin_magnitudes+first_bin_index, freq_bin_magnitudes+first_bin_index, 
+		     end_harmonic_bin_index-first_bin_index);
+#endif
+
+	/* The current bin is the 1st harmonic. */
+	memcpy(hps, freq_bin_magnitudes+first_bin_index, ncandidates*sizeof(magnitude_t));
+	for (int harmonic = 2; harmonic <= nharmonics; ++harmonic) {
+		/* 
+		 * The frequency of current bin, bin at index i, is i*bin_width(). The frequency of
+		 * the kth harmonic is k times the frequency of the current bin, k*(i*bin_width()).
+		 * But this is also the same as (k*i)*bin_width(), the frequency of bin at index k*i,
+		 * so the bin index of the harmonic is k*i (or harmonic*i).
+		 *
+		 * Downsampling (compressing) the spectrum by a factor of k shifts the kth harmonic of
+		 * each bin from index k*i down to index i, so that the spectra can be combined bin for 
+		 * bin with a vector kernel. Only the candidates up to nproducts have this harmonic in the 
+		 * bandwidth, and those above are padded with the floor magnitude.
+		 */
+		int nproducts = (nbins-1)/harmonic+1-first_bin_index;
+
+		if (nproducts > ncandidates)
+			nproducts = ncandidates;
+		if (nproducts < 0)
+			nproducts = 0;
+		for (int j = 0; j < nproducts; ++j)
+			downsampled_spectrum[j] = freq_bin_magnitudes[harmonic*(first_bin_index+j)];
+#if FIXED_POINT
+		arm_mult_q31(hps, downsampled_spectrum, hps, nproducts);
+		arm_scale_q31(hps+nproducts, floor_magnitude, 0, hps+nproducts, ncandidates-nproducts);
+		/* 
+		 * Scale the products back up, all by the same power of 2 so they stay comparable, as the
+		 * quieter candidates would otherwise drop to 0 a few harmonics in.
+		 */
+		arm_max_q31(hps, ncandidates, &max, &max_index);
+		if (max > 0)
+			arm_shift_q31(hps, __builtin_clz(max)-1, hps, ncandidates);
+#else
+		arm_add_f32(hps, downsampled_spectrum, hps, nproducts);
+		arm_offset_f32(hps+nproducts, floor_magnitude, hps+nproducts, ncandidates-nproducts);
+#endif
 	}
+
+	fill_no_magnitude(freq_bin_magnitudes, first_bin_index);
+	memcpy(freq_bin_magnitudes+first_bin_index, hps, ncandidates*sizeof(magnitude_t));
+	fill_no_magnitude(freq_bin_magnitudes+end_bin_index, nbins-end_bin_index);
+}
+
+void harmonic_product_spectrum(magnitude_t *freq_bin_magnitudes, enum frame_length frame_len, 
+			       int sampling_rate, int nharmonics)
+{
+	/* The buffers of the default context are too short for a longer frame. */
+	if (frame_len > MAX_LINKED_FRAME_LEN) {
+		fill_no_magnitude(freq_bin_magnitudes, nr_bins(frame_len));
+		return;
+	}
+	hps_with_buffers(freq_bin_magnitudes, frame_len, sampling_rate, nharmonics, default_ctx.hps,
+			 default_ctx.downsampled_spectrum);
+}
+
+void dsp_ctx_harmonic_product_spectrum(struct dsp_ctx *ctx, magnitude_t *freq_bin_magnitudes, int nharmonics)
+{
+	hps_with_buffers(freq_bin_magnitudes, ctx->frame_len, SAMPLING_RATE, nharmonics, ctx->hps,
+			 ctx->downsampled_spectrum);
+}
+
+int max_bin_index(magnitude_t *freq_bin_magnitudes, enum frame_length frame_len)
+{
+	return max_bin_index_in_range(freq_bin_magnitudes, all_bins(frame_len));
 }
 
-int max_bin_index(float32_t *freq_bin_magnitudes, enum frame_length frame_len)
+int max_bin_index_in_range(magnitude_t *freq_bin_magnitudes, struct bin_range range)
 {
-	float32_t max;
+	magnitude_t max;
 	uint32_t max_index;
 
-	arm_max_f32(freq_bin_magnitudes, nr_bins(frame_len), &max, &max_index);
-	return max_index;
+	if (range.first == range.end)
+		return range.first;
+#if FIXED_POINT
+	arm_max_q31(freq_bin_magnitudes+range.first, range.end-range.first, &max, &max_index);
+#else
+	arm_max_f32(freq_bin_magnitudes+range.first, range.end-range.first, &max, &max_index);
+#endif
+	return range.first+max_index;
 }
@@ -10,8 +10,29 @@ export nr_taps = 128
 # See comment at ../include/dsp.h:SAMPLING_RATE
 export sampling_rate = 4000
 # The higher the oversampling factor, the more higher frequencies that can be prevented 
-# from aliasing, but it comes at the cost of RAM and performance, and so this can't
-# be too high. See also comment at ../include/dsp.h:OVERSAMPLING_FACTOR
+# from aliasing. Decimation is done in stages of 2 with cheap half-band filters before the
+# last stage (see ../include/decimate.h), so raising this costs little processing, but the 
+# samples still have to be stored at the higher rate, costing RAM. Must be one of 2, 4, 8 or 16.
+# See also comment at ../include/dsp.h:OVERSAMPLING_FACTOR
 export oversampling_factor = 2
-export oversampling_rate = $(shell expr $(sampling_rate) \* $(oversampling_factor))
+# Sampling rate of the input to the last decimation stage, which has the band-pass filter.
+export last_stage_sampling_rate = $(shell expr $(sampling_rate) \* 2)
+# Number of half-band filter coefficients, of which almost half are zero. See the 
+# gen_halfband_filter_coeffs.m script and ../include/decimate.h:HALFBAND_NR_TAPS for more info.
+export halfband_nr_taps = 15
 
+# Frame lengths (see ../include/dsp.h:frame_length) whose FFT tables are linked into the core lib,
+# i.e. the frame lengths that can be selected at run time. Each frame length has its own tables
+# which take up a lot of memory, so only list those used. A parent makefile can set this before 
+# including compiler_vars.mk to override it. Rebuild the core lib (make clean) after changing it.
+export frame_lengths ?= 4096
+# The longest of frame_lengths, which sizes the memory of the default DSP context (see ../include/arena.h).
+export max_frame_len = $(lastword $(shell echo $(frame_lengths) | tr ' ' '\n' | sort -n))
+# Set to 1 to build the fixed-point version of the DSP pipeline, for MCUs without an FPU, where
+# samples are q15 and the FFT and frequency bin magnitudes q31. See ../include/dsp.h:FIXED_POINT.
+# Like frame_lengths a parent makefile can override it.
+export fixed_point ?= 0
+# Suffix of the build artifacts of the fixed-point version, to keep them apart from the float version's.
+ifeq ($(fixed_point), 1)
+export variant = -q
+endif
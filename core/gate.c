@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ */
+#include <math.h>
+#include "gate.h"
+
+/*
+ * The energy of a hop is that of its filtered and decimated samples, before the FFT. When there is no
+ * sound being made it's the energy of the noise of the ADC, which is quite noisy, and when a note is
+ * played it jumps well above that and then decays back. But the noise depends on the power source: 
+ * powering the MCU off a battery via its 5V pin is much quieter than a dirtier source such as the 
+ * ST-Link, which is why the gate tracks the noise floor rather than using a fixed threshold.
+ *
+ * Fraction of the difference between the log energy of a hop and the log noise floor that the log 
+ * noise floor moves by per hop: when the hop is quieter than the noise floor, when the hop is louder
+ * but the gate is closed, and when the gate is open. With a hop of 0.256 seconds the noise floor 
+ * halves the distance to a quieter floor each hop, to a louder floor in a few seconds, and while 
+ * the gate is open in a minute or two.
+ */
+#define NOISE_FLOOR_FALL_RATE  0.5f
+#define NOISE_FLOOR_RISE_RATE  0.05f
+#define NOISE_FLOOR_OPEN_RISE_RATE  0.002f
+/* The energy of a hop of zero samples is clamped to this so that its log is finite. */
+#define MIN_ENERGY  1.0f
+
+void energy_gate_init(struct energy_gate *gate)
+{
+	gate->log_noise_floor = 0;
+	gate->nr_hops = 0;
+}
+
+bool energy_gate_update(struct energy_gate *gate, float32_t energy)
+{
+	const float32_t log_energy = logf(fmaxf(energy, MIN_ENERGY));
+	const float32_t diff = log_energy-gate->log_noise_floor;
+	bool open;
+
+	if (gate->nr_hops < GATE_CALIBRATION_HOPS) {
+		/* The calibrated noise floor is the mean log energy of the calibration hops. */
+		gate->log_noise_floor += diff/++gate->nr_hops;
+		return false;
+	}
+	open = diff > logf(GATE_OPEN_RATIO);
+	if (diff < 0)
+		gate->log_noise_floor += NOISE_FLOOR_FALL_RATE*diff;
+	else if (!open)
+		gate->log_noise_floor += NOISE_FLOOR_RISE_RATE*diff;
+	else
+		gate->log_noise_floor += NOISE_FLOOR_OPEN_RISE_RATE*diff;
+	return open;
+}
+
+float32_t energy_gate_noise_floor(const struct energy_gate *gate)
+{
+	return expf(gate->log_noise_floor);
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ */
+#include <string.h>
+#include "gddram.h"
+
+/*
+ * The control byte starting a payload, with the continuation (Co) bit low so that all the bytes after
+ * it are either commands or GDDRAM data. See SSD1306 datasheet section 8.1.5.2.
+ */
+#define CTL_CMD_STREAM  0x00
+#define CTL_DATA_STREAM 0x40
+
+enum gddram_cmd {
+	GDDRAM_CMD_SET_COL_ADDR  = 0x21,
+	GDDRAM_CMD_SET_PAGE_ADDR = 0x22
+};
+
+/*
+ * Bytes to start another range of a page: the slave address and payload of the commands setting the
+ * range and the slave address and control byte of the data. An unchanged gap between changed columns
+ * shorter than this is cheaper to resend than to start a new range after.
+ */
+#define RANGE_OVERHEAD (1 + 7 + 1 + 1)
+
+void gddram_image_set(uint8_t *image, int i, int j, bool value)
+{
+	if ((i >= 0 && i < GDDRAM_NPAGES*BITS_IN_BYTE) && (j >= 0 && j < GDDRAM_NCOLS)) {
+		uint8_t *byte = image + (i/BITS_IN_BYTE)*GDDRAM_NCOLS + j;
+		uint8_t bitmask = 1<<(i%BITS_IN_BYTE);
+
+		if (value)
+			*byte |= bitmask;
+		else
+			*byte &= ~bitmask;
+	}
+}
+
+void gddram_image_fill_rect(uint8_t *image, struct write_coord coord, int width, int height, bool value)
+{
+	const int nrows = GDDRAM_NPAGES*BITS_IN_BYTE;
+	const int first_row = coord.row < 0 ? 0 : coord.row;
+	const int end_row = coord.row+height < nrows ? coord.row+height : nrows;
+	const int first_col = coord.col < 0 ? 0 : coord.col;
+	const int end_col = coord.col+width < GDDRAM_NCOLS ? coord.col+width : GDDRAM_NCOLS;
+
+	if (first_row >= end_row || first_col >= end_col)
+		return;
+	for (int page = first_row/BITS_IN_BYTE; page <= (end_row-1)/BITS_IN_BYTE; ++page) {
+		/* The rows of the page in [first_row, end_row), the top row the LSB. */
+		const int lo = first_row > page*BITS_IN_BYTE ? first_row - page*BITS_IN_BYTE : 0;
+		const int hi = end_row < (page+1)*BITS_IN_BYTE ? end_row - page*BITS_IN_BYTE : BITS_IN_BYTE;
+		const uint8_t bitmask = (0xFF<<lo) & (0xFF>>(BITS_IN_BYTE-hi));
+		uint8_t *byte = image + page*GDDRAM_NCOLS + first_col;
+
+		for (int j = first_col; j < end_col; ++j, ++byte) {
+			if (value)
+				*byte |= bitmask;
+			else
+				*byte &= ~bitmask;
+		}
+	}
+}
+
+/** @brief Write the bits of byte high in mask to the byte at page, column j of the image, if it's within it. */
+static void gddram_image_write_masked(uint8_t *image, int page, int j, uint8_t byte, uint8_t mask)
+{
+	if ((page >= 0 && page < GDDRAM_NPAGES) && (j >= 0 && j < GDDRAM_NCOLS)) {
+		uint8_t *dest = image + page*GDDRAM_NCOLS + j;
+		*dest = (*dest & ~mask) | (byte & mask);
+	}
+}
+
+void gddram_image_copy(uint8_t *image, const uint8_t *src, int ncols, int npages, struct write_coord coord)
+{
+	/* Rows of the source below the top of the image page they start in, rounding down for negative rows. */
+	const int shift = (coord.row%BITS_IN_BYTE + BITS_IN_BYTE) % BITS_IN_BYTE;
+	const int first_page = (coord.row-shift) / BITS_IN_BYTE;
+
+	/* A source page straddles two image pages unless it's aligned to one. */
+	for (int p = 0; p < npages; ++p) {
+		for (int j = 0; j < ncols; ++j) {
+			const uint8_t byte = src[p*ncols + j];
+
+			gddram_image_write_masked(image, first_page+p, coord.col+j, byte<<shift, 0xFF<<shift);
+			if (shift) {
+				gddram_image_write_masked(image, first_page+p+1, coord.col+j, 
+							  byte>>(BITS_IN_BYTE-shift), 0xFF>>(BITS_IN_BYTE-shift));
+			}
+		}
+	}
+}
+
+void gddram_pages_from_bit_array_2d(uint8_t *pages, const uint8_t *bit_array, int ncols, int nrows)
+{
+	const int nbyte_cols = ncols/BITS_IN_BYTE;
+
+	for (int p = 0; p < nrows/BITS_IN_BYTE; ++p) {
+		for (int j = 0; j < ncols; ++j) {
+			uint8_t byte = 0;
+
+			/* The top row of the page is the LSB. */
+			for (int k = 0; k < BITS_IN_BYTE; ++k) {
+				const int i = p*BITS_IN_BYTE + k;
+
+				if (bit_array[i*nbyte_cols + j/BITS_IN_BYTE] & bit_index_to_8bit_bitmask(j%BITS_IN_BYTE))
+					byte |= 1<<k;
+			}
+			pages[p*ncols + j] = byte;
+		}
+	}
+}
+
+void gddram_shadow_init(struct gddram_shadow *shadow)
+{
+	shadow->valid = false;
+}
+
+/** @brief Send columns first to last of the page of the image, and copy them to the shadow. */
+static int gddram_send_range(struct gddram_shadow *shadow, const uint8_t *image, int page, int first, int last,
+			     const struct gddram_i2c_transport *i2c)
+{
+	const uint8_t cmds[] = {
+		CTL_CMD_STREAM,
+		GDDRAM_CMD_SET_COL_ADDR, first, last,
+		GDDRAM_CMD_SET_PAGE_ADDR, page, page
+	};
+	const int offset = page*GDDRAM_NCOLS + first;
+	const int len = last-first+1;
+	uint8_t data[1+GDDRAM_NCOLS];
+
+	i2c->write(i2c->priv, cmds, sizeof(cmds));
+	data[0] = CTL_DATA_STREAM;
+	memcpy(data+1, image+offset, len);
+	i2c->write(i2c->priv, data, 1+len);
+	memcpy(shadow->image+offset, image+offset, len);
+	return sizeof(cmds) + 1+len;
+}
+
+int gddram_update(struct gddram_shadow *shadow, const uint8_t *image, const struct gddram_i2c_transport *i2c)
+{
+	int nbytes = 0;
+
+	for (int page = 0; page < GDDRAM_NPAGES; ++page) {
+		const uint8_t *new = image + page*GDDRAM_NCOLS;
+		const uint8_t *old = shadow->image + page*GDDRAM_NCOLS;
+		int col = 0;
+
+		while (col < GDDRAM_NCOLS) {
+			int first, last;
+
+			if (shadow->valid && new[col] == old[col]) {
+				++col;
+				continue;
+			}
+			first = last = col;
+			/* Extend the range across the gaps cheaper to resend than to start a new range after. */
+			for (col = first+1; col < GDDRAM_NCOLS && col-last <= RANGE_OVERHEAD; ++col) {
+				if (!shadow->valid || new[col] != old[col])
+					last = col;
+			}
+			nbytes += gddram_send_range(shadow, image, page, first, last, i2c);
+			col = last+1;
+		}
+	}
+	shadow->valid = true;
+	return nbytes;
+}
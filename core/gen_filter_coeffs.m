@@ -3,6 +3,10 @@
 %
 % Generate coefficients for a brick wall band-pass filter for use by the 
 % CMSIS DSP arm_fir_init_*() functions. 
+%
+% The filter is used in the last decimation stage (see ../include/decimate.h), so 
+% the oversampling rate and decimation factor args are those of the last stage: 
+% twice the sampling rate, and 2.
 
 pkg load signal
 
@@ -0,0 +1,28 @@
+% Copyright (C) 2024 Petar Turukalo
+% SPDX-License-Identifier: GPL-2.0
+%
+% Generate coefficients for the half-band low-pass filter used by the decimate 
+% by 2 stages that come before the last (band-pass) stage. See ../include/decimate.h.
+%
+% The same coefficients are used for all half-band stages. The last half-band stage 
+% is the most demanding as its transition band is the narrowest: it must pass the 
+% frequencies up to the Nyquist frequency of the SAMPLING_RATE, and stop those that 
+% would alias into them after decimation. Each stage before it runs at a higher sampling 
+% rate, so relative to its sampling rate has an even wider transition band.
+
+pkg load signal
+
+if (nargin != 1)
+	error("Expected 1 arg number of taps/coefficients")
+endif
+
+order = str2num(argv{1})-1;
+% A cutoff at half the Nyquist frequency gives a half-band filter, in which every 
+% second coefficient either side of the centre coefficient is zero.
+coeffs = fir1(order, 0.5);
+% Make the zeros exact because they are skipped over rather than multiplied by.
+centre = order/2+1;
+coeffs(centre+2:2:end) = 0;
+coeffs(centre-2:-2:1) = 0;
+% Convert to 32-bit float.
+coeffs = single(coeffs);
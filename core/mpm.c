@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * McLeod Pitch Method (MPM). See include/pitch.h:mpm_pitch_detector.
+ */
+#include <math.h>
+#include "pitch.h"
+
+#if !FIXED_POINT
+
+/*
+ * Fraction of the highest key maximum that the first key maximum must reach to be chosen as the period.
+ * The earlier key maxima are shorter periods; the later are multiples of the period which can score
+ * a little higher than the period itself.
+ */
+#define KEY_MAX_THRESHOLD 0.95f
+
+/**
+ * Turn the autocorrelation r into the Normalised Square Difference Function (NSDF) in place,
+ * n(lag) = 2*r(lag)/m(lag), where m(lag) is the sum of the squares of the two parts of the window
+ * that overlap at the lag. The NSDF is 1 at lags where the window matches itself exactly, 0
+ * where it's uncorrelated, and -1 where it's inverted.
+ */
+static void autocorrelation_to_nsdf(float32_t *r, const float32_t *window, int window_len, int max_lag)
+{
+	float32_t m = 2*r[0];
+
+	for (int lag = 0; lag < max_lag; ++lag) {
+		if (lag > 0) {
+			/* Both overlapping parts lose a sample as the lag increases. */
+			m -= window[lag-1]*window[lag-1] + window[window_len-lag]*window[window_len-lag];
+		}
+		r[lag] = m > 0 ? 2*r[lag]/m : 0;
+	}
+}
+
+/**
+ * Interpolate the true peak about a local maximum at lag, which falls between lags, with a parabola
+ * through the maximum and its neighbours. Return the offset of the true peak from lag, and output its
+ * value in peak. The interpolated values are needed to compare key maxima of the higher notes,
+ * whose periods span only a few lags.
+ */
+static float32_t interpolate_peak(const float32_t *nsdf, int lag, int max_lag, float32_t *peak)
+{
+	float32_t denominator, offset;
+
+	*peak = nsdf[lag];
+	if (lag < 1 || lag >= max_lag-1)
+		return 0;
+	denominator = nsdf[lag-1] - 2*nsdf[lag] + nsdf[lag+1];
+	if (denominator >= 0)
+		return 0;
+	offset = (nsdf[lag-1]-nsdf[lag+1])/(2*denominator);
+	*peak = nsdf[lag] - (nsdf[lag-1]-nsdf[lag+1])*offset/4;
+	return offset;
+}
+
+/**
+ * Get the lag of the first key maximum at or above threshold. A key maximum is the highest NSDF
+ * value between a positive going zero crossing and the following negative going zero crossing.
+ * The positive region about lag 0 is skipped as the window always matches itself at lag 0.
+ *
+ * @param highest Output the (interpolated) value of the highest key maximum up to the returned lag.
+ * @param offset Output the offset of the interpolated key maximum from the returned lag.
+ * @return The lag, or 0 if there isn't one.
+ */
+static int key_max_lag(const float32_t *nsdf, int max_lag, float32_t threshold, float32_t *highest,
+		       float32_t *offset)
+{
+	int lag = 0;
+	int region_max_lag = 0;  /* Lag of the max of the current positive region, or 0 if not in one. */
+	float32_t peak;
+
+	*highest = 0;
+	while (lag < max_lag && nsdf[lag] > 0)
+		++lag;
+	for (; lag < max_lag; ++lag) {
+		if (nsdf[lag] > 0) {
+			if (!region_max_lag || nsdf[lag] > nsdf[region_max_lag])
+				region_max_lag = lag;
+			/* Let a region cut off at the max lag end so that a key maximum in it isn't missed. */
+			if (lag < max_lag-1)
+				continue;
+		}
+		if (region_max_lag) {
+			*offset = interpolate_peak(nsdf, region_max_lag, max_lag, &peak);
+			if (peak > *highest)
+				*highest = peak;
+			if (peak >= threshold)
+				return region_max_lag;
+			region_max_lag = 0;
+		}
+	}
+	return 0;
+}
+
+static float32_t mpm_finish_ctx(struct dsp_ctx *ctx, float32_t *strength)
+{
+	const float32_t *window;
+	float32_t *nsdf = dsp_ctx_autocorrelation_finish(ctx, &window);
+	const int window_len = ctx->frame_len/2;
+	/* The parts of the window that overlap are too short to be reliable past half the window. */
+	const int max_lag = window_len/2;
+	float32_t highest, offset;
+	int lag;
+
+	autocorrelation_to_nsdf(nsdf, window, window_len, max_lag);
+	key_max_lag(nsdf, max_lag, INFINITY, &highest, &offset);
+	lag = key_max_lag(nsdf, max_lag, KEY_MAX_THRESHOLD*highest, &highest, &offset);
+	if (!lag) {
+		*strength = 0;
+		return 0;
+	}
+	interpolate_peak(nsdf, lag, max_lag, strength);
+	return SAMPLING_RATE/(lag+offset);
+}
+
+static float32_t mpm_finish(enum frame_length frame_len, float32_t *strength)
+{
+	return mpm_finish_ctx(dsp_default_ctx(), strength);
+}
+
+const struct pitch_detector mpm_pitch_detector = {
+	.name = "mpm",
+	.init = hop_samples_to_freq_bin_magnitudes_init,
+	.push_block = hop_samples_to_freq_bin_magnitudes_push_block,
+	.finish = mpm_finish,
+	.finish_ctx = mpm_finish_ctx,
+	.min_strength = 0.8f
+};
+#endif
@@ -83,13 +83,14 @@ struct note_freq note_freqs[] = {
 	{ "A#4", 466.164 },
 	{ "B4",  493.883 },
 /*
- * Ending at B4 is the highest note expected to be reliably handled because 
- * its 4th harmonic is below the 2000 Hz cutoff frequency defined by the anti-aliasing
- * filter implemented in gen_filter_coeffs.m, and HPS uses 4 harmonics (see NHARMONICS).
+ * B4 is the highest note with all of its 4 harmonics (HPS uses 4 by default, see 
+ * NHARMONICS) below the 2000 Hz cutoff frequency defined by the anti-aliasing filter 
+ * implemented in gen_filter_coeffs.m. The notes above are compared on the harmonics 
+ * they have below it: see harmonic_product_spectrum().
  *
  * This doesn't affect getting the open strings in tune, which is the main use
- * case of this tuner, but may cause issues if trying to test the intonation 
- * of the high E string e.g. when checking its pitch at fret 12.
+ * case of this tuner, but the higher notes are less robust against octave errors, 
+ * e.g. when checking the pitch of the high E string at fret 12.
  */
 
 	{ "C5",  523.251 },
@@ -132,6 +133,11 @@ float32_t lowest_note_frequency(void)
 	return note_freqs[0].frequency;
 }
 
+float32_t highest_note_frequency(void)
+{
+	return note_freqs[sizeof(note_freqs)/sizeof(struct note_freq)-2].frequency;
+}
+
 int cents_difference(float32_t frequency, struct note_freq *reference)
 {
 	return round(-CENTS_IN_OCTAVE*log2f(reference->frequency/frequency));
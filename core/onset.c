@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ */
+#include <math.h>
+#include "onset.h"
+#include "dsp.h"
+
+/* The energy of a block of zero samples is clamped to this so that its log is finite. */
+#define MIN_ENERGY  1.0f
+
+void onset_detector_init(struct onset_detector *od, int block_len)
+{
+	const float32_t block_period = (float32_t)block_len/(OVERSAMPLING_FACTOR*SAMPLING_RATE);
+
+	od->log_average_energy = 0;
+	od->average_rate = fminf(block_period/ONSET_AVERAGE_PERIOD, 1);
+	od->nr_refractory_blocks = ceilf(ONSET_REFRACTORY_PERIOD/block_period);
+	od->nr_blocks_to_wait = -1;
+}
+
+bool onset_detector_update(struct onset_detector *od, float32_t block_energy)
+{
+	const float32_t log_energy = logf(fmaxf(block_energy, MIN_ENERGY));
+	bool onset = false;
+
+	if (od->nr_blocks_to_wait < 0) {
+		od->log_average_energy = log_energy;
+		od->nr_blocks_to_wait = 0;
+		return false;
+	}
+	if (od->nr_blocks_to_wait > 0) {
+		--od->nr_blocks_to_wait;
+	} else if (log_energy-od->log_average_energy > logf(ONSET_RATIO)) {
+		onset = true;
+		od->nr_blocks_to_wait = od->nr_refractory_blocks;
+	}
+	od->log_average_energy += od->average_rate*(log_energy-od->log_average_energy);
+	return onset;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ */
+#include <string.h>
+#include "pitch.h"
+
+/**
+ * Get the product of the harmonic magnitudes of the bin in the bandwidth, i.e. what the value of the
+ * bin after HPS is the log of in the float version, less the padding of the harmonics above the bandwidth. The fixed-point version of HPS scales the magnitudes so its value
+ * isn't comparable across frames.
+ */
+static float32_t harmonic_product(const magnitude_t *freq_bin_magnitudes, int bin_index, enum frame_length frame_len,
+				  int nharmonics)
+{
+	float32_t product = magnitude_to_float(freq_bin_magnitudes[bin_index], frame_len);
+
+	for (int harmonic = 2; harmonic <= nharmonics && harmonic*bin_index < nr_bins(frame_len); ++harmonic)
+		product *= magnitude_to_float(freq_bin_magnitudes[harmonic*bin_index], frame_len);
+	return product;
+}
+
+float32_t hps_finish_ctx_nharmonics(struct dsp_ctx *ctx, int nharmonics, float32_t *strength)
+{
+	const enum frame_length frame_len = ctx->frame_len;
+	/* Only the bins that HPS and the interpolation read. */
+	const struct bin_range range = hps_magnitude_bin_range(frame_len, SAMPLING_RATE, nharmonics);
+	/* Magnitudes before HPS, to interpolate the frequency of the peak found in the HPS. */
+	magnitude_t *fft_bin_magnitudes = ctx->spectrum;
+	magnitude_t *freq_bin_magnitudes;
+	int max_bin_ind;
+
+	freq_bin_magnitudes = dsp_ctx_finish(ctx, range, false);
+	memcpy(fft_bin_magnitudes+range.first, freq_bin_magnitudes+range.first, 
+	       (range.end-range.first)*sizeof(magnitude_t));
+	dsp_ctx_harmonic_product_spectrum(ctx, freq_bin_magnitudes, nharmonics);
+	max_bin_ind = max_bin_index_in_range(freq_bin_magnitudes, 
+					     hps_candidate_bin_range(frame_len, SAMPLING_RATE, nharmonics));
+	*strength = harmonic_product(fft_bin_magnitudes, max_bin_ind, frame_len, nharmonics);
+	return dsp_ctx_interpolate_peak_freq(ctx, fft_bin_magnitudes, max_bin_ind);
+}
+
+static float32_t hps_finish_ctx(struct dsp_ctx *ctx, float32_t *strength)
+{
+	return hps_finish_ctx_nharmonics(ctx, NHARMONICS, strength);
+}
+
+static float32_t hps_finish(enum frame_length frame_len, float32_t *strength)
+{
+	return hps_finish_ctx(dsp_default_ctx(), strength);
+}
+
+const struct pitch_detector hps_pitch_detector = {
+	.name = "hps",
+	.init = hop_samples_to_freq_bin_magnitudes_init,
+	.push_block = hop_samples_to_freq_bin_magnitudes_push_block,
+	.finish = hps_finish,
+	.finish_ctx = hps_finish_ctx,
+	/*
+	 * Hops with no note being played are skipped by the energy gate (see gate.h) before the FFT,
+	 * which, unlike a fixed threshold on the HPS peak, adapts to the noise floor of the ADC and power
+	 * source. So any hop that makes it this far is taken as having a note.
+	 */
+	.min_strength = 0
+};
@@ -0,0 +1,13 @@
+% Copyright (C) 2024 Petar Turukalo
+% SPDX-License-Identifier: GPL-2.0
+% 
+% Open a plot of the filter coefficients generated by gen_halfband_filter_coeffs.m
+% in a new window. Frequencies are normalised to the sampling rate of the stage.
+
+source gen_halfband_filter_coeffs.m
+
+% Plot filter.
+freqz(coeffs, 1, 512, 1)
+drawnow()
+% Wait for plot to be closed before exiting.
+uiwait()
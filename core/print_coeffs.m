@@ -0,0 +1,32 @@
+% Copyright (C) 2024 Petar Turukalo
+% SPDX-License-Identifier: GPL-2.0
+%
+% Print filter coefficients to standard out in C syntax as a constant array of single 
+% precision 32-bit floats named array_name, of length len_name (a macro). The print_script 
+% and gen_script params name the scripts that print and generate the coefficients. The optional
+% header param names a header to include, e.g. one which defines len_name.
+
+function print_coeffs(array_name, len_name, coeffs, print_script, gen_script, header)
+	printf("/*\n")
+	printf(" * This file was automatically generated by the %s octave script.\n", print_script)
+	printf(" * See that file along with %s for more info.\n", gen_script)
+	printf(" */\n")
+	printf("#include <arm_math_types.h>\n")
+	if (nargin == 6)
+		printf("#include \"%s\"\n", header)
+	endif
+	printf("\n")
+	printf("const float32_t %s[%s] = {\n", array_name, len_name)
+	% Reverse coefficients because arm_fir_init_*() requires them in time reversed order. 
+	coeffs = fliplr(coeffs);
+	% Print coefficients. 
+	% The 9 is FLT_DECIMAL_DIG from float.h. See its documentation for more info.
+	printf("\t%.9g, %.9g, %.9g, %.9g, %.9g,\n", coeffs)
+	% Put the closing brace on its own line in case the last row of coeffs didn't 
+	% print a newline.
+	ncoeff_columns = 5;
+	if (mod(length(coeffs), ncoeff_columns) != 0)
+		printf("\n")
+	endif
+	printf("};\n")
+endfunction
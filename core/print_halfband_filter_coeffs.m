@@ -0,0 +1,10 @@
+% Copyright (C) 2024 Petar Turukalo
+% SPDX-License-Identifier: GPL-2.0
+%
+% Print the filter coefficients generated by gen_halfband_filter_coeffs.m 
+% to standard out in C syntax as a constant array of single precision 32-bit floats.
+
+source gen_halfband_filter_coeffs.m
+
+print_coeffs("halfband_filter_coefficients", "HALFBAND_NR_TAPS", coeffs, ...
+	     "print_halfband_filter_coeffs.m", "gen_halfband_filter_coeffs.m", "decimate.h")
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ */
+#include "ring.h"
+
+void spsc_ring_init(struct spsc_ring *ring, void *slots, size_t slot_size, uint32_t nr_slots)
+{
+	ring->slots = slots;
+	ring->slot_size = slot_size;
+	ring->nr_slots = nr_slots;
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	atomic_init(&ring->nr_overruns, 0);
+	atomic_init(&ring->nr_empty_polls, 0);
+}
+
+static uint8_t *slot(struct spsc_ring *ring, uint32_t index)
+{
+	return ring->slots+(index & (ring->nr_slots-1))*ring->slot_size;
+}
+
+void *spsc_ring_write_slot(struct spsc_ring *ring, uint32_t i)
+{
+	/* Only the producer writes head, so it can load its own writes relaxed. */
+	const uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	const uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+	if (head-tail+i >= ring->nr_slots)
+		return NULL;
+	return slot(ring, head+i);
+}
+
+bool spsc_ring_publish(struct spsc_ring *ring, uint32_t n)
+{
+	const uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	const uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+	if (head-tail+n > ring->nr_slots-1) {
+		atomic_store_explicit(&ring->nr_overruns,
+				      atomic_load_explicit(&ring->nr_overruns, memory_order_relaxed)+n,
+				      memory_order_relaxed);
+		return false;
+	}
+	atomic_store_explicit(&ring->head, head+n, memory_order_release);
+	return true;
+}
+
+uint32_t spsc_ring_nr_readable(struct spsc_ring *ring)
+{
+	return atomic_load_explicit(&ring->head, memory_order_acquire) -
+	       atomic_load_explicit(&ring->tail, memory_order_relaxed);
+}
+
+const void *spsc_ring_read_slot(struct spsc_ring *ring, uint32_t i)
+{
+	if (i >= spsc_ring_nr_readable(ring)) {
+		atomic_store_explicit(&ring->nr_empty_polls,
+				      atomic_load_explicit(&ring->nr_empty_polls, memory_order_relaxed)+1,
+				      memory_order_relaxed);
+		return NULL;
+	}
+	return slot(ring, atomic_load_explicit(&ring->tail, memory_order_relaxed)+i);
+}
+
+void spsc_ring_consume(struct spsc_ring *ring, uint32_t n)
+{
+	const uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+	atomic_store_explicit(&ring->tail, tail+n, memory_order_release);
+}
+
+uint32_t spsc_ring_nr_overruns(struct spsc_ring *ring)
+{
+	return atomic_load_explicit(&ring->nr_overruns, memory_order_relaxed);
+}
+
+uint32_t spsc_ring_nr_empty_polls(struct spsc_ring *ring)
+{
+	return atomic_load_explicit(&ring->nr_empty_polls, memory_order_relaxed);
+}
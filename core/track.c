@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ */
+#include <math.h>
+#include <stdlib.h>
+#include "track.h"
+#include "dsp.h"
+
+/* 
+ * Hann window, so that the leakage of the other harmonics and notes doesn't swamp the peaks. It's the same
+ * for every tracker, so only the first note_tracker_init() computes it, rather than each rewriting it under
+ * the trackers already running.
+ */
+static float32_t hann_window[TRACK_WINDOW_LEN];
+static bool hann_window_computed;
+
+void note_tracker_init(struct note_tracker *nt, struct dsp_ctx *ctx, int block_len)
+{
+	const float32_t block_period = (float32_t)block_len/(OVERSAMPLING_FACTOR*SAMPLING_RATE);
+
+	nt->ctx = ctx;
+	nt->reference_decay = powf(TRACK_REFERENCE_DECAY, block_period);
+	if (!hann_window_computed) {
+		for (int i = 0; i < TRACK_WINDOW_LEN; ++i)
+			hann_window[i] = 0.5f-0.5f*cosf(2*PI*i/TRACK_WINDOW_LEN);
+		hann_window_computed = true;
+	}
+	note_tracker_unlock(nt);
+}
+
+void note_tracker_unlock(struct note_tracker *nt)
+{
+	nt->note = nt->candidate = NULL;
+	nt->nr_candidate_readings = 0;
+}
+
+bool note_tracker_lock(struct note_tracker *nt, float32_t frequency)
+{
+	struct note_freq *nf = nearest_note(frequency);
+
+	if (!nf || nf != nt->candidate)
+		nt->nr_candidate_readings = 0;
+	nt->candidate = nf;
+	if (!nf || ++nt->nr_candidate_readings < TRACK_LOCK_READINGS)
+		return false;
+	nt->note = nf;
+	nt->frequency = frequency;
+	nt->reference_power = 0;
+	return true;
+}
+
+/**
+ * Get the power of the DFT of the samples at the frequency, which unlike the FFT needn't be at the centre
+ * of a bin. The Goertzel algorithm gets it with a real multiply-add per sample.
+ */
+static float32_t goertzel_power(const float32_t *samples, int len, float32_t frequency)
+{
+	const float32_t coeff = 2*cosf(2*PI*frequency/SAMPLING_RATE);
+	float32_t s, s1 = 0, s2 = 0;
+
+	for (int i = 0; i < len; ++i) {
+		s = samples[i]+coeff*s1-s2;
+		s2 = s1;
+		s1 = s;
+	}
+	return s1*s1+s2*s2-coeff*s1*s2;
+}
+
+float32_t note_tracker_track(struct note_tracker *nt)
+{
+	/* The tracker runs between finishes, so the window can go in the scratch of the context. */
+	float32_t *windowed = nt->ctx->scratch;
+	const sample_t *newest = dsp_ctx_newest(nt->ctx, TRACK_WINDOW_LEN);
+	const float32_t binwidth = (float32_t)SAMPLING_RATE/TRACK_WINDOW_LEN;
+	float32_t power = 0, weighted_frequencies = 0, frequency;
+
+	for (int i = 0; i < TRACK_WINDOW_LEN; ++i)
+		windowed[i] = hann_window[i]*newest[i];
+	for (int harmonic = 1; harmonic <= TRACK_NHARMONICS; ++harmonic) {
+		const float32_t centre = harmonic*nt->frequency;
+		float32_t below, peak, above, denominator, offset;
+
+		if (centre+binwidth >= nyquist_frequency(SAMPLING_RATE))
+			break;
+		/* Plus one so that the logs are finite. */
+		below = logf(goertzel_power(windowed, TRACK_WINDOW_LEN, centre-binwidth)+1);
+		peak = goertzel_power(windowed, TRACK_WINDOW_LEN, centre);
+		above = logf(goertzel_power(windowed, TRACK_WINDOW_LEN, centre+binwidth)+1);
+		/* 
+		 * The log of the main lobe of the Hann window is close to a parabola, so fit one through the
+		 * three points. If they aren't about a peak, the peak is further than a bin away: move a bin
+		 * towards it, and get the rest of the way in the next refreshes.
+		 */
+		denominator = below-2*logf(peak+1)+above;
+		offset = denominator < 0 ? 0.5f*(below-above)/denominator : (above > below ? 1 : -1);
+		offset = fmaxf(-1, fminf(offset, 1));
+		/* Weight the estimate of each harmonic by its power, as the weak ones are the least accurate. */
+		weighted_frequencies += peak*(centre+offset*binwidth)/harmonic;
+		power += peak;
+	}
+	nt->reference_power = fmaxf(power, nt->reference_power*nt->reference_decay);
+	if (power == 0 || power < nt->reference_power*TRACK_COLLAPSE_RATIO) {
+		note_tracker_unlock(nt);
+		return 0;
+	}
+	frequency = weighted_frequencies/power;
+	if (abs(cents_difference(frequency, nt->note)) > CENTS_IN_SEMITONE) {
+		note_tracker_unlock(nt);
+		return 0;
+	}
+	nt->frequency = frequency;
+	return frequency;
+}
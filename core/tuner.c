@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ */
+#include "tuner.h"
+#include "pitch.h"
+
+_Static_assert(TUNER_FRAME_LEN-TUNER_HOP_LEN >= TRACK_WINDOW_LEN, "frame too short for the note tracker window");
+
+void tuner_init(struct tuner *tuner)
+{
+	TUNER_PITCH_DETECTOR.init(TUNER_FRAME_LEN, TUNER_HOP_LEN);
+	energy_gate_init(&tuner->gate);
+	onset_detector_init(&tuner->onset_detector, TUNER_BLOCK_LEN);
+	note_tracker_init(&tuner->note_tracker, dsp_default_ctx(), TUNER_BLOCK_LEN);
+	adc_converter_init(&tuner->adc_converter);
+	tuner->nr_hop_blocks_left = TUNER_BLOCKS_IN_HOP;
+}
+
+bool tuner_push_block(struct tuner *tuner, const uint16_t *u12_samples, float32_t *frequency)
+{
+	bool new_reading = false;
+	float32_t strength;
+
+	convert_adc_u12_samples(&tuner->adc_converter, u12_samples, tuner->block, TUNER_BLOCK_LEN);
+	TUNER_PITCH_DETECTOR.push_block(tuner->block, TUNER_BLOCK_LEN);
+	if (onset_detector_update(&tuner->onset_detector, hop_samples_block_energy())) {
+		hop_samples_restart_hop(TUNER_BLOCK_LEN, TUNER_ONSET_HOP_LEN);
+		tuner->nr_hop_blocks_left = TUNER_BLOCKS_IN_ONSET_HOP;
+		/* The pluck may be of another string. */
+		note_tracker_unlock(&tuner->note_tracker);
+	}
+	/*
+	 * Once locked onto a note, refresh it after every block rather than every hop, and as soon as it's
+	 * lost rather than leave it displayed until the end of the hop.
+	 */
+	if (tuner->note_tracker.note) {
+		*frequency = note_tracker_track(&tuner->note_tracker);
+		new_reading = true;
+	}
+	if (--tuner->nr_hop_blocks_left != 0)
+		return new_reading;
+	tuner->nr_hop_blocks_left = TUNER_BLOCKS_IN_HOP;
+	/*
+	 * No note is being played if the hop is barely louder than the noise floor, so don't bother with
+	 * the FFT. The first few hops after power on calibrate the noise floor.
+	 */
+	if (!energy_gate_update(&tuner->gate, hop_samples_energy())) {
+		note_tracker_unlock(&tuner->note_tracker);
+		*frequency = 0;
+		return true;
+	}
+	/* Only fall back to the full search when the note isn't being tracked. */
+	if (tuner->note_tracker.note)
+		return new_reading;
+	*frequency = TUNER_PITCH_DETECTOR.finish(TUNER_FRAME_LEN, &strength);
+	/*
+	 * Only read a note if the reading is strong enough, in order to filter out readings where there is
+	 * no clear note despite the energy, e.g. a knock. See the min_strength of the pitch detector.
+	 */
+	if (strength < TUNER_PITCH_DETECTOR.min_strength)
+		*frequency = 0;
+	note_tracker_lock(&tuner->note_tracker, *frequency);
+	return true;
+}
@@ -37,10 +37,24 @@ struct write_coord {
 
 /**
  * @brief Copy a ncols by nrows source 2D bit array to a destination 2D bit array.
+ *
+ * The source is clipped to the destination once, then each row is copied a destination byte at a time,
+ * shifting the source bits into place and masking them in, rather than a bit at a time.
+ *
  * @param ncols Must be a multiple of BITS_IN_BYTE.
  */
 void bit_array_2d_copy(uint8_t *dest_bit_array, int dest_ncols, int dest_nrows,
 		       uint8_t *src_bit_array, int src_ncols, int src_nrows,
 		       struct write_coord coord);
 
+/**
+ * @brief Set the width by height rectangle of the 2D bit array with its top left corner at coord to value,
+ *        clipped to the 2D bit array.
+ * @param ncols Must be a multiple of BITS_IN_BYTE.
+ */
+void bit_array_2d_fill_rect(uint8_t *bit_array, int ncols, int nrows, struct write_coord coord,
+			    int width, int height, bool value);
+/** @brief Set len bits of row i of the 2D bit array from column j to value. See bit_array_2d_fill_rect(). */
+void bit_array_2d_fill_span(uint8_t *bit_array, int ncols, int nrows, int i, int j, int len, bool value);
+
 #endif
@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <arm_math_types.h>
+#include "dsp.h"
 
 /**
  * The MCU ADC read function returns the voltage of the electrical
@@ -17,5 +18,42 @@
  * DSP anyway, and to not lose resolution when uspcaling to signed 16-bit.
  */
 float32_t convert_adc_u12_sample_to_s16(uint16_t u12_sample);
+/**
+ * Fixed-point version of convert_adc_u12_sample_to_s16() for the FIXED_POINT pipeline (see dsp.h): 
+ * a q15 with the same value as the signed 16-bit sample, give or take the rounding of the zero value 
+ * to 2048 as a shift can't scale by the exact INT16_MAX/2047.5 of the float version.
+ */
+q15_t convert_adc_u12_sample_to_q15(uint16_t u12_sample);
+
+/* 
+ * Number of fractional bits of the DC offset estimate of struct adc_converter, and the shift of the 
+ * rate it tracks the mean of each batch at (1/64, i.e. a time constant of 64 batches, ~2 seconds for
+ * blocks of 256 at an OVERSAMPLING_RATE of 8000: far longer than the period of the lowest note).
+ */
+#define ADC_DC_FRAC_BITS  8
+#define ADC_DC_RATE_SHIFT  6
+
+/**
+ * @brief Batched conversion of raw 12-bit ADC samples to sample_t, with the DC offset removed.
+ *
+ * Rather than converting each sample as it's read (in the ADC interrupt), store the raw 12-bit samples 
+ * (half the size of a float) and convert a whole block right before pushing it to the DSP. The DC offset
+ * subtracted isn't the nominal VCC/2 bias of convert_adc_u12_sample_to_s16() but an estimate of the
+ * actual bias, which drifts with the supply and microphone, tracked from the mean of each batch.
+ */
+struct adc_converter {
+	/* Estimate of the DC offset, in raw samples with ADC_DC_FRAC_BITS fractional bits. */
+	int32_t dc;
+};
+
+/** @brief Initialise the DC offset estimate to the nominal bias of VCC/2. */
+void adc_converter_init(struct adc_converter *conv);
+/**
+ * Convert len raw 12-bit samples to samples with the same scale as convert_adc_u12_sample_to_s16() 
+ * (or convert_adc_u12_sample_to_q15() in the fixed-point version), less the DC offset estimate, then 
+ * update the estimate with the mean of the batch. The conversion and the sum for the mean are fused 
+ * into a single pass with no branches, which the compiler can vectorise.
+ */
+void convert_adc_u12_samples(struct adc_converter *conv, const uint16_t *u12_samples, sample_t *samples, int len);
 
 #endif
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Compile-time layout of the memory of a DSP context (see dsp.h:dsp_ctx), so that it can be carved
+ * from a static arena sized exactly for a frame length, e.g. that of the MCU, rather than for
+ * MAX_FRAME_LEN.
+ *
+ * The buffers are laid out by the phase of a hop in which they're live, and buffers of phases that
+ * don't intersect share memory.
+ * 1. Always: the decimator and the frame, which persist across hops.
+ * 2. Between finishes, while the blocks of a hop are pushed: scratch (e.g. for track.h).
+ * 3. FFT, at the start of a finish: its input buf and its output fft_complex_nrs.
+ * 4. Peak, once the magnitudes are in the first half of buf: the buffers of HPS and the copy of the
+ *    magnitudes of the pitch detectors, spectrum.
+ * Scratch and the buffers of HPS overlay fft_complex_nrs, and spectrum the second half of buf, which
+ * for a frame of FRAME_LEN_4096 saves 20 KB in the float version over a buffer each.
+ */
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "dsp.h"
+#include "decimate.h"
+
+/* Round a buffer size up so that the buffer carved after it is aligned for any of the sample types. */
+#define ARENA_ALIGN(size)  (((size)+7) & ~(size_t)7)
+#define ARENA_MAX(a, b)  ((a) > (b) ? (a) : (b))
+/** @brief Define a static arena of at least size bytes, aligned for any of the sample types. */
+#define ARENA_DEFINE(name, size)  static uint64_t name[ARENA_ALIGN(size)/sizeof(uint64_t)]
+
+/* The float FFT outputs half the spectrum and the q31 FFT the whole mirrored spectrum. */
+#if FIXED_POINT
+#define FFT_COMPLEX_NRS_LEN(frame_len)  (2*(frame_len))
+#else
+#define FFT_COMPLEX_NRS_LEN(frame_len)  (frame_len)
+#endif
+/* The HPS of the candidate fundamentals, of nr_bins(), then the downsampled spectrum, of half that. */
+#define DSP_CTX_HPS_LEN(frame_len)  ((frame_len)/2 + (frame_len)/4)
+
+/* Offsets in bytes of the buffers of a context from the start of its memory. */
+#define DSP_CTX_FRAME_OFFSET  ARENA_ALIGN(sizeof(struct decimator))
+#define DSP_CTX_BUF_OFFSET(frame_len)  (DSP_CTX_FRAME_OFFSET + ARENA_ALIGN((frame_len)*sizeof(sample_t)))
+#define DSP_CTX_SPECTRUM_OFFSET(frame_len)  (DSP_CTX_BUF_OFFSET(frame_len) + (frame_len)/2*sizeof(magnitude_t))
+/* Of fft_complex_nrs, the buffers of HPS and scratch. */
+#define DSP_CTX_PHASE_OFFSET(frame_len)  (DSP_CTX_BUF_OFFSET(frame_len) + ARENA_ALIGN((frame_len)*sizeof(magnitude_t)))
+#define DSP_CTX_DOWNSAMPLED_SPECTRUM_OFFSET(frame_len)  (DSP_CTX_PHASE_OFFSET(frame_len) + (frame_len)/2*sizeof(magnitude_t))
+
+/** @brief Number of bytes of memory of a context of frame_len. See dsp_ctx_mem_size(). */
+#define DSP_CTX_MEM_SIZE(frame_len)  (DSP_CTX_PHASE_OFFSET(frame_len) + \
+	ARENA_ALIGN(ARENA_MAX(FFT_COMPLEX_NRS_LEN(frame_len), DSP_CTX_HPS_LEN(frame_len))*sizeof(magnitude_t)))
+
+/** @brief Get a pointer of type to the buffer at offset bytes into the memory. A constant if mem is. */
+#define ARENA_AT(type, mem, offset)  ((type *)((char *)(mem) + (offset)))
+
+#endif
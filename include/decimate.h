@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Multi-stage filter and decimator, taking samples from the OVERSAMPLING_RATE down
+ * to the SAMPLING_RATE in stages that each decimate by 2. 
+ *
+ * The last stage decimates from twice the SAMPLING_RATE down to the SAMPLING_RATE with the 
+ * steep NR_TAPS band-pass filter (see gen_filter_coeffs.m). Every stage before it (there are 
+ * none for an OVERSAMPLING_FACTOR of 2) decimates with a half-band filter (see 
+ * gen_halfband_filter_coeffs.m), which is very cheap compared to the band-pass filter because 
+ * it only needs to stop the frequencies that would alias into the band kept by the last stage, 
+ * which leaves it a wide transition band and so few taps, of which almost half are zero. 
+ * This way the cost per output sample stays close to that of a single decimate by 2 stage, 
+ * no matter the OVERSAMPLING_FACTOR.
+ */
+#ifndef DECIMATE_H
+#define DECIMATE_H
+
+#include <arm_math_types.h>
+#include <dsp/filtering_functions.h>
+#include "dsp.h"
+
+/* 
+ * Must be 3 more than a multiple of 4 so that the taps at either end of the half-band
+ * filter aren't zero.
+ */
+#define HALFBAND_NR_TAPS  HALFBAND_NR_TAPS_FROM_MAKEFILE
+/** 
+ * @brief Length of the state buffer of a half-band decimator which decimates at most 
+ *        max_nsamples samples per call. 
+ */
+#define HALFBAND_DECIMATOR_STATE_LEN(max_nsamples)  (HALFBAND_NR_TAPS-1+(max_nsamples))
+
+struct halfband_decimator {
+	/* 
+	 * The last HALFBAND_NR_TAPS-1 samples from the previous call followed by the new
+	 * samples of the current call.
+	 */
+	sample_t *state;
+};
+
+#if OVERSAMPLING_FACTOR == 2
+#define NR_HALFBAND_STAGES 0
+#elif OVERSAMPLING_FACTOR == 4
+#define NR_HALFBAND_STAGES 1
+#elif OVERSAMPLING_FACTOR == 8
+#define NR_HALFBAND_STAGES 2
+#elif OVERSAMPLING_FACTOR == 16
+#define NR_HALFBAND_STAGES 3
+#else
+#error "OVERSAMPLING_FACTOR must be one of 2, 4, 8 or 16"
+#endif
+
+/*
+ * Samples are decimated in chunks of at most this many decimated (output) samples so
+ * that the state of each stage, which must fit a whole chunk, doesn't have to be as big 
+ * as a frame.
+ */
+#define DECIMATE_CHUNK_LEN 64
+#define MAX_CHUNK_NSAMPLES (OVERSAMPLING_FACTOR*DECIMATE_CHUNK_LEN)
+/* 
+ * Total length of the states of all half-band stages. The first stage takes a whole chunk 
+ * of MAX_CHUNK_NSAMPLES samples and each stage after it takes half as many as the one before.
+ */
+#define HALFBAND_STATES_LEN (NR_HALFBAND_STAGES*(HALFBAND_NR_TAPS-1) + 2*MAX_CHUNK_NSAMPLES - 4*DECIMATE_CHUNK_LEN)
+
+/** The state of all stages of a stream of samples being decimated. */
+struct decimator {
+	/* Without half-band stages these would be zero-length arrays, which ISO C doesn't allow. */
+#if NR_HALFBAND_STAGES
+	struct halfband_decimator halfband_decimators[NR_HALFBAND_STAGES];
+	sample_t halfband_states[HALFBAND_STATES_LEN];
+	/* Output of the half-band stages, each decimating in place on the output of the previous. */
+	sample_t halfband_decimated_samples[MAX_CHUNK_NSAMPLES/2];
+#endif
+	/* The last stage takes the output of the half-band stages, a chunk decimated down to twice the SAMPLING_RATE. */
+	sample_t fir_state[NR_TAPS+(2*DECIMATE_CHUNK_LEN)-1];
+#if FIXED_POINT
+	arm_fir_decimate_instance_q15 fir_decimate_instance;
+#else
+	arm_fir_decimate_instance_f32 fir_decimate_instance;
+#endif
+};
+
+/** @param state Of length HALFBAND_DECIMATOR_STATE_LEN(). */
+void halfband_decimator_init(struct halfband_decimator *hbd, sample_t *state);
+/**
+ * Half-band filter nsamples samples and decimate them by 2 to nsamples/2 decimated samples. 
+ * @param nsamples Must be even.
+ * @param decimated_samples Can be the same as samples to decimate in place.
+ */
+void halfband_decimate(struct halfband_decimator *hbd, const sample_t *samples, 
+		       sample_t *decimated_samples, int nsamples);
+
+/** 
+ * @brief Initialise (and reset) the state of all stages of the decimator. In the fixed-point version this also
+ *        converts the filter coefficients to q15.
+ */
+void decimate_init(struct decimator *dec);
+/**
+ * Filter and decimate nsamples samples at the OVERSAMPLING_RATE down to nsamples/OVERSAMPLING_FACTOR
+ * samples at the SAMPLING_RATE. Filter state is kept between calls so a stream of samples can be 
+ * decimated in any number of calls.
+ *
+ * @param nsamples Must be a multiple of OVERSAMPLING_FACTOR.
+ */
+void decimate(struct decimator *dec, const sample_t *samples, sample_t *decimated_samples, int nsamples);
+
+#endif
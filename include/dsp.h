@@ -6,7 +6,10 @@
 #define DSP_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <arm_math_types.h>
+#include <dsp/transform_functions.h>
 
 /**
  * SAMPLING_RATE is the sampling rate after decimation down from the OVERSAMPLING_RATE. 
@@ -23,9 +26,33 @@
 #define OVERSAMPLING_FACTOR  OVERSAMPLING_FACTOR_FROM_MAKEFILE
 #define OVERSAMPLING_RATE  (SAMPLING_RATE*OVERSAMPLING_FACTOR)
 
+/**
+ * FIXED_POINT selects the fixed-point version of the DSP pipeline, for MCUs without an FPU where 
+ * float processing is too slow. Samples (sample_t) are q15 with the same value as the float 
+ * version's signed 16-bit range samples, and are filtered and decimated with arm_fir_decimate_q15().
+ * The FFT is arm_rfft_q31(), which has the headroom for its bit growth that arm_rfft_q15() doesn't,
+ * and the frequency bin magnitudes (magnitude_t) are q31. The time domain samples take half the 
+ * memory of the float version, but the FFT output takes twice as it's the whole mirrored spectrum.
+ *
+ * Only the frequency domain pipeline has a fixed-point version; the time domain pitch detectors
+ * in pitch.h are float only.
+ */
+#define FIXED_POINT  FIXED_POINT_FROM_MAKEFILE
+
+#if FIXED_POINT
+typedef q15_t sample_t;
+typedef q31_t magnitude_t;
+#else
+typedef float32_t sample_t;
+typedef float32_t magnitude_t;
+#endif
+
 /**
  * @brief FFT frame lengths (number of samples in a frame). 
- * @warning only FRAME_LEN_4096 is currently supported.
+ *
+ * Each frame length needs its own FFT tables, which take up a lot of memory, so only those
+ * listed in frame_lengths in core/dsp_params.mk are linked. A shorter frame length fills
+ * quicker (lower latency) at the cost of a wider bin_width() (worse frequency resolution).
  */
 enum frame_length {
 	FRAME_LEN_32   = 32,
@@ -43,6 +70,14 @@ enum frame_length {
  */
 #define MAX_FRAME_LEN  FRAME_LEN_4096
 #define MAX_NR_BINS (MAX_FRAME_LEN/2)
+/* The longest of frame_lengths in core/dsp_params.mk, i.e. the longest that can be selected at run time. */
+#define MAX_LINKED_FRAME_LEN  MAX_LINKED_FRAME_LEN_FROM_MAKEFILE
+
+/** @brief A range of frequency bin indices, from first up to but not including end. */
+struct bin_range {
+	int first;
+	int end;
+};
 
 
 /**
@@ -61,13 +96,215 @@ enum frame_length {
  * and is centred about frequency i*bin_width() (see also bin_index_to_freq()). 
  * Bins start at index 1 because index 0 is for the DC offset and can be ignored.
  *
- * @warning The input samples array is reused and trashed by the implementation of this function in
- *          order to save MCU RAM space.
+ * The frame length can be changed at run time by calling the init function again with the new length.
+ * The init function returns false if the FFT tables for frame_len weren't linked.
+ *
+ * The input samples are only read: they are filtered and decimated into the frame of the default 
+ * context (see struct dsp_ctx).
+ *
  * @warning The return is a static buffer and will trash the previous return when
  *          called in sequence.
  */
-void samples_to_freq_bin_magnitudes_init(enum frame_length frame_len);
-float32_t *samples_to_freq_bin_magnitudes(float32_t *samples, enum frame_length frame_len);
+bool samples_to_freq_bin_magnitudes_init(enum frame_length frame_len);
+magnitude_t *samples_to_freq_bin_magnitudes(const sample_t *samples, enum frame_length frame_len);
+
+/**
+ * Sliding (overlapping frame) version of samples_to_freq_bin_magnitudes(). Rather than waiting
+ * for a whole new oversized frame to fill, the frame is advanced by a hop of hop_len samples
+ * at a time, so a new set of frequency bin magnitudes is produced every hop_len samples at
+ * the same frequency resolution as frame_len.
+ *
+ * The oversized hop of samples is of length hop_len*OVERSAMPLING_FACTOR. Only the new hop is
+ * low-pass filtered and decimated: the previous frame_len-hop_len filtered and decimated samples
+ * are kept from previous calls. Until frame_len/hop_len hops have been processed since
+ * initialisation the frame is padded at the start with zeros.
+ *
+ * @param hop_len Must evenly divide frame_len, e.g. frame_len/4 for 4 updates per frame.
+ * @warning The return is the same static buffer as that of samples_to_freq_bin_magnitudes().
+ * @warning Don't interleave calls with samples_to_freq_bin_magnitudes() as they share
+ *          filter state: call the matching init function when switching between them.
+ */
+bool hop_samples_to_freq_bin_magnitudes_init(enum frame_length frame_len, int hop_len);
+magnitude_t *hop_samples_to_freq_bin_magnitudes(const sample_t *samples, enum frame_length frame_len, int hop_len);
+
+/**
+ * Streaming versions of samples_to_freq_bin_magnitudes() and hop_samples_to_freq_bin_magnitudes().
+ * Rather than filtering and decimating a whole oversized frame (or hop) in one go after it has
+ * filled, each block of block_len oversampled samples is pushed, and filtered and decimated, as
+ * soon as it's available, so that the filtering is done while the frame (or hop) is still filling.
+ * Once all the blocks of the frame (or hop) have been pushed, call the matching finish function to 
+ * run the remaining steps (FFT and magnitudes) and get the frequency bin magnitudes.
+ *
+ * Initialise with the same init function as the non-streaming version. A call to the non-streaming
+ * version is the same as pushing the whole oversized frame (or hop) as a single block then finishing.
+ *
+ * The pushed blocks are only read, so they can be e.g. a read-only view of a file or the half of a 
+ * DMA buffer that the ADC isn't writing, and the frame and hop lengths are those of the init call.
+ *
+ * @param block_len Must be a multiple of OVERSAMPLING_FACTOR, and evenly divide the oversized frame 
+ *	  (or hop) length.
+ */
+void samples_to_freq_bin_magnitudes_push_block(const sample_t *samples, int block_len);
+magnitude_t *samples_to_freq_bin_magnitudes_finish(enum frame_length frame_len);
+void hop_samples_to_freq_bin_magnitudes_push_block(const sample_t *samples, int block_len);
+magnitude_t *hop_samples_to_freq_bin_magnitudes_finish(enum frame_length frame_len);
+/**
+ * Pruned version of hop_samples_to_freq_bin_magnitudes_finish() that only gets the magnitudes of the 
+ * bins in range, e.g. hps_magnitude_bin_range(): the magnitudes of the other bins are undefined. 
+ *
+ * @param approximate Whether to approximate the magnitudes with alpha max plus beta min, which saves 
+ *	  a square root per bin at an error of up to ~4%.
+ */
+magnitude_t *hop_samples_to_freq_bin_magnitudes_range_finish(enum frame_length frame_len, struct bin_range range,
+							     bool approximate);
+/**
+ * Get the energy (mean square) of the filtered and decimated samples of the hop whose blocks have all 
+ * been pushed, in units of a signed 16-bit integer squared. It's computed as the blocks are pushed so 
+ * is cheap: use it to decide whether to finish the hop at all, e.g. with an energy gate (see gate.h).
+ * A hop that isn't finished is dropped when the first block of the next hop is pushed.
+ *
+ * @warning Call it before the hop is finished.
+ */
+float32_t hop_samples_energy(void);
+/** @brief Same as hop_samples_energy() but of just the last block pushed, e.g. for onset.h. */
+float32_t hop_samples_block_energy(void);
+/**
+ * Restart the current hop at the last block pushed, e.g. on an onset (see onset.h), so that the analysis
+ * is aligned to the block rather than to fixed hop boundaries. The samples of the hop before the block
+ * are dropped and the rest of the frame zeroed, so that the frame starts with the block. The hop is 
+ * cut short to first_hop_len filtered samples from the start of the block, so that it can be finished 
+ * soon after the block, and the hops after it are of the hop_len of the init call as usual.
+ *
+ * @param first_hop_len At least block_len/OVERSAMPLING_FACTOR and at most hop_len, in steps of it.
+ */
+void hop_samples_restart_hop(int block_len, int first_hop_len);
+/**
+ * Get the newest len filtered and decimated samples pushed, oldest first, e.g. for the narrowband 
+ * analysis of track.h. Unlike the frame, they are available after each block rather than each hop.
+ *
+ * @param len At most frame_len-hop_len+block_len/OVERSAMPLING_FACTOR.
+ * @warning The samples are only valid until the next push.
+ */
+const sample_t *hop_samples_newest(int len);
+
+/**
+ * Finish a hop like hop_samples_to_freq_bin_magnitudes_finish(), but instead of the frequency bin
+ * magnitudes return the autocorrelation of the window of the newest frame_len/2 filtered and 
+ * decimated samples, for the time domain pitch detectors (see pitch.h). The autocorrelation at 
+ * lag i (0 <= i < frame_len/2) is the sum of window[j]*window[j+i] over j. It is computed with
+ * FFTs of frame_len, which is why the window is only half the frame length.
+ *
+ * @param window Output pointer to the window, valid until the next push.
+ * @warning The return is the same static buffer as that of samples_to_freq_bin_magnitudes().
+ * @warning Float version only.
+ */
+#if !FIXED_POINT
+float32_t *hop_samples_to_autocorrelation_finish(enum frame_length frame_len, const float32_t **window);
+#endif
+
+struct decimator;
+
+/**
+ * @brief The state and buffers of a hop pipeline (see hop_samples_to_freq_bin_magnitudes() and its
+ *        streaming version), so that more than one can run at a time.
+ *
+ * The functions above that don't take a context all run on the same default context (see
+ * dsp_default_ctx()), so only one pipeline of them can run per process. A context of its own runs
+ * independently of all others, e.g. one per thread of a batch analysis on the host, or pipelines of
+ * different frame lengths side by side on the MCU. Each function dsp_ctx_*() is the same as its
+ * namesake above without the context, apart from the frame and hop lengths being those given to 
+ * dsp_ctx_init(). A whole frame is a hop of the frame length.
+ *
+ * The buffers are carved from memory provided by the caller, e.g. a static arena sized at compile time
+ * (see arena.h), so a context allocates nothing and dsp_ctx_destroy() frees nothing: the caller frees 
+ * the memory after destroying the context. Buffers that are never live at the same time share memory.
+ * The fields are read-only outside of dsp.c, except spectrum.
+ */
+struct dsp_ctx {
+	enum frame_length frame_len;
+	int hop_len;
+#if FIXED_POINT
+	arm_rfft_instance_q31 fft_instance;
+#else
+	arm_rfft_fast_instance_f32 fft_instance;
+#endif
+	struct decimator *decimator;
+	/*
+	 * The last frame_len filtered and decimated samples, oldest first. Each hop shifts out the
+	 * oldest hop_len samples and appends the newest hop_len samples at the end.
+	 */
+	sample_t *hop_frame;
+	/* 
+	 * Input of the FFT, a copy of the frame as the FFT trashes its input, reused for the output 
+	 * frequency bin magnitudes (or the autocorrelation). Of frame_len.
+	 */
+	magnitude_t *buf;
+	/* 
+	 * Output of the FFT: half the spectrum, frame_len floats, in the float version, but the whole 
+	 * mirrored spectrum, 2*frame_len q31s, in the fixed-point version.
+	 */
+	magnitude_t *fft_complex_nrs;
+	/* Buffers of HPS: the HPS of the candidate fundamentals and the spectrum downsampled for a harmonic. */
+	magnitude_t *hps;
+	magnitude_t *downsampled_spectrum;
+	/* 
+	 * Of nr_bins(), free for the pitch detectors to keep a copy of the magnitudes in after a finish, 
+	 * e.g. before HPS. Trashed by the next finish.
+	 */
+	magnitude_t *spectrum;
+	/* 
+	 * At least frame_len magnitudes, free for use between a finish and the next push, e.g. by track.h.
+	 * Trashed by finishes and by HPS.
+	 */
+	void *scratch;
+	/* Number of filtered and decimated samples streamed into the current hop so far. */
+	int nr_filtered_samples;
+	/* 
+	 * Sum of the squares of the filtered and decimated samples pushed to the current hop so far, and the 
+	 * number of them. Fewer than the hop length are pushed to a hop cut short by dsp_ctx_restart_hop().
+	 */
+#if FIXED_POINT
+	q63_t hop_sum_of_squares;
+#else
+	float32_t hop_sum_of_squares;
+#endif
+	int nr_hop_energy_samples;
+	/* Energy of the last block pushed. */
+	float32_t block_energy;
+	/* One past the newest filtered and decimated sample pushed. */
+	const sample_t *newest_filtered_samples_end;
+	/* 
+	 * Number of the newest samples of the frame pushed since the context was reset or the hop was
+	 * restarted, up to frame_len. The older ones are zeros. See dsp_ctx_interpolate_peak_freq().
+	 */
+	int nr_frame_samples;
+};
+
+/** @brief Get the number of bytes of memory a context of frame_len needs. See also arena.h:DSP_CTX_MEM_SIZE(). */
+size_t dsp_ctx_mem_size(enum frame_length frame_len);
+/**
+ * Initialise (and reset) a context, carving its buffers from mem. Call it again, with the same or 
+ * other memory, to change the frame or hop length.
+ *
+ * @param mem At least dsp_ctx_mem_size(frame_len) bytes aligned to 8 bytes, e.g. from malloc(). 
+ *	  Must outlive the context.
+ * @return false if the FFT tables for frame_len weren't linked.
+ */
+bool dsp_ctx_init(struct dsp_ctx *ctx, enum frame_length frame_len, int hop_len, void *mem);
+/** @brief Invalidate the context. Its memory can then be freed or reused. */
+void dsp_ctx_destroy(struct dsp_ctx *ctx);
+void dsp_ctx_push_block(struct dsp_ctx *ctx, const sample_t *samples, int block_len);
+/** @warning The return is the context's buf, trashed by the next finish. */
+magnitude_t *dsp_ctx_finish(struct dsp_ctx *ctx, struct bin_range range, bool approximate);
+#if !FIXED_POINT
+float32_t *dsp_ctx_autocorrelation_finish(struct dsp_ctx *ctx, const float32_t **window);
+#endif
+float32_t dsp_ctx_hop_energy(const struct dsp_ctx *ctx);
+float32_t dsp_ctx_block_energy(const struct dsp_ctx *ctx);
+void dsp_ctx_restart_hop(struct dsp_ctx *ctx, int block_len, int first_hop_len);
+const sample_t *dsp_ctx_newest(const struct dsp_ctx *ctx, int len);
+/** @brief Get the context that the functions without one run on. */
+struct dsp_ctx *dsp_default_ctx(void);
 
 int nr_bins(enum frame_length frame_len);
 int bandwidth(int sampling_rate);
@@ -82,17 +319,78 @@ int freq_to_bin_index(float32_t frequency, float32_t binwidth);
 float32_t bin_index_to_freq(int bin_index, float32_t binwidth);
 int nyquist_frequency(int sampling_rate);
 
-/* Number of harmonics can't be too high otherwise the new product value will overflow. */
+/* Default number of harmonics for harmonic_product_spectrum(). */
 #define NHARMONICS 4
 
+/**
+ * Get the bins which are candidate fundamentals of harmonic_product_spectrum(): those of the notes of
+ * note_freqs (see note.h) in the bandwidth, including those with fewer than nharmonics harmonics in it.
+ */
+struct bin_range hps_candidate_bin_range(enum frame_length frame_len, int sampling_rate, int nharmonics);
+/**
+ * Get the bins whose magnitudes harmonic_product_spectrum() and then interpolate_peak_freq() on its 
+ * peak read: the candidate fundamentals, their harmonics, and the neighbours of the candidates.
+ * Only these magnitudes need computing (see hop_samples_to_freq_bin_magnitudes_range_finish()).
+ */
+struct bin_range hps_magnitude_bin_range(enum frame_length frame_len, int sampling_rate, int nharmonics);
+
 /**
  * Apply a Harmonic Product Spectrum (HPS) to the magnitudes to turn the fundamental
  * frequency peak into the maximum peak. This is done because the maximum peak isn't 
  * necessarily the fundamental, and may be a different harmonic.
+ *
+ * Only the bins of hps_candidate_bin_range() are candidate fundamentals. More harmonics make the 
+ * fundamental stand out more. The harmonics of a candidate above the bandwidth are taken to be at the
+ * mean magnitude of the bins read, so the upper candidates are compared on as many terms as the 
+ * others. The other bins are set to no magnitude (see below), and only the 
+ * magnitudes of hps_magnitude_bin_range() are read. It runs on the buffers of the default context, so
+ * a frame longer than MAX_LINKED_FRAME_LEN has no candidates and all its bins are set to no magnitude.
+ *
+ * The float version works in the log domain, summing the log magnitudes rather than multiplying the 
+ * magnitudes so that the product can't overflow for any count of harmonics: the output is the log of 
+ * the HPS, and no magnitude is -INFINITY. In the fixed-point version the q31 magnitudes are all less 
+ * than 1 so their products can't overflow, but are first scaled up so the max magnitude is at least 
+ * half of full scale, and so are the products after each harmonic, so that they keep their precision.
+ * Here no magnitude is 0.
+ *
+ * @param nharmonics Number of harmonics in the product, including the fundamental. At least 1.
  */
-void harmonic_product_spectrum(float32_t *freq_bin_magnitudes, enum frame_length frame_len,
-			       int sampling_rate);
+void harmonic_product_spectrum(magnitude_t *freq_bin_magnitudes, enum frame_length frame_len,
+			       int sampling_rate, int nharmonics);
+/** @brief Same as harmonic_product_spectrum() at the SAMPLING_RATE but with the buffers of the context. */
+void dsp_ctx_harmonic_product_spectrum(struct dsp_ctx *ctx, magnitude_t *freq_bin_magnitudes, int nharmonics);
 /** @brief Get the index of the frequency bin with the maximum magnitude peak. */
-int max_bin_index(float32_t *freq_bin_magnitudes, enum frame_length frame_len);
+int max_bin_index(magnitude_t *freq_bin_magnitudes, enum frame_length frame_len);
+/** 
+ * @brief Same as max_bin_index() but only over the bins in range, e.g. hps_candidate_bin_range() 
+ *        after HPS. Return range.first if the range is empty. 
+ */
+int max_bin_index_in_range(magnitude_t *freq_bin_magnitudes, struct bin_range range);
+/** 
+ * @brief Convert a frequency bin magnitude to float, in the same scale as that of the float version
+ *        so that thresholds on magnitudes hold for both versions. 
+ */
+float32_t magnitude_to_float(magnitude_t magnitude, enum frame_length frame_len);
+/**
+ * Estimate the frequency of a magnitude peak to a fraction of a bin width, from the magnitudes of
+ * the peak bin and its larger neighbour. Without this the frequency resolution is limited to
+ * bin_width(), which for the shorter frame lengths is several Hz (tens of cents at low notes).
+ *
+ * @param freq_bin_magnitudes Magnitudes as returned by samples_to_freq_bin_magnitudes() (or its
+ *	  variants), i.e. before harmonic_product_spectrum() as it doesn't preserve the shape of the peak.
+ * @param bin_index Index of the peak, e.g. the fundamental found by max_bin_index() on the HPS.
+ */
+float32_t interpolate_peak_freq(const magnitude_t *freq_bin_magnitudes, int bin_index, enum frame_length frame_len,
+				int sampling_rate);
+/**
+ * Same as interpolate_peak_freq() at the SAMPLING_RATE but on the last frame finished on the context,
+ * which may only be partly filled with samples, e.g. right after initialisation or dsp_ctx_restart_hop().
+ * The zeros before the samples shorten the window, which widens the peak, so the interpolation of the
+ * full frame would pull the frequency towards the larger neighbour by up to half a bin.
+ *
+ * @warning Call it before pushing the next block.
+ */
+float32_t dsp_ctx_interpolate_peak_freq(const struct dsp_ctx *ctx, const magnitude_t *freq_bin_magnitudes, 
+					int bin_index);
 
 #endif
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Energy gate to skip the expensive DSP (the FFT and pitch detection) on hops where no note is 
+ * being played. The energy of a hop (see hop_samples_energy()) is computed as its blocks are 
+ * filtered and decimated, so the gate can be checked as soon as the last block is pushed, 
+ * before the hop is finished.
+ *
+ * The gate opens when the energy is GATE_OPEN_RATIO above an estimate of the noise floor, which
+ * tracks the noise floor over time: rather than an absolute threshold, which only holds for the
+ * noise of a particular power source (and ADC), the threshold is relative to whatever the noise is.
+ */
+#ifndef GATE_H
+#define GATE_H
+
+#include <stdbool.h>
+#include <arm_math_types.h>
+
+/* Energy ratio above the noise floor at which the gate opens (10 dB). */
+#define GATE_OPEN_RATIO  10.0f
+/* Number of hops after initialisation spent calibrating the noise floor, during which the gate is closed. */
+#define GATE_CALIBRATION_HOPS  4
+
+struct energy_gate {
+	/* Natural log of the noise floor energy estimate, as the noise floor is tracked in decibels. */
+	float32_t log_noise_floor;
+	/* Number of hops since initialisation, up to GATE_CALIBRATION_HOPS. */
+	int nr_hops;
+};
+
+/** 
+ * @brief Initialise (and reset) the gate. Nothing should be played for the first GATE_CALIBRATION_HOPS 
+ *        hops, e.g. right after power on, as they calibrate the noise floor.
+ */
+void energy_gate_init(struct energy_gate *gate);
+/**
+ * Update the noise floor estimate with the energy of a hop and return whether the gate is open for it.
+ *
+ * The estimate falls quickly to quieter hops, rises slowly to louder hops while the gate is closed, 
+ * so that it follows the noise floor, and rises very slowly while the gate is open, so that a held 
+ * note barely moves it but a lasting jump in the noise floor (e.g. a dirtier power source) is 
+ * eventually learnt rather than keeping the gate open for good.
+ */
+bool energy_gate_update(struct energy_gate *gate, float32_t energy);
+/** @brief Get the noise floor energy estimate. */
+float32_t energy_gate_noise_floor(const struct energy_gate *gate);
+
+#endif
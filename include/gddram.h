@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Incremental updates of the Graphic Display Data RAM (GDDRAM) of the SSD1306 display controller
+ * (see ../mcu/ssd1306.h). Rather than the whole 1 KB GDDRAM each frame, only the column ranges of the
+ * pages that changed since the last update are sent, which for the tuner is typically the few columns
+ * of the slider tic and sometimes the note name.
+ *
+ * The I2C transfers are made through a transport given by the caller, the I2C controller of the MCU or
+ * a mock of it on the host.
+ *
+ * Images are drawn in the page-major layout of the GDDRAM itself, so that they're sent as is.
+ */
+#ifndef GDDRAM_H
+#define GDDRAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "2d_bit_array.h"
+
+/*
+ * The GDDRAM is 8 pages of 128 columns, each column of a page a byte of 8 vertically adjacent pixels
+ * with the top pixel the LSB. See SSD1306 datasheet section 8.7.
+ */
+#define GDDRAM_NPAGES 8
+#define GDDRAM_NCOLS 128
+#define GDDRAM_LEN (GDDRAM_NPAGES*GDDRAM_NCOLS)
+
+struct gddram_i2c_transport {
+	/** @brief Write the len bytes of payload to the SSD1306 in one I2C transfer. */
+	void (*write)(void *priv, const uint8_t *payload, int len);
+	void *priv;
+};
+
+/** @brief Set the pixel at row i, column j of the page-major image to value, if it's within the image. */
+void gddram_image_set(uint8_t *image, int i, int j, bool value);
+
+/**
+ * @brief Set the width by height rectangle of the page-major image with its top left corner at coord to
+ *        value, clipped to the image, a column byte of each page at a time.
+ */
+void gddram_image_fill_rect(uint8_t *image, struct write_coord coord, int width, int height, bool value);
+
+/**
+ * @brief Copy a page-major source of npages pages of ncols columns to the page-major image, with its top
+ *        left corner at coord. The row of coord needn't be the top row of a page. Pixels of the source
+ *        outside of the image are clipped.
+ */
+void gddram_image_copy(uint8_t *image, const uint8_t *src, int ncols, int npages, struct write_coord coord);
+
+/**
+ * @brief Convert a ncols by nrows 2D bit array (see 2d_bit_array.h) to nrows/BITS_IN_BYTE pages of ncols
+ *        columns in the page-major layout, e.g. to draw glyph bitmaps with gddram_image_copy().
+ * @param nrows Must be a multiple of BITS_IN_BYTE.
+ */
+void gddram_pages_from_bit_array_2d(uint8_t *pages, const uint8_t *bit_array, int ncols, int nrows);
+
+/** The image of the GDDRAM as last sent, to diff the next image against. */
+struct gddram_shadow {
+	uint8_t image[GDDRAM_LEN];  /* Page-major, as the GDDRAM. */
+	bool valid;  /* False until the whole GDDRAM has been sent once. */
+};
+
+/** @brief Initialise the shadow as unknown, so that the next update sends the whole image. */
+void gddram_shadow_init(struct gddram_shadow *shadow);
+
+/**
+ * @brief Update the GDDRAM to the image, sending only what differs from the shadow, and update the
+ *        shadow to match.
+ *
+ * The column and page address of each changed range are set before its data, so the SSD1306 must be
+ * in horizontal addressing mode. See SSD1306 datasheet section 10.1.3.
+ *
+ * @param image Page-major image of GDDRAM_LEN bytes.
+ * @return Number of bytes of payload sent, excluding the slave address byte of each transfer.
+ */
+int gddram_update(struct gddram_shadow *shadow, const uint8_t *image, const struct gddram_i2c_transport *i2c);
+
+#endif
@@ -20,6 +20,10 @@ extern struct note_freq null_nf;
  * @brief Get the frequency of the lowest note C0.
  */
 float32_t lowest_note_frequency(void);
+/**
+ * @brief Get the frequency of the highest note B6.
+ */
+float32_t highest_note_frequency(void);
 
 #define CENTS_IN_OCTAVE  1200
 #define CENTS_IN_SEMITONE 100
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Streaming onset detector to find when a string is plucked, so that the analysis can be realigned
+ * to start at the pluck rather than wait for hops on fixed boundaries to fill with it. See 
+ * hop_samples_restart_hop().
+ *
+ * An onset is a sharp rise in energy (energy flux): a block whose energy (see hop_samples_block_energy())
+ * is ONSET_RATIO above the average of the energy of the blocks before it. The detector is cheap
+ * enough to update on every block pushed.
+ */
+#ifndef ONSET_H
+#define ONSET_H
+
+#include <stdbool.h>
+#include <arm_math_types.h>
+
+/* Energy ratio of a block over the recent average at which it's an onset (12 dB). */
+#define ONSET_RATIO  16.0f
+/* 
+ * Seconds after an onset during which no other onset is detected, as the energy of an attack keeps
+ * rising over a few blocks. Shorter than it takes to pluck the same string twice.
+ */
+#define ONSET_REFRACTORY_PERIOD  0.1f
+/* Time constant in seconds of the average energy that a block is compared with. */
+#define ONSET_AVERAGE_PERIOD  0.1f
+
+struct onset_detector {
+	/* Natural log of the recent average energy, to compare the energy ratio as a difference. */
+	float32_t log_average_energy;
+	/* Fraction of the difference to a block's log energy that the average moves per block. */
+	float32_t average_rate;
+	int nr_refractory_blocks;
+	/* Number of blocks left in the refractory period, or -1 before the first block. */
+	int nr_blocks_to_wait;
+};
+
+/**
+ * @brief Initialise (and reset) the detector.
+ * @param block_len The number of oversampled samples in each block, as pushed to 
+ *	  hop_samples_to_freq_bin_magnitudes_push_block().
+ */
+void onset_detector_init(struct onset_detector *od, int block_len);
+/** 
+ * Update the detector with the energy of the latest block, e.g. hop_samples_block_energy(), and return 
+ * whether there is an onset in it. The very first block is never an onset as there's nothing to 
+ * compare it with.
+ */
+bool onset_detector_update(struct onset_detector *od, float32_t block_energy);
+
+#endif
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ */
+#ifndef PITCH_H
+#define PITCH_H
+
+#include <stdbool.h>
+#include "dsp.h"
+
+/**
+ * A pitch detector finds the fundamental frequency of the note being played from overlapping frames
+ * of oversampled samples, hopped and streamed in blocks as with hop_samples_to_freq_bin_magnitudes()
+ * (see its documentation and that of its streaming version for the parameters).
+ *
+ * Use one as follows.
+ * 1. Call init once, and again to change the frame or hop length.
+ * 2. Call push_block for each block of a hop as soon as it's available.
+ * 3. Once all the blocks of a hop have been pushed, call finish to get the frequency of the frame ending
+ *    with the hop.
+ *
+ * The detectors share the default context of dsp.h (see struct dsp_ctx), so only use one at a time.
+ * To run one on a context of its own instead, initialise the context and push to it with dsp_ctx_init()
+ * and dsp_ctx_push_block(), and finish with finish_ctx.
+ */
+struct pitch_detector {
+	const char *name;
+	/* Return false if the frame length isn't supported. */
+	bool (*init)(enum frame_length frame_len, int hop_len);
+	void (*push_block)(const sample_t *samples, int block_len);
+	/**
+	 * Return the fundamental frequency in Hz, or 0 if none was found. Output how strongly the frame
+	 * is pitched in strength, with what it measures specific to the detector.
+	 */
+	float32_t (*finish)(enum frame_length frame_len, float32_t *strength);
+	/* Same as finish but on the context, e.g. one that runs alongside others. */
+	float32_t (*finish_ctx)(struct dsp_ctx *ctx, float32_t *strength);
+	/* Strength below which there is no note being played. */
+	float32_t min_strength;
+};
+
+/**
+ * Frequency domain detector: harmonic_product_spectrum() of the frequency bin magnitudes then
+ * interpolate_peak_freq() on its max peak. Strength is the HPS max peak magnitude, in the scale of the
+ * float version (see magnitude_to_float()). Needs a long frame length for the lower notes: see bin_width().
+ */
+extern const struct pitch_detector hps_pitch_detector;
+/**
+ * @brief Same as finish_ctx of hps_pitch_detector but with nharmonics harmonics in the HPS rather than
+ *        NHARMONICS, e.g. to compare harmonic counts without a rebuild.
+ */
+float32_t hps_finish_ctx_nharmonics(struct dsp_ctx *ctx, int nharmonics, float32_t *strength);
+/**
+ * Time domain detector: the McLeod Pitch Method (MPM) finds the lag at which the frame best matches
+ * itself, the period, using the autocorrelation (see hop_samples_to_autocorrelation_finish()).
+ * Strength is the clarity, from 0 to 1, of how periodic the frame is. Only needs a couple of periods
+ * of the lowest note in the window, so works with shorter frame lengths than hps_pitch_detector.
+ *
+ * See P. McLeod and G. Wyvill, "A Smarter Way to Find Pitch", 2005.
+ */
+#if !FIXED_POINT
+extern const struct pitch_detector mpm_pitch_detector;
+#endif
+
+#endif
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Lock-free single-producer/single-consumer (SPSC) ring of fixed-size slots, e.g. blocks of samples
+ * handed off from the ADC interrupt (the producer) to the processing loop (the consumer), or from a
+ * producer thread to a consumer thread on the host. A slot is published or consumed at a time, or a
+ * hop or frame of them at once.
+ *
+ * The producer only writes head and the consumer only writes tail, so neither needs a lock, nor to
+ * disable interrupts. Publishing stores head with release ordering after the slots are written, and
+ * the consumer loads it with acquire ordering before reading them, so the consumer never reads a slot
+ * before its contents. Likewise consuming stores tail with release ordering after the slots are read,
+ * and the producer loads it with acquire ordering before writing them again.
+ *
+ * One slot is always kept free for the producer to write into, so at most nr_slots-1 slots are ever
+ * published. Publishing into a full ring is an overrun (the consumer has fallen behind): the published
+ * slots are dropped, to be overwritten by the next ones, and counted rather than blocked on, as the 
+ * interrupt can't wait. Reading a slot that isn't published yet is an empty poll, which is also counted
+ * but isn't an error: a consumer that keeps up with the producer polls an empty ring all the time, e.g.
+ * while it waits for the next block. A consumer that needs the slot to be there, e.g. one that must 
+ * keep up with a real-time deadline, can count its own empty polls as underruns.
+ */
+#ifndef RING_H
+#define RING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct spsc_ring {
+	uint8_t *slots;
+	size_t slot_size;
+	/* A power of 2 so that the free running indices below still map to slots when they wrap around. */
+	uint32_t nr_slots;
+	/* Count of slots published, only written by the producer. */
+	_Atomic uint32_t head;
+	/* Count of slots consumed, only written by the consumer. */
+	_Atomic uint32_t tail;
+	/* Counts of slots dropped on overrun and of empty polls. Each only written by one side. */
+	_Atomic uint32_t nr_overruns;
+	_Atomic uint32_t nr_empty_polls;
+};
+
+/**
+ * @param slots Memory of nr_slots slots of slot_size bytes.
+ * @param nr_slots A power of 2, at least 2.
+ */
+void spsc_ring_init(struct spsc_ring *ring, void *slots, size_t slot_size, uint32_t nr_slots);
+
+/**
+ * @brief Producer side: get the ith slot after the published slots, to write into before publishing it.
+ * @return NULL if i is past the slots that are free, though the first (i of 0) is always free.
+ */
+void *spsc_ring_write_slot(struct spsc_ring *ring, uint32_t i);
+/**
+ * @brief Producer side: publish the n written slots to the consumer.
+ * @return false on overrun if they don't all fit, in which case none are published.
+ */
+bool spsc_ring_publish(struct spsc_ring *ring, uint32_t n);
+
+/** @brief Consumer side: get the number of published slots not yet consumed. */
+uint32_t spsc_ring_nr_readable(struct spsc_ring *ring);
+/**
+ * @brief Consumer side: get the ith oldest published slot.
+ * @return NULL, counted as an empty poll, if fewer than i+1 slots are published.
+ */
+const void *spsc_ring_read_slot(struct spsc_ring *ring, uint32_t i);
+/** @brief Consumer side: free the n oldest published slots for the producer to write again. */
+void spsc_ring_consume(struct spsc_ring *ring, uint32_t n);
+
+uint32_t spsc_ring_nr_overruns(struct spsc_ring *ring);
+uint32_t spsc_ring_nr_empty_polls(struct spsc_ring *ring);
+
+#endif
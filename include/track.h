@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Narrowband tracking of a note once the full search of a pitch detector (see pitch.h) has stably
+ * identified it. Rather than the FFT of the whole frame and a search over every bin, the tracker 
+ * evaluates the DFT (with the Goertzel algorithm) of only the newest TRACK_WINDOW_LEN samples at 
+ * three frequencies about each of the first TRACK_NHARMONICS harmonics of the tracked frequency, and
+ * interpolates the peak of each. That's cheap enough to refresh after every block rather than every 
+ * hop, and the frequency can move by up to a bin per refresh, within a semitone of the locked note.
+ *
+ * Use it as follows.
+ * 1. Call note_tracker_init() once.
+ * 2. While not locked, feed each reading of the full search to note_tracker_lock().
+ * 3. Once locked, call note_tracker_track() after each block pushed instead of the full search, until
+ *    it returns 0 when the note is lost, then go back to 2. Unlock on an onset (see onset.h) or when 
+ *    the energy gate (see gate.h) closes, as the note may have changed.
+ */
+#ifndef TRACK_H
+#define TRACK_H
+
+#include <stdbool.h>
+#include "note.h"
+#include "dsp.h"
+
+/* 
+ * Length of the window of the newest filtered and decimated samples analysed, which sets the bin width
+ * (~3.9 Hz at the SAMPLING_RATE of 4000). Short enough to follow the note closely, and long enough that
+ * the harmonics of the lowest notes are many bins apart.
+ */
+#define TRACK_WINDOW_LEN  1024
+#define TRACK_NHARMONICS  4
+/* Number of full search readings in a row of the same note to lock onto it. */
+#define TRACK_LOCK_READINGS  2
+/* 
+ * The note is lost when the power of its harmonics collapses to below TRACK_COLLAPSE_RATIO of a 
+ * reference power: the highest power since the lock, decaying by TRACK_REFERENCE_DECAY per second, 
+ * faster than a note rings out (about 5 dB/s after the attack) but slower than a muted note dies.
+ */
+#define TRACK_COLLAPSE_RATIO  0.01f
+#define TRACK_REFERENCE_DECAY  0.01f
+
+struct note_tracker {
+	/* Context whose newest samples are tracked. */
+	struct dsp_ctx *ctx;
+	/* Note locked onto, or NULL if not locked. */
+	struct note_freq *note;
+	/* Note of the latest full search readings and the number of them in a row. */
+	struct note_freq *candidate;
+	int nr_candidate_readings;
+	float32_t frequency;
+	/* Reference power of the harmonics to detect a collapse, and the factor it decays by per refresh. */
+	float32_t reference_power;
+	float32_t reference_decay;
+};
+
+/**
+ * @param ctx Context the blocks are pushed to, e.g. dsp_default_ctx(). Its scratch is used between finishes.
+ * @param block_len The number of oversampled samples in each block, as pushed to 
+ *	  hop_samples_to_freq_bin_magnitudes_push_block(), i.e. between refreshes.
+ */
+void note_tracker_init(struct note_tracker *nt, struct dsp_ctx *ctx, int block_len);
+void note_tracker_unlock(struct note_tracker *nt);
+/** 
+ * Feed a reading of the full search, 0 if there was none. Return whether the tracker is locked, i.e.
+ * the reading is of the same note as the previous TRACK_LOCK_READINGS-1 readings.
+ */
+bool note_tracker_lock(struct note_tracker *nt, float32_t frequency);
+/**
+ * Refresh the tracked frequency from the newest samples pushed (see hop_samples_newest()) and return it.
+ * Call it between finishing a hop and pushing the next block, as it trashes the scratch of the context.
+ * Return 0 and unlock if the note is lost: if the power of its harmonics collapses, or the frequency 
+ * drifts more than a semitone from the locked note.
+ *
+ * @warning Only call it when locked. The frame length less the hop length must be at least TRACK_WINDOW_LEN.
+ */
+float32_t note_tracker_track(struct note_tracker *nt);
+
+#endif
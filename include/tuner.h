@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * The processing of the tuner, from blocks of raw 12-bit ADC samples to the readings to display, shared by
+ * the MCU (see ../mcu/guitar_tuner.c) and the tests on the host (see ../test/cents_sweep.c) so that they
+ * run the very same loop. Each block is converted (see adc.h) and pushed to the pitch detector, the hop
+ * is restarted at each onset (see onset.h), the hops barely louder than the noise floor are skipped (see
+ * gate.h), and the note is read with the full search of the pitch detector at the end of each hop until
+ * the tracker (see track.h) locks onto it, then tracked after every block until it's lost.
+ *
+ * Usage:
+ * 1. Call tuner_init() once.
+ * 2. Call tuner_push_block() with each block of samples, displaying the reading whenever there's one.
+ */
+#ifndef TUNER_H
+#define TUNER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "dsp.h"
+#include "adc.h"
+#include "gate.h"
+#include "onset.h"
+#include "track.h"
+
+/*
+ * Pitch detector and the frame length it runs on. See include/pitch.h. The time domain mpm_pitch_detector
+ * works with a frame length as short as FRAME_LEN_512, but has more octave errors than hps_pitch_detector.
+ * The frame length must be one of frame_lengths in core/dsp_params.mk. The memory of the DSP is sized for
+ * the longest of those at compile time, so list only TUNER_FRAME_LEN there. See `make ram-report` of
+ * ../mcu/Makefile.
+ */
+#define TUNER_PITCH_DETECTOR  hps_pitch_detector
+#define TUNER_FRAME_LEN  FRAME_LEN_4096
+/*
+ * The frame is advanced a hop at a time rather than a whole frame at a time, giving
+ * TUNER_HOPS_IN_FRAME readings per frame. See hop_samples_to_freq_bin_magnitudes().
+ */
+#define TUNER_HOPS_IN_FRAME  4
+#define TUNER_HOP_LEN  (TUNER_FRAME_LEN/TUNER_HOPS_IN_FRAME)
+#define TUNER_OVER_HOP_LEN  (TUNER_HOP_LEN*OVERSAMPLING_FACTOR)
+/*
+ * Samples are published by the sampler and filtered in blocks as the hop fills.
+ * See hop_samples_to_freq_bin_magnitudes_push_block().
+ */
+#define TUNER_BLOCK_LEN  256
+#define TUNER_BLOCKS_IN_HOP  (TUNER_OVER_HOP_LEN/TUNER_BLOCK_LEN)
+/*
+ * On an onset (a pluck), the hop is restarted at the block of the onset and cut short to this length,
+ * so the note is read soon after the pluck rather than at the end of the hop it lands in. See
+ * hop_samples_restart_hop().
+ */
+#define TUNER_ONSET_HOP_LEN  (TUNER_HOP_LEN/2)
+#define TUNER_BLOCKS_IN_ONSET_HOP  (TUNER_ONSET_HOP_LEN*OVERSAMPLING_FACTOR/TUNER_BLOCK_LEN)
+/* Hops of raw samples buffered by the MCU while the blocks before them are processed. */
+#define TUNER_NR_RING_HOPS  2
+
+struct tuner {
+	/* Skips the processing of hops where no note is being played. */
+	struct energy_gate gate;
+	/* Realigns the hops to the start of each note played. */
+	struct onset_detector onset_detector;
+	/* Tracks the note once found, in place of the full search of the pitch detector. */
+	struct note_tracker note_tracker;
+	/* Converts the raw samples of each block and removes their DC offset. */
+	struct adc_converter adc_converter;
+	/* The block being pushed, converted from the raw samples. */
+	sample_t block[TUNER_BLOCK_LEN];
+	/* Number of blocks left to push to fill the hop. */
+	int nr_hop_blocks_left;
+};
+
+/** @brief Initialise (and reset) the tuner and the pitch detector, which runs on the default DSP context. */
+void tuner_init(struct tuner *tuner);
+/**
+ * @brief Push a block of TUNER_BLOCK_LEN raw 12-bit ADC samples, reading the note if due.
+ * @param frequency Set to the frequency read, or 0 if there's no note, when there's a new reading.
+ * @return Whether there's a new reading, i.e. whether the display is to be refreshed.
+ */
+bool tuner_push_block(struct tuner *tuner, const uint16_t *u12_samples, float32_t *frequency);
+
+#endif
@@ -17,6 +17,12 @@
 #define FONT_PIXEL_WIDTH  29
 #define FONT_PIXEL_HEIGHT 32
 #define FONT_PIXEL_WIDTH_PAD 32
+/* 
+ * A glyph in the page-major layout of the SSD1306 GDDRAM (see gddram.h) is FONT_NPAGES pages of 
+ * FONT_PIXEL_WIDTH_PAD columns, each column of a page a byte of 8 vertically adjacent pixels.
+ */
+#define FONT_NPAGES (FONT_PIXEL_HEIGHT/8)
+#define FONT_GLYPH_PAGES_LEN (FONT_NPAGES*FONT_PIXEL_WIDTH_PAD)
 
 /**
  * Get the glyph bitmap of a character. Supported characters are 
@@ -28,5 +34,10 @@
  * of the return.
  */
 uint8_t *font_get_glyph_bitmap(char c);
+/**
+ * Get the glyph of a character in the page-major layout, as converted from its bitmap at build 
+ * time into font_pages.c (see gen_font_pages.c). Return NULL if the character is unsupported.
+ */
+const uint8_t *font_get_glyph_pages(char c);
 
 #endif
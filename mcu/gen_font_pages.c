@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Print the glyph bitmaps of font.c to standard out in C syntax, converted to the page-major layout
+ * of the SSD1306 GDDRAM (see gddram.h), so that glyphs are drawn to the page-major GDDRAM MCU side
+ * buffer without converting them at run time. This is run on the host at build time to generate
+ * font_pages.c, which defines font.h:font_get_glyph_pages().
+ */
+#include <stdio.h>
+#include "font.h"
+#include "gddram.h"
+
+int main(void)
+{
+	uint8_t pages[FONT_GLYPH_PAGES_LEN];
+
+	printf("/*\n");
+	printf(" * This file was automatically generated by the gen-font-pages program.\n");
+	printf(" * See gen_font_pages.c along with font.c for more info.\n");
+	printf(" */\n");
+	printf("#include \"font.h\"\n");
+	printf("#include <stddef.h>\n");
+	printf("\n");
+	printf("static const struct glyph_pages {\n");
+	printf("\tchar c;\n");
+	printf("\tuint8_t pages[FONT_GLYPH_PAGES_LEN];\n");
+	printf("} glyph_pages[] = {\n");
+	for (int c = 1; c < 128; ++c) {
+		uint8_t *bitmap = font_get_glyph_bitmap(c);
+
+		if (!bitmap)
+			continue;
+		gddram_pages_from_bit_array_2d(pages, bitmap, FONT_PIXEL_WIDTH_PAD, FONT_PIXEL_HEIGHT);
+		printf("{ '%c', {", c);
+		for (int i = 0; i < FONT_GLYPH_PAGES_LEN; ++i) {
+			if (i % 16 == 0)
+				printf("\n\t");
+			printf("0x%02X,", pages[i]);
+		}
+		printf(" } },\n");
+	}
+	printf("{ 0 }\n");
+	printf("};\n");
+	printf("\n");
+	printf("const uint8_t *font_get_glyph_pages(char c)\n");
+	printf("{\n");
+	printf("\tconst struct glyph_pages *gp = glyph_pages;\n");
+	printf("\n");
+	printf("\tfor (; gp->c; ++gp) {\n");
+	printf("\t\tif (gp->c == c)\n");
+	printf("\t\t\treturn gp->pages;\n");
+	printf("\t}\n");
+	printf("\treturn NULL;\n");
+	printf("}\n");
+	return 0;
+}
@@ -9,61 +9,88 @@
 #include <libopencm3/stm32/f4/nvic.h>
 #include <libopencm3/cm3/cortex.h>
 #include <stdio.h>
-#include "adc.h"
 #include "dsp.h"
+#include "tuner.h"
+#include "ring.h"
 #include "note.h"
 #include "ssd1306.h"
 #include "font.h"
 #include "debug.h"
 
-#define FRAME_LEN  FRAME_LEN_4096
-#define OVER_FRAME_LEN  (FRAME_LEN*OVERSAMPLING_FACTOR)
+#define NR_RING_BLOCKS  (TUNER_BLOCKS_IN_HOP*TUNER_NR_RING_HOPS)
 /* The ADC regular data register data field is 16 bits wide, but the sample is 12 bits. */
 #define ADC_DR_DATA_MASK 0x00000fff
 
 /**
- * This is a circular buffer storing 2 oversized frames worth of samples so that one frame can
- * be filled while the other full frame is being processed.
+ * This is a ring of TUNER_NR_RING_HOPS oversized hops worth of blocks of samples so that blocks of samples 
+ * can be filled while other full blocks are being processed (NR_RING_BLOCKS is a power of 2 as the 
+ * ring needs). The samples are the raw 12-bit ADC readings, which take half the RAM of floats, and 
+ * are converted a block at a time right before the block is pushed (see convert_adc_u12_samples()).
  */
-static volatile float32_t samples[OVER_FRAME_LEN*2];
-static volatile float32_t *volatile full_samples_frame = NULL;
+static uint16_t samples[TUNER_BLOCK_LEN*NR_RING_BLOCKS];
+/* 
+ * Hands the blocks off from adc_isr() to processing_start(). Should the processing fall a whole ring
+ * behind, the blocks that don't fit are dropped and counted as overruns. See ring.h.
+ */
+static struct spsc_ring sample_ring;
 
 /**
- * @brief Store the converted sample in the next free slot in the samples circular buffer. 
+ * @brief Store the raw sample in the next free slot of the block being filled. 
  *
- * When a frame has been filled full_samples_frame is set to the first sample in the
- * filled frame, signalling that the frame is ready for processing (see processing_start()).
+ * When a block has been filled it's published to the ring, signalling that the block is ready for 
+ * processing (see processing_start()).
  */
 void adc_isr(void) 
 {
+	static uint16_t *block;
 	static int i = 0;
 
-	samples[i++] = convert_adc_u12_sample_to_s16(adc_read_regular(ADC1)&ADC_DR_DATA_MASK);
+	if (i == 0)
+		block = spsc_ring_write_slot(&sample_ring, 0);
+	block[i++] = adc_read_regular(ADC1)&ADC_DR_DATA_MASK;
 
-	/* If just finished filling a frame of samples. */
-	if (i%OVER_FRAME_LEN == 0) {
-		full_samples_frame = samples+(i-OVER_FRAME_LEN);
-		if (i == OVER_FRAME_LEN*2)
-			i = 0;
+	/* If just finished filling a block of samples. */
+	if (i == TUNER_BLOCK_LEN) {
+		spsc_ring_publish(&sample_ring, 1);
+		i = 0;
 	}
 }
 
+/*
+ * The timer is running off APB1, which is 6 MHz, but because the APB1 prescaler is > 1,
+ * the timer clock frequencies are twice APB1, which is 12 MHz. 
+ */
+#define TIMER2_CLOCK_FREQ 12000000
+/*
+ * Counter clock cycles per update event (see timer2_set_sampling_rate()). Ideally 2, the fewest 
+ * possible, but 3 when the timer clock can't be divided down evenly to twice the OVERSAMPLING_RATE, 
+ * e.g. for an OVERSAMPLING_FACTOR of 8. An OVERSAMPLING_FACTOR of 16 can't be reached from a 12 MHz 
+ * timer clock at all and would need a faster APB1 clock.
+ */
+#if TIMER2_CLOCK_FREQ%(2*OVERSAMPLING_RATE) == 0
+#define TIMER2_CYCLES_PER_UPDATE 2
+#else
+#define TIMER2_CYCLES_PER_UPDATE 3
+#endif
+_Static_assert(TIMER2_CLOCK_FREQ%(TIMER2_CYCLES_PER_UPDATE*OVERSAMPLING_RATE) == 0, 
+	       "OVERSAMPLING_RATE can't be divided down to from the timer clock");
+
 /** @brief Set timer 2 (TIM2) sampling rate to OVERSAMPLING_RATE. */
 static void timer2_set_sampling_rate(void)
 {
 	/*
-	 * The timer is running off APB1, which is 6 MHz, but because the APB1 prescaler is > 1,
-	 * the timer clock frequencies are twice APB1, which is 12 MHz. This clock divider sets
-	 * the counter clock frequency to twice the OVERSAMPLING_RATE (i.e. 12 MHz / clock_div = 2*OVERSAMPLING_RATE),
-	 * because it takes a clock cycle to count from 0 to 1, and another clock cycle to overflow 
-	 * from 1 back to 0: each update event takes 2 cycles, so with a clock rate of 2*OVERSAMPLING_RATE 
-	 * there will be OVERSAMPLING_RATE update events. 
+	 * This clock divider sets the counter clock frequency to TIMER2_CYCLES_PER_UPDATE times the 
+	 * OVERSAMPLING_RATE (i.e. 12 MHz / clock_div = TIMER2_CYCLES_PER_UPDATE*OVERSAMPLING_RATE), because 
+	 * with a period of TIMER2_CYCLES_PER_UPDATE-1 it takes a clock cycle to count from 0 to 1, and so on 
+	 * up to the period, and another clock cycle to overflow from the period back to 0: e.g. with a period
+	 * of 1 each update event takes 2 cycles, so with a clock rate of 2*OVERSAMPLING_RATE there will be 
+	 * OVERSAMPLING_RATE update events. 
 	 *
 	 * Note also the counter clock is lowered rather than raising the timer period in order to save power.
 	 */
-	const int clock_div = 750;
+	const int clock_div = TIMER2_CLOCK_FREQ/(TIMER2_CYCLES_PER_UPDATE*OVERSAMPLING_RATE);
 	timer_set_prescaler(TIM2, clock_div-1);
-	timer_set_period(TIM2, 1);
+	timer_set_period(TIM2, TIMER2_CYCLES_PER_UPDATE-1);
 
 	/* Trigger update event to load "preload" prescaler value set above into preload register proper. */
 	timer_generate_event(TIM2, TIM_EGR_UG);
@@ -125,6 +152,7 @@ static void adc_init(void)
  */
 static void sampler_init(void)
 {
+	spsc_ring_init(&sample_ring, samples, TUNER_BLOCK_LEN*sizeof(uint16_t), NR_RING_BLOCKS);
 	timer_init();
 	adc_init();
 }
@@ -198,55 +226,49 @@ static void display_question_mark(void)
 	display_note_and_slider(0);
 }
 
+/* The processing from the raw samples to the readings. See tuner.h. */
+static struct tuner tuner;
+
 static void processing_init(void)
 {
 	counter_init();
-	samples_to_freq_bin_magnitudes_init(FRAME_LEN);
+	tuner_init(&tuner);
 	ssd1306_init_i2c(SSD1306_I2C_SLAVE_ADDR_LOW);
 	ssd1306_init();
-	/* Show a question mark while the very first frame of samples is being collected. */
+	/* Show a question mark while the very first hop of samples is being collected. */
 	display_question_mark();
 }
 
 /**
- * Continuously wait for a frame of samples to be filled, then processing the full frame for
- * a detected closest note and showing it on the display. Because after decimation the sampling rate 
- * (SAMPLING_RATE) is 4000 and the frame length (FRAME_LEN) is 4096, it will take 4096/4000 = 1.024 
- * seconds to fill a frame. The processing of a frame from testing then takes around 0.09 seconds.
+ * Continuously wait for a block of samples to be filled and filter it, then once a hop of blocks 
+ * has been filtered, processing the frame ending in the full hop for a detected closest note and 
+ * showing it on the display. Because after decimation the sampling rate (SAMPLING_RATE) is 4000 
+ * and the frame length (TUNER_FRAME_LEN) is 4096, it would take 4096/4000 = 1.024 seconds to fill a
+ * whole new frame, but a hop (TUNER_HOP_LEN) of 1024 samples only takes 1024/4000 = 0.256 seconds to
+ * fill. The processing of a whole frame from testing takes around 0.09 seconds, but because the 
+ * filtering is done block by block while the hop is filling, only the FFT and the steps after it 
+ * remain once the last block of the hop lands. The hops are realigned to each pluck so that it's read
+ * within TUNER_ONSET_HOP_LEN of it. Once the same note has been read a couple of times in a row, it's
+ * tracked after every block with a much cheaper narrowband analysis instead, until it's lost. See
+ * tuner_push_block().
  */
 static void processing_start(void)
 {
-	float32_t *freq_bin_magnitudes;
-	int max_bin_ind;
-	float32_t frequency; 
+	float32_t frequency;
 
 	for (;;) {
-		/* Wait for sampler to fill frame. See adc_isr(). */
-		do {
+		/* Wait for sampler to fill block. See adc_isr(). */
+		while (spsc_ring_nr_readable(&sample_ring) == 0)
 			__asm__("wfi");
-		} while (!full_samples_frame);
 
 		/* DSP. */
-		freq_bin_magnitudes = samples_to_freq_bin_magnitudes((float32_t *)full_samples_frame, FRAME_LEN);
-		harmonic_product_spectrum(freq_bin_magnitudes, FRAME_LEN, SAMPLING_RATE);
-		max_bin_ind = max_bin_index(freq_bin_magnitudes, FRAME_LEN);
-		frequency = bin_index_to_freq(max_bin_ind, bin_width(FRAME_LEN, SAMPLING_RATE));
-
-		/*
-		 * Only display a note if the reading is strong enough, in order to filter out readings where there is
-		 * no actual note being played. From testing, the resting max magnitude when there is no sound being
-		 * made is e+17 (because the ADC is quite noisy), and when you play a note it will start at around 
-		 * e+22 to e+25 and then fade out / decline back to e+17. Be wary that this e+17 "noise floor" is 
-		 * when powering the MCU off a battery via the MCU's 5V pin: a dirtier power source, such as the
-		 * ST-Link, will have a higher noise floor, e.g. e+20, and so this threshold won't work and also
-		 * a note when played won't "hold" (display on screen) as long.
-		 */
-		if (freq_bin_magnitudes[max_bin_ind] >= 1.3e+18) 
-			display_note_and_slider(frequency);
-		else
-			display_question_mark();
-
-		full_samples_frame = NULL;
+		if (tuner_push_block(&tuner, spsc_ring_read_slot(&sample_ring, 0), &frequency)) {
+			if (frequency)
+				display_note_and_slider(frequency);
+			else
+				display_question_mark();
+		}
+		spsc_ring_consume(&sample_ring, 1);
 	}
 }
 
@@ -13,7 +13,7 @@
 #include <string.h>
 #include "ssd1306.h"
 #include "font.h"
-#include "2d_bit_array.h"
+#include "gddram.h"
 
 static uint32_t ssd1306_i2c_controller = I2C1;
 static enum ssd1306_i2c_slave_address ssd1306_addr;
@@ -35,6 +35,15 @@ void ssd1306_init_i2c(enum ssd1306_i2c_slave_address addr)
 	ssd1306_addr = addr;
 }
 
+static void ssd1306_i2c_write(void *priv, const uint8_t *payload, int len)
+{
+	i2c_transfer7(ssd1306_i2c_controller, ssd1306_addr, (uint8_t *)payload, len, NULL, 0);
+}
+
+static const struct gddram_i2c_transport ssd1306_i2c = { .write = ssd1306_i2c_write };
+/* What the GDDRAM was last filled with, to send only what changes. */
+static struct gddram_shadow gddram_shadow;
+
 /**
  * The SSD1306 I2C payload is typically an interleaving of control byte (this) 
  * and then data/command byte. 
@@ -176,7 +185,8 @@ void ssd1306_init(void)
 	ssd1306_set_contrast(1);  /* Although this is the lowest visible contrast setting it's still quite bright. */
 	ssd1306_set_display_clock(0, 0);  /* Slowest clock which doesn't produce screen flickering. */
 
-	/* Clear screen before it gets turned on. */
+	/* Clear screen before it gets turned on, the whole of it as what it holds is unknown. */
+	gddram_shadow_init(&gddram_shadow);
 	gddram_mcu_buf_zero();
 	ssd1306_fill_gddram();
 	
@@ -185,84 +195,26 @@ void ssd1306_init(void)
 }
 
 
-#define GDDRAM_MCU_BUF_LEN 1024  /**< Bytes in 128x64 bits. */
-#define GDDRAM_MCU_BUF_NBYTE_COLS 16  /**< Bytes in 128 bits. */
-#define GDDRAM_MCU_BUF_NBYTE_ROWS  8  /**< Bytes in 64 bits. */
-
-#define GDDRAM_NPAGES 8
-#define GDDRAM_NROWS_IN_PAGE 8
-
-static uint8_t gddram_mcu_buf[GDDRAM_MCU_BUF_LEN];
-
-/**
- * Transpose the gddram_mcu_buf 2D bit array into a data stream gddram_mcu_buf_transposed that
- * when sent to the SSD1306 GDDRAM configured for horizontal addressing mode will show up on 
- * the display as the original 2D bit array.
- *
- * See SSD1306 datasheet section 8.7 for info on the GDDRAM and section 10.1.3 for info 
- * on horizontal addressing mode.
+/* 
+ * The GDDRAM MCU side buffer is in the page-major layout of the GDDRAM itself (see gddram.h), so it's
+ * sent as is, without transposing it from a row-major 2D bit array. See SSD1306 datasheet section 8.7 
+ * for info on the GDDRAM and section 10.1.3 for info on horizontal addressing mode.
  */
-static void gddram_mcu_buf_transpose(uint8_t *gddram_mcu_buf, uint8_t *gddram_mcu_buf_transposed) 
-{
-	/* Pointers to bytes vertically adjacent in a page. */
-	uint8_t *rows[GDDRAM_NROWS_IN_PAGE];
-	int w = 0;  /* Write index. */
-	
-	for (int i = 0; i < GDDRAM_NPAGES; ++i) {
-		for (int j = 0; j < GDDRAM_MCU_BUF_NBYTE_COLS; ++j) {
-			if (j == 0) {
-				/* Initialise to point to the start byte of each row in the page. */
-				rows[0] = gddram_mcu_buf;
-				for (int k = 1; k < GDDRAM_NROWS_IN_PAGE; ++k)
-					rows[k] = rows[k-1]+GDDRAM_MCU_BUF_NBYTE_COLS;
-			}
-			/* 
-			 * Each column of bits in the column byte becomes a transposed byte with
-			 * top row bit the LSB and bottom row bit the MSB.
-			 */
-			for (int bit_index = 0; bit_index < BITS_IN_BYTE; ++bit_index) {
-				uint8_t transposed = 0;
-				uint8_t bitmask = bit_index_to_8bit_bitmask(bit_index);
-				for (int k = 0; k < GDDRAM_NROWS_IN_PAGE; ++k)  {
-					if (*rows[k]&bitmask)
-						transposed |= 1<<k;
-				}
-				gddram_mcu_buf_transposed[w++] = transposed;
-			}
-			/* Shift to the next byte column. */
-			for (int k = 0; k < GDDRAM_NROWS_IN_PAGE; ++k)
-				rows[k] += 1;
-		}
-		/* Move to start of next page. */
-		gddram_mcu_buf += GDDRAM_MCU_BUF_NBYTE_COLS*GDDRAM_NROWS_IN_PAGE;
-	}
-}
+static uint8_t gddram_mcu_buf[GDDRAM_LEN];
 
 void ssd1306_fill_gddram(void)
 {
-	static struct {
-		struct control_byte ctl;
-		uint8_t gddram_mcu_buf_transposed[GDDRAM_MCU_BUF_LEN];
-	} payload;
-
-	payload.ctl.unused = 0; 
-	payload.ctl.next_byte = CTL_NEXT_BYTE_DATA; 
-	payload.ctl.continuation = CTL_CONTINUATION_DATA;
-	gddram_mcu_buf_transpose(gddram_mcu_buf, payload.gddram_mcu_buf_transposed);
-
-	i2c_transfer7(ssd1306_i2c_controller, ssd1306_addr, (uint8_t *)&payload, sizeof(payload), NULL, 0);
+	gddram_update(&gddram_shadow, gddram_mcu_buf, &ssd1306_i2c);
 }
 
 void gddram_mcu_buf_zero(void)
 {
-	memset(gddram_mcu_buf, 0, GDDRAM_MCU_BUF_LEN);
+	memset(gddram_mcu_buf, 0, GDDRAM_LEN);
 }
 
-void gddram_mcu_buf_write_2d_bit_array(uint8_t *bit_array, int ncols, int nrows,
-				       struct write_coord coord)
+void gddram_mcu_buf_write_pages(const uint8_t *pages, int ncols, int npages, struct write_coord coord)
 {
-	bit_array_2d_copy(gddram_mcu_buf, GDDRAM_PIXEL_WIDTH, GDDRAM_PIXEL_HEIGHT,
-			  bit_array, ncols, nrows, coord);
+	gddram_image_copy(gddram_mcu_buf, pages, ncols, npages, coord);
 }
 
 void gddram_mcu_buf_write_text(const char *text, struct write_coord coord)
@@ -270,28 +222,19 @@ void gddram_mcu_buf_write_text(const char *text, struct write_coord coord)
 	char c;
 
 	while (c = *text++) {
-		uint8_t *bitmap = font_get_glyph_bitmap(c);
-		if (bitmap) {
-			gddram_mcu_buf_write_2d_bit_array(bitmap, FONT_PIXEL_WIDTH_PAD, FONT_PIXEL_HEIGHT,
-							  coord);
-		}
+		const uint8_t *pages = font_get_glyph_pages(c);
+		if (pages)
+			gddram_mcu_buf_write_pages(pages, FONT_PIXEL_WIDTH_PAD, FONT_NPAGES, coord);
 		coord.col += FONT_PIXEL_WIDTH;
 	}
 }
 
 void gddram_mcu_buf_write_horizontal_line(struct write_coord coord, int length)
 {
-	for (int i = 0; i < length; ++i) {
-		bit_array_2d_set(gddram_mcu_buf, GDDRAM_PIXEL_WIDTH, GDDRAM_PIXEL_HEIGHT,
-				 coord.row, coord.col+i, 1);
-	}
+	gddram_image_fill_rect(gddram_mcu_buf, coord, length, 1, 1);
 }
 
 void gddram_mcu_buf_write_vertical_line(struct write_coord coord, int height)
 {
-	for (int i = 0; i < height; ++i) {
-		bit_array_2d_set(gddram_mcu_buf, GDDRAM_PIXEL_WIDTH, GDDRAM_PIXEL_HEIGHT,
-				 coord.row+i, coord.col, 1);
-	}
+	gddram_image_fill_rect(gddram_mcu_buf, coord, 1, height, 1);
 }
-
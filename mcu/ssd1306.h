@@ -7,7 +7,7 @@
 #ifndef SSD1306_H	
 #define SSD1306_H	
 
-#include "2d_bit_array.h"
+#include "gddram.h"
 
 #define GDDRAM_PIXEL_WIDTH 128
 #define GDDRAM_PIXEL_HEIGHT 64
@@ -44,6 +44,9 @@ void ssd1306_init(void);
  *
  * Ensure to fill the GDDRAM MCU side buffer with the gddram_mcu_buf_*() functions below
  * with what you want displayed before calling this.
+ *
+ * Only the column ranges of the pages that changed since the last fill are sent over I2C
+ * (see gddram.h), so redrawing the whole buffer each frame is cheap when little changes.
  */
 void ssd1306_fill_gddram(void);
 
@@ -56,9 +59,11 @@ void ssd1306_fill_gddram(void);
 
 /** @brief Zero the entire GDDRAM MCU side buffer. */
 void gddram_mcu_buf_zero(void);
-/** @brief Write a ncols by nrows 2D bit array to the GDDRAM MCU side buffer. */
-void gddram_mcu_buf_write_2d_bit_array(uint8_t *bit_array, int ncols, int nrows,
-				       struct write_coord coord);
+/** 
+ * @brief Write npages pages of ncols columns in the page-major layout of the GDDRAM (see gddram.h)
+ *        to the GDDRAM MCU side buffer. 
+ */
+void gddram_mcu_buf_write_pages(const uint8_t *pages, int ncols, int npages, struct write_coord coord);
 /** @note Text font is the font implemented in file 'font.h'. */
 void gddram_mcu_buf_write_text(const char *text, struct write_coord coord);
 /* Lines are 1 pixel thick. */
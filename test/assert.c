@@ -3,6 +3,7 @@
  * SPDX-License-Identifier: GPL-2.0
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdarg.h>
 #include "assert.h"
 
@@ -10,24 +11,61 @@
 
 static int failed_asserts_count = 0;
 static int total_asserts_count = 0;
+/* The log of the asserts of the calling thread, if any. */
+static _Thread_local struct assert_log *thread_log;
 
 void Assert(bool condition, const char *function, const char *file, int line,
 	    const char *format, ...)
 {
+	FILE *stream = thread_log ? thread_log->stream : stderr;
+
 	if (!condition) {
-		fprintf(stderr, "Assert failed in %s at '%s:%d'%s", function, file, line,
+		fprintf(stream, "Assert failed in %s at '%s:%d'%s", function, file, line,
 				format ? ": " : "");
 		if (format) {
 			va_list ap;
 			va_start(ap, format);
-			vfprintf(stderr, format, ap);
+			vfprintf(stream, format, ap);
 			va_end(ap);
 		}
-		fprintf(stderr, "\n");
+		fprintf(stream, "\n");
 
-		++failed_asserts_count;
+		if (thread_log)
+			++thread_log->failed_asserts_count;
+		else
+			++failed_asserts_count;
 	}
-	++total_asserts_count;
+	if (thread_log)
+		++thread_log->total_asserts_count;
+	else
+		++total_asserts_count;
+}
+
+bool assert_log_begin(struct assert_log *log)
+{
+	log->buf = NULL;
+	log->len = 0;
+	log->failed_asserts_count = 0;
+	log->total_asserts_count = 0;
+	log->stream = open_memstream(&log->buf, &log->len);
+	if (!log->stream)
+		return false;
+	thread_log = log;
+	return true;
+}
+
+void assert_log_end(void)
+{
+	thread_log = NULL;
+}
+
+void assert_log_merge(struct assert_log *log)
+{
+	fclose(log->stream);
+	fwrite(log->buf, 1, log->len, stderr);
+	free(log->buf);
+	failed_asserts_count += log->failed_asserts_count;
+	total_asserts_count += log->total_asserts_count;
 }
 
 bool print_asserts_summary(void)
@@ -6,6 +6,8 @@
 #define ASSERT_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
 
 /**
  * Assert whether the condition is true. If false print the error message
@@ -17,6 +19,30 @@ void Assert(bool condition, const char *function, const char *file, int line,
 #define Assert(condition, format, ...)  Assert(condition, __func__, __FILE__, __LINE__, \
 					       format __VA_OPT__(,) __VA_ARGS__)
 
+/**
+ * The asserts of a unit of work run on a thread of its own, e.g. a file source of 
+ * for_each_file_source_parallel(), kept apart from those of the other threads until they're merged. 
+ * Merging the logs in the order of the units of work rather than of when they finished keeps the 
+ * failure messages and counts the same however the threads are scheduled.
+ */
+struct assert_log {
+	FILE *stream;  /* Failure messages, in memory. */
+	char *buf;
+	size_t len;
+	int failed_asserts_count;
+	int total_asserts_count;
+};
+
+/**
+ * Start logging the asserts of the calling thread to log rather than printing and counting them 
+ * straight away, until assert_log_end().
+ * @return false on error.
+ */
+bool assert_log_begin(struct assert_log *log);
+void assert_log_end(void);
+/** Print the failure messages of the log to stderr, add its counts to the totals and free it. */
+void assert_log_merge(struct assert_log *log);
+
 /**
  * Print whether all asserts run so far have been successful, along 
  * with the count of failed asserts and total count of asserts.
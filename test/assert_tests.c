@@ -3,28 +3,43 @@
  * SPDX-License-Identifier: GPL-2.0
  */
 #include "dsp_indirect.h"
+#include "decimate.h"
 #include "adc.h"
 #include "note.h"
+#include "gate.h"
+#include "onset.h"
+#include "track.h"
+#include "ring.h"
 #include "2d_bit_array.h"
+#include "gddram.h"
+#include "font.h"
+#include "synth.h"
+#include "pareto.h"
 #include "assert.h"
 #include "file_source.h"
+#include "parallel_file_source.h"
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 /** @brief Assert the frequency of a sine wave falls into the expected bin. */
-static bool assert_sine_wave_freq_to_bin_index(const char *sine_freq_str, int i, const int16_t *samples, enum frame_length frame_len)
+static bool assert_sine_wave_freq_to_bin_index(struct file_source_worker *worker, const char *sine_freq_str, int i, 
+					       const int16_t *samples, enum frame_length frame_len)
 {
 	float32_t sine_freq;
-	float32_t *freq_bin_magnitudes;
+	magnitude_t *freq_bin_magnitudes;
 	int expected_bin_index, actual_bin_index;
 
 	sscanf(sine_freq_str, "%f", &sine_freq);
 	if (i == 1)
-		samples_to_freq_bin_magnitudes_init(frame_len);
-	freq_bin_magnitudes = samples_to_freq_bin_magnitudes_s16(samples, frame_len);
+		dsp_ctx_init(&worker->ctx, frame_len, frame_len, worker->ctx_mem);
+	freq_bin_magnitudes = dsp_ctx_samples_to_freq_bin_magnitudes_s16(&worker->ctx, samples, worker->converted_samples);
 	expected_bin_index = freq_to_bin_index(sine_freq, bin_width(frame_len, SAMPLING_RATE));
 	actual_bin_index = max_bin_index(freq_bin_magnitudes, frame_len);
 
@@ -33,50 +48,92 @@ static bool assert_sine_wave_freq_to_bin_index(const char *sine_freq_str, int i,
 	return true;
 }
 
+/** @brief Assert the interpolated frequency of a sine wave is within a fraction of a bin width of it. */
+static bool assert_sine_wave_interpolate_peak_freq(struct file_source_worker *worker, const char *sine_freq_str, int i, 
+						   const int16_t *samples, enum frame_length frame_len)
+{
+	float32_t sine_freq, actual_freq;
+	magnitude_t *freq_bin_magnitudes;
+	float32_t binwidth = bin_width(frame_len, SAMPLING_RATE);
+
+	sscanf(sine_freq_str, "%f", &sine_freq);
+	if (i == 1)
+		dsp_ctx_init(&worker->ctx, frame_len, frame_len, worker->ctx_mem);
+	freq_bin_magnitudes = dsp_ctx_samples_to_freq_bin_magnitudes_s16(&worker->ctx, samples, worker->converted_samples);
+	actual_freq = interpolate_peak_freq(freq_bin_magnitudes, max_bin_index(freq_bin_magnitudes, frame_len), 
+					    frame_len, SAMPLING_RATE);
+
+	/* 
+	 * A sine between bins is estimated to within ~0.01 Hz (~0.15 cents) at 98 Hz, as opposed to up to
+	 * half a bin width (~0.5 Hz, ~9 cents) off without interpolation. 
+	 */
+	Assert(fabsf(actual_freq-sine_freq) <= binwidth/50, "expected sine %.2f Hz but interpolated %.3f Hz, bin width %.3f", 
+							       sine_freq, actual_freq, binwidth);
+	return true;
+}
+
 /**
- * @brief Generate peaks in the empty magnitudes array at the first NHARMONICS harmonics of the fundamental frequency. 
+ * @brief Generate peaks in the empty magnitudes array at the first nharmonics harmonics of the fundamental frequency. 
  * @return The expected magnitude value of the fundamental frequency / maximum peak after HPS.
  */
-static float32_t generate_harmonic_peaks(float32_t fundamental_freq, float32_t *mags, float32_t binwidth)
+static float32_t generate_harmonic_peaks(float32_t fundamental_freq, magnitude_t *mags, float32_t binwidth, 
+					 int nharmonics)
 {
+#if FIXED_POINT
+	/* 
+	 * Half of full scale (0.5 in q31), which HPS doesn't scale up, but it scales each product of 
+	 * 0.25 back up to the max product of half of full scale.
+	 */
+	const magnitude_t harmonic_peak_mag = 1 << 30;
+	const float32_t expected_peak_mag = 1 << 30;
+#else
 	const int harmonic_peak_mag = 2;  /* At least higher than 1 so a multiplication with it returns an increased value. */
+	/* The float HPS outputs the log of the product. */
+	const float32_t expected_peak_mag = nharmonics*logf(harmonic_peak_mag);
+#endif
 	const int fundamental_freq_bin_index = freq_to_bin_index(fundamental_freq, binwidth);
 
 	mags[fundamental_freq_bin_index] = harmonic_peak_mag;
-	for (int harmonic = 2; harmonic <= NHARMONICS; ++harmonic) {
+	for (int harmonic = 2; harmonic <= nharmonics; ++harmonic) {
 		int harmonic_bin_index = harmonic*fundamental_freq_bin_index;
 		mags[harmonic_bin_index] = harmonic_peak_mag;
 	}
-	return pow(harmonic_peak_mag, NHARMONICS);
+	return expected_peak_mag;
 }
 
 /** @brief Assert the implementation of harmonic_product_spectrum() finds the peak value of harmonics as intended. */
-static void assert_hps_find_harmonic_peaks(float32_t fundamental_freq, enum frame_length frame_len, int sampling_rate)
+static void assert_hps_find_harmonic_peaks(float32_t fundamental_freq, enum frame_length frame_len, int sampling_rate,
+					   int nharmonics)
 {
-	float32_t mags[MAX_NR_BINS] = { 0 };
+	magnitude_t mags[MAX_NR_BINS] = { 0 };
 	int expected_bin_index, actual_bin_index;
 	float32_t expected_mag, actual_mag;
 	float32_t binwidth;
 
 	binwidth = bin_width(frame_len, sampling_rate);
 	expected_bin_index = freq_to_bin_index(fundamental_freq, binwidth);
-	expected_mag = generate_harmonic_peaks(fundamental_freq, mags, binwidth);
-	harmonic_product_spectrum(mags, frame_len, sampling_rate);
+	expected_mag = generate_harmonic_peaks(fundamental_freq, mags, binwidth, nharmonics);
+	harmonic_product_spectrum(mags, frame_len, sampling_rate, nharmonics);
 	actual_bin_index = max_bin_index(mags, frame_len);
 	actual_mag = mags[actual_bin_index];
 	
 	Assert(actual_bin_index == expected_bin_index, "max mag peak after HPS for fundamental freq %.2f found at bin index "
 						       "%d but expected at index %d", fundamental_freq, actual_bin_index, expected_bin_index);
-	Assert(actual_mag == expected_mag, "max mag peak after HPS for fundamental freq %.2f expected mag %.2f but was %.2f", fundamental_freq,
-					   expected_mag, actual_mag);
+	/* Accept the rounding of the sum of the logs. */
+	Assert(fabsf(actual_mag-expected_mag) <= expected_mag*1e-6, "max mag peak after HPS for fundamental freq %.2f, "
+								    "%d harmonics, expected mag %.2f but was %.2f", 
+								    fundamental_freq, nharmonics, expected_mag, actual_mag);
 }
 
 static void test_hps_find_harmonic_peaks(void)
 {
 	/* Reminder bin width will be ~0.9766. */
-	assert_hps_find_harmonic_peaks(97.7, FRAME_LEN_4096, SAMPLING_RATE);
-	assert_hps_find_harmonic_peaks(98, FRAME_LEN_4096, SAMPLING_RATE);
-	assert_hps_find_harmonic_peaks(98.6, FRAME_LEN_4096, SAMPLING_RATE);
+	assert_hps_find_harmonic_peaks(97.7, FRAME_LEN_4096, SAMPLING_RATE, NHARMONICS);
+	assert_hps_find_harmonic_peaks(98, FRAME_LEN_4096, SAMPLING_RATE, NHARMONICS);
+	assert_hps_find_harmonic_peaks(98.6, FRAME_LEN_4096, SAMPLING_RATE, NHARMONICS);
+	/* Past the count at which the float product of magnitudes used to overflow. */
+	assert_hps_find_harmonic_peaks(98, FRAME_LEN_4096, SAMPLING_RATE, 8);
+	assert_hps_find_harmonic_peaks(98, FRAME_LEN_4096, SAMPLING_RATE, 12);
 }
 
 static float32_t note_frequency(const char *note_name)
@@ -92,16 +149,17 @@ static float32_t note_frequency(const char *note_name)
 }
 
 /** @brief Assert harmonic product spectrum turns the fundamental frequency into the maximum peak. */
-static bool assert_hps(const char *note_name, int i, const int16_t *samples, enum frame_length frame_len)
+static bool assert_hps(struct file_source_worker *worker, const char *note_name, int i, const int16_t *samples, 
+		       enum frame_length frame_len)
 {
-	float32_t *freq_bin_magnitudes;
+	magnitude_t *freq_bin_magnitudes;
 	float32_t note_freq;
 	int expected_bin_index, actual_bin_index;
 
 	if (i == 1)
-		samples_to_freq_bin_magnitudes_init(frame_len);
-	freq_bin_magnitudes = samples_to_freq_bin_magnitudes_s16(samples, frame_len);
-	harmonic_product_spectrum(freq_bin_magnitudes, frame_len, SAMPLING_RATE);
+		dsp_ctx_init(&worker->ctx, frame_len, frame_len, worker->ctx_mem);
+	freq_bin_magnitudes = dsp_ctx_samples_to_freq_bin_magnitudes_s16(&worker->ctx, samples, worker->converted_samples);
+	dsp_ctx_harmonic_product_spectrum(&worker->ctx, freq_bin_magnitudes, NHARMONICS);
 
 	note_freq = note_frequency(note_name);
 	expected_bin_index = freq_to_bin_index(note_freq, bin_width(frame_len, SAMPLING_RATE));
@@ -112,6 +170,731 @@ static bool assert_hps(const char *note_name, int i, const int16_t *samples, enu
 	return true;
 }
 
+/**
+ * @brief Assert pushing an oversized frame in blocks gives the same frequency bin magnitudes 
+ *        as processing the whole oversized frame in one go.
+ */
+static bool assert_push_blocks(const char *filename, int i, const int16_t *samples, enum frame_length frame_len)
+{
+	/* Shorter than the oversized frame for the shortest frame lengths. */
+	const int block_len = frame_len*OVERSAMPLING_FACTOR < 256 ? frame_len*OVERSAMPLING_FACTOR/2 : 256;
+	static magnitude_t expected_freq_bin_magnitudes[MAX_NR_BINS];
+	magnitude_t *actual_freq_bin_magnitudes;
+	const int nbins = nr_bins(frame_len);
+	int mismatch_bin_index = 0;
+
+	/* 
+	 * Both are initialised at the start of each frame because the streaming and non-streaming versions
+	 * share filter state.
+	 */
+	samples_to_freq_bin_magnitudes_init(frame_len);
+	memcpy(expected_freq_bin_magnitudes, samples_to_freq_bin_magnitudes_s16(samples, frame_len), 
+	       nbins*sizeof(magnitude_t));
+	samples_to_freq_bin_magnitudes_init(frame_len);
+	actual_freq_bin_magnitudes = samples_to_freq_bin_magnitudes_blocks_s16(samples, frame_len, block_len);
+
+	/* Accept some tolerance as the filter may accumulate in a different order for a different block length. */
+	for (int j = 1; j < nbins && !mismatch_bin_index; ++j) {
+		float32_t expected = magnitude_to_float(expected_freq_bin_magnitudes[j], frame_len);
+		float32_t actual = magnitude_to_float(actual_freq_bin_magnitudes[j], frame_len);
+		if (fabsf(expected-actual) > expected*1e-4)
+			mismatch_bin_index = j;
+	}
+	Assert(!mismatch_bin_index, "file %s, frame %d, bin %d mag differs when pushed in blocks of %d", 
+				    filename, i, mismatch_bin_index, block_len);
+	return true;
+}
+
+/** 
+ * @brief Assert each frame length can be selected at run time and processes the note files. 
+ *
+ * Only the processing is checked here and not which note is found because with the wider bin widths of 
+ * the shorter frame lengths HPS often finds the wrong octave for the lower notes.
+ */
+static void test_frame_lengths(void)
+{
+	enum frame_length frame_lens[] = { FRAME_LEN_32, FRAME_LEN_64, FRAME_LEN_128, FRAME_LEN_256, 
+					   FRAME_LEN_512, FRAME_LEN_1024, FRAME_LEN_2048, FRAME_LEN_4096 };
+
+	for (int i = 0; i < sizeof(frame_lens)/sizeof(enum frame_length); ++i) {
+		Assert(samples_to_freq_bin_magnitudes_init(frame_lens[i]), "frame len %d failed to init", frame_lens[i]);
+		Assert(hop_samples_to_freq_bin_magnitudes_init(frame_lens[i], frame_lens[i]/4), 
+		       "frame len %d failed to init for hops", frame_lens[i]);
+		for_each_file_source(NOTE_FILES_DIR, frame_lens[i], assert_push_blocks);
+	}
+}
+
+/**
+ * @brief Assert harmonic product spectrum turns the fundamental frequency into the maximum peak for each
+ *        overlapping frame produced by hop_samples_to_freq_bin_magnitudes().
+ */
+static bool assert_hop_hps(const char *note_name, int i, const int16_t *samples, enum frame_length frame_len)
+{
+	const int hops_in_frame = 4;
+	const int hop_len = frame_len/hops_in_frame;
+	magnitude_t *freq_bin_magnitudes;
+	float32_t note_freq;
+	int expected_bin_index, actual_bin_index;
+
+	if (i == 1)
+		hop_samples_to_freq_bin_magnitudes_init(frame_len, hop_len);
+	note_freq = note_frequency(note_name);
+	expected_bin_index = freq_to_bin_index(note_freq, bin_width(frame_len, SAMPLING_RATE));
+
+	for (int j = 1; j <= hops_in_frame; ++j) {
+		freq_bin_magnitudes = hop_samples_to_freq_bin_magnitudes_s16(samples, frame_len, hop_len);
+		samples += hop_len*OVERSAMPLING_FACTOR;
+		/* Skip the hops in the first frame that are still partly zero padded. */
+		if (i == 1 && j < hops_in_frame)
+			continue;
+		harmonic_product_spectrum(freq_bin_magnitudes, frame_len, SAMPLING_RATE, NHARMONICS);
+		actual_bin_index = max_bin_index(freq_bin_magnitudes, frame_len);
+
+		/* 
+		 * Allow a bin either side because a recorded note isn't exactly at its reference frequency 
+		 * and can fall either side of a bin boundary in the frames that straddle two recorded frames.
+		 */
+		Assert(abs(expected_bin_index-actual_bin_index) <= 1, "expected bin index %d for note %s (%.3f Hz), frame len %d, frame %d, "
+							       "hop %d, but was %d", expected_bin_index, note_name, note_freq, frame_len, 
+							       i, j, actual_bin_index);
+	}
+	return true;
+}
+
+/**
+ * @brief Assert computing only the magnitudes of hps_magnitude_bin_range() gets the same magnitudes
+ *        there as computing them all, and that HPS on them finds the same peak among the candidates 
+ *        as on all of them. Also assert the approximate magnitudes are within their max error.
+ */
+static bool assert_pruned_hps(const char *note_name, int i, const int16_t *samples, enum frame_length frame_len)
+{
+	const int hop_len = frame_len/4;
+	const struct bin_range range = hps_magnitude_bin_range(frame_len, SAMPLING_RATE, NHARMONICS);
+	const struct bin_range candidates = hps_candidate_bin_range(frame_len, SAMPLING_RATE, NHARMONICS);
+	static magnitude_t expected_freq_bin_magnitudes[MAX_NR_BINS];
+	magnitude_t *actual_freq_bin_magnitudes;
+	int expected_bin_index, actual_bin_index;
+	int mismatch_bin_index = 0, inaccurate_bin_index = 0;
+
+	if (i == 1)
+		hop_samples_to_freq_bin_magnitudes_init(frame_len, hop_len);
+	hop_samples_push_s16(samples, frame_len, hop_len);
+	/* Each finish gets the magnitudes of the same hop. */
+	memcpy(expected_freq_bin_magnitudes, hop_samples_to_freq_bin_magnitudes_finish(frame_len), 
+	       nr_bins(frame_len)*sizeof(magnitude_t));
+	actual_freq_bin_magnitudes = hop_samples_to_freq_bin_magnitudes_range_finish(frame_len, range, true);
+	for (int j = range.first; j < range.end && !inaccurate_bin_index; ++j) {
+		float32_t expected = magnitude_to_float(expected_freq_bin_magnitudes[j], frame_len);
+		float32_t actual = magnitude_to_float(actual_freq_bin_magnitudes[j], frame_len);
+		/* Plus some tolerance for the rounding of the fixed-point version. */
+		if (fabsf(expected-actual) > expected*0.04f+1)
+			inaccurate_bin_index = j;
+	}
+	actual_freq_bin_magnitudes = hop_samples_to_freq_bin_magnitudes_range_finish(frame_len, range, false);
+	for (int j = range.first; j < range.end && !mismatch_bin_index; ++j) {
+		if (expected_freq_bin_magnitudes[j] != actual_freq_bin_magnitudes[j])
+			mismatch_bin_index = j;
+	}
+	harmonic_product_spectrum(expected_freq_bin_magnitudes, frame_len, SAMPLING_RATE, NHARMONICS);
+	harmonic_product_spectrum(actual_freq_bin_magnitudes, frame_len, SAMPLING_RATE, NHARMONICS);
+	expected_bin_index = max_bin_index(expected_freq_bin_magnitudes, frame_len);
+	actual_bin_index = max_bin_index_in_range(actual_freq_bin_magnitudes, candidates);
+
+	Assert(!inaccurate_bin_index, "note %s, frame %d, bin %d approximate mag off by more than its max error", 
+				      note_name, i, inaccurate_bin_index);
+	Assert(!mismatch_bin_index, "note %s, frame %d, bin %d mag differs when pruned", note_name, i, mismatch_bin_index);
+	Assert(expected_bin_index == actual_bin_index, "note %s, frame %d, HPS peak at bin index %d when pruned but %d "
+						       "otherwise", note_name, i, actual_bin_index, expected_bin_index);
+	return true;
+}
+
+/** @brief Fill samples with white noise of up to +-amplitude from a linear congruential generator. */
+static void generate_noise(int16_t *samples, int len, int amplitude)
+{
+	static uint32_t state = 1;
+
+	for (int i = 0; i < len; ++i) {
+		state = state*1664525+1013904223;
+		samples[i] = (int16_t)((int32_t)(state >> 16)%(2*amplitude+1)-amplitude);
+	}
+}
+
+/** 
+ * @brief Push a hop of samples through the energy gate without finishing it (as when the gate is
+ *        closed) and return whether the gate is open.
+ */
+static bool energy_gate_hop_s16(struct energy_gate *gate, const int16_t *samples, enum frame_length frame_len, 
+				int hop_len)
+{
+	hop_samples_push_s16(samples, frame_len, hop_len);
+	return energy_gate_update(gate, hop_samples_energy());
+}
+
+/**
+ * @brief Assert the energy gate calibrated on quiet noise stays closed on it, opens on the first hop
+ *        of each note, and closes again once a louder noise floor has been going on for long enough.
+ */
+static bool assert_energy_gate(const char *note_name, int i, const int16_t *samples, enum frame_length frame_len)
+{
+	const int hop_len = frame_len/4;
+	static int16_t noise[OVERSAMPLING_FACTOR*MAX_FRAME_LEN/4];
+	struct energy_gate gate;
+	int nr_open_hops = 0, nr_loud_noise_hops = 0;
+	bool open;
+
+	/* The note starts at the start of its file. */
+	if (i != 1)
+		return true;
+	hop_samples_to_freq_bin_magnitudes_init(frame_len, hop_len);
+	energy_gate_init(&gate);
+	for (int j = 0; j < 2*GATE_CALIBRATION_HOPS; ++j) {
+		generate_noise(noise, OVERSAMPLING_FACTOR*hop_len, 100);
+		nr_open_hops += energy_gate_hop_s16(&gate, noise, frame_len, hop_len);
+	}
+	open = energy_gate_hop_s16(&gate, samples, frame_len, hop_len);
+	/* A tenfold louder noise floor, i.e. 20 dB, takes a while to learn while the gate is open. */
+	do {
+		generate_noise(noise, OVERSAMPLING_FACTOR*hop_len, 1000);
+	} while (energy_gate_hop_s16(&gate, noise, frame_len, hop_len) && ++nr_loud_noise_hops < 2000);
+
+	Assert(!nr_open_hops, "note %s, gate open on %d hops of the noise it was calibrated on", note_name, nr_open_hops);
+	Assert(open, "note %s, gate closed on the first hop of the note, noise floor %.0f", note_name, 
+		     energy_gate_noise_floor(&gate));
+	Assert(nr_loud_noise_hops < 2000, "note %s, gate still open after %d hops of louder noise", note_name, 
+					  nr_loud_noise_hops);
+	return true;
+}
+
+#define ONSET_TEST_BLOCK_LEN 256
+
+/**
+ * @brief Stream nr_noise_blocks blocks of noise then the note in samples through HPS a block at a time
+ *        with the energy gate as on the MCU, and optionally restart the hop at onsets, with the first
+ *        hop after an onset half a hop long.
+ * @return The number of blocks of the note pushed by the end of the first hop that finds the note, or 
+ *         that of the whole note if none do.
+ */
+static int blocks_to_correct_note(const char *note_name, const int16_t *samples, int nr_samples, 
+				  int nr_noise_blocks, bool restart_on_onset)
+{
+	const enum frame_length frame_len = FRAME_LEN_4096;
+	const int hop_len = frame_len/4, block_len = ONSET_TEST_BLOCK_LEN;
+	const int blocks_in_hop = OVERSAMPLING_FACTOR*hop_len/block_len;
+	static int16_t noise[ONSET_TEST_BLOCK_LEN];
+	static sample_t block[ONSET_TEST_BLOCK_LEN];
+	struct energy_gate gate;
+	struct onset_detector od;
+	struct note_freq *nf;
+	float32_t frequency, strength;
+	int nr_hop_blocks = 0;
+
+	hps_pitch_detector.init(frame_len, hop_len);
+	energy_gate_init(&gate);
+	onset_detector_init(&od, block_len);
+	for (int i = 0; i < nr_noise_blocks+nr_samples/block_len; ++i) {
+		if (i < nr_noise_blocks) {
+			generate_noise(noise, block_len, 100);
+			s16_array_to_samples(noise, block, block_len);
+		} else {
+			s16_array_to_samples(samples+(i-nr_noise_blocks)*block_len, block, block_len);
+		}
+		hps_pitch_detector.push_block(block, block_len);
+		if (restart_on_onset && onset_detector_update(&od, hop_samples_block_energy())) {
+			hop_samples_restart_hop(block_len, hop_len/2);
+			nr_hop_blocks = blocks_in_hop/2;
+		}
+		if (++nr_hop_blocks < blocks_in_hop)
+			continue;
+		nr_hop_blocks = 0;
+		if (!energy_gate_update(&gate, hop_samples_energy()))
+			continue;
+		frequency = hps_pitch_detector.finish(frame_len, &strength);
+		nf = nearest_note(frequency);
+		if (i >= nr_noise_blocks && nf && strcasecmp(nf->note_name, note_name) == 0)
+			return i+1-nr_noise_blocks;
+	}
+	return nr_samples/block_len;
+}
+
+static int nr_onset_notes, nr_blocks_fixed_hops, nr_blocks_onset_hops;
+
+/**
+ * @brief Count the blocks to the first correct note of the note starting at each block of a hop after 
+ *        enough noise to calibrate the energy gate, with hops on fixed boundaries and restarted at the onset.
+ */
+static bool count_blocks_to_correct_note(const char *note_name, int i, const int16_t *samples, 
+					 enum frame_length frame_len)
+{
+	const int nr_samples = OVERSAMPLING_FACTOR*frame_len;
+	const int blocks_in_hop = nr_samples/4/ONSET_TEST_BLOCK_LEN;
+	const int nr_noise_blocks = (GATE_CALIBRATION_HOPS+1)*blocks_in_hop;
+
+	/* The note starts at the start of its file. */
+	if (i != 1)
+		return true;
+	for (int offset = 0; offset < blocks_in_hop; ++offset) {
+		nr_blocks_fixed_hops += blocks_to_correct_note(note_name, samples, nr_samples, nr_noise_blocks+offset, false);
+		nr_blocks_onset_hops += blocks_to_correct_note(note_name, samples, nr_samples, nr_noise_blocks+offset, true);
+		++nr_onset_notes;
+	}
+	return true;
+}
+
+/** 
+ * @brief Assert restarting the hop at the onset of the note gets to the correct note faster on average 
+ *        than waiting for the hops on fixed boundaries. 
+ */
+static void test_onset_time_to_correct_note(void)
+{
+	const float32_t block_period = (float32_t)ONSET_TEST_BLOCK_LEN/(OVERSAMPLING_FACTOR*SAMPLING_RATE);
+	float32_t fixed_hops_time, onset_hops_time;
+
+	nr_onset_notes = nr_blocks_fixed_hops = nr_blocks_onset_hops = 0;
+	for_each_file_source(NOTE_FILES_DIR, FRAME_LEN_4096, count_blocks_to_correct_note);
+	fixed_hops_time = block_period*nr_blocks_fixed_hops/nr_onset_notes;
+	onset_hops_time = block_period*nr_blocks_onset_hops/nr_onset_notes;
+	Assert(onset_hops_time < 0.8f*fixed_hops_time, "mean time to the first correct note %.3f s with hops restarted "
+						       "at the onset, %.3f s with fixed hops", onset_hops_time, fixed_hops_time);
+}
+
+/**
+ * @brief Assert the first reading of HPS after the onset of a synthesised pluck (see synth.h), of the 
+ *        frame of mostly zeros left by restarting the hop, is within a couple of cents of the pluck. The
+ *        interpolation of a full frame reads the same plucks up to ~5 cents off.
+ */
+static void test_onset_first_reading_cents(void)
+{
+	const enum frame_length frame_len = FRAME_LEN_4096;
+	const int hop_len = frame_len/4, block_len = ONSET_TEST_BLOCK_LEN;
+	const int nr_silent_samples = OVERSAMPLING_FACTOR*frame_len;
+	const int nr_samples = nr_silent_samples+OVERSAMPLING_FACTOR*hop_len;
+	const char *note_names[] = { "E2", "A2", "D3", "G3", "B3", "E4" };
+	struct pluck pluck = {
+		.amplitude = 0.5,
+		.nr_harmonics = 12,
+		.decay_secs = 1.5,
+		.inharmonicity = 1e-4,
+		.pluck_position = 0.2,
+		.noise_rms = 2,
+		.dc_offset = 37,
+	};
+	static uint16_t u12_samples[OVERSAMPLING_FACTOR*(FRAME_LEN_4096+FRAME_LEN_4096/4)];
+	static sample_t block[ONSET_TEST_BLOCK_LEN];
+	struct adc_converter conv;
+	struct onset_detector od;
+	float32_t frequency, strength, cents;
+
+	for (int n = 0; n < (int)(sizeof(note_names)/sizeof(note_names[0])); ++n) {
+		int nr_hop_blocks_left = -1;
+
+		/* Off the note, so that the pluck falls at various fractions of a bin. */
+		pluck.frequency = detune(note_frequency(note_names[n]), 23);
+		pluck.seed = n+1;
+		synth_pluck_u12(&pluck, u12_samples, nr_samples, nr_silent_samples, OVERSAMPLING_RATE);
+		hps_pitch_detector.init(frame_len, hop_len);
+		onset_detector_init(&od, block_len);
+		adc_converter_init(&conv);
+		frequency = 0;
+		for (int i = 0; i+block_len <= nr_samples; i += block_len) {
+			convert_adc_u12_samples(&conv, u12_samples+i, block, block_len);
+			hps_pitch_detector.push_block(block, block_len);
+			if (onset_detector_update(&od, hop_samples_block_energy())) {
+				hop_samples_restart_hop(block_len, hop_len/2);
+				nr_hop_blocks_left = OVERSAMPLING_FACTOR*hop_len/2/block_len;
+			}
+			if (--nr_hop_blocks_left == 0) {
+				frequency = hps_pitch_detector.finish(frame_len, &strength);
+				break;
+			}
+		}
+		cents = 1200*log2f(frequency/pluck.frequency);
+		Assert(fabsf(cents) < 2, "first reading after the onset of a pluck of %.3f Hz is %.3f Hz, %.1f cents off",
+		       pluck.frequency, frequency, cents);
+	}
+}
+
+static int nr_tracked_blocks, nr_correct_tracked_blocks;
+
+/**
+ * @brief Push each note file a block at a time, finding the note with the full search of HPS at the end
+ *        of each hop until the tracker locks, then tracking it after each block. Count the blocks tracked
+ *        and of those the ones where the note is right.
+ */
+static bool count_tracked_notes(const char *note_name, int i, const int16_t *samples, enum frame_length frame_len)
+{
+	const int hop_len = frame_len/4, block_len = 256;
+	const int nr_blocks = OVERSAMPLING_FACTOR*frame_len/block_len, blocks_in_hop = nr_blocks/4;
+	static struct note_tracker nt;
+	static sample_t block[256];
+	float32_t frequency, tracked_frequency = 0, strength;
+	struct note_freq *nf;
+
+	if (i == 1) {
+		hps_pitch_detector.init(frame_len, hop_len);
+		note_tracker_init(&nt, dsp_default_ctx(), block_len);
+	}
+	for (int j = 1; j <= nr_blocks; ++j) {
+		s16_array_to_samples(samples+(j-1)*block_len, block, block_len);
+		hps_pitch_detector.push_block(block, block_len);
+		if (nt.note) {
+			tracked_frequency = note_tracker_track(&nt);
+			++nr_tracked_blocks;
+			nf = nearest_note(tracked_frequency);
+			if (nf && strcasecmp(nf->note_name, note_name) == 0)
+				++nr_correct_tracked_blocks;
+		}
+		/* Skip the hops in the first frame that are still partly zero padded. */
+		if (j%blocks_in_hop != 0 || (i == 1 && j < nr_blocks))
+			continue;
+		frequency = hps_pitch_detector.finish(frame_len, &strength);
+		if (!nt.note)
+			note_tracker_lock(&nt, frequency);
+	}
+	return true;
+}
+
+/**
+ * @brief Push a synthesised pluck (see synth.h) a block at a time, locking the tracker with the full 
+ *        search of HPS at the end of each hop and then tracking it after each block.
+ * @return The most cents the tracked frequency is off the pluck, or INFINITY if the tracker never locks.
+ */
+static float32_t max_tracked_pluck_cents_off(const struct pluck *pluck)
+{
+	const enum frame_length frame_len = FRAME_LEN_4096;
+	const int hop_len = frame_len/4, block_len = 256;
+	const int nr_samples = 2*OVERSAMPLING_FACTOR*frame_len, blocks_in_hop = OVERSAMPLING_FACTOR*hop_len/block_len;
+	static uint16_t u12_samples[2*OVERSAMPLING_FACTOR*FRAME_LEN_4096];
+	static sample_t block[256];
+	struct adc_converter conv;
+	struct note_tracker nt;
+	float32_t strength, max_cents_off = INFINITY;
+
+	synth_pluck_u12(pluck, u12_samples, nr_samples, 0, OVERSAMPLING_RATE);
+	hps_pitch_detector.init(frame_len, hop_len);
+	note_tracker_init(&nt, dsp_default_ctx(), block_len);
+	adc_converter_init(&conv);
+	for (int j = 1; j*block_len <= nr_samples; ++j) {
+		convert_adc_u12_samples(&conv, u12_samples+(j-1)*block_len, block, block_len);
+		hps_pitch_detector.push_block(block, block_len);
+		if (nt.note) {
+			float32_t cents_off = fabsf(1200*log2f(note_tracker_track(&nt)/pluck->frequency));
+
+			max_cents_off = isinf(max_cents_off) ? cents_off : fmaxf(cents_off, max_cents_off);
+		} else if (j%blocks_in_hop == 0) {
+			note_tracker_lock(&nt, hps_pitch_detector.finish(frame_len, &strength));
+		}
+	}
+	return max_cents_off;
+}
+
+/** @brief Fill samples with a tone of TRACK_NHARMONICS equal harmonics, continuing from phase. */
+static void generate_tone(int16_t *samples, int len, float32_t frequency, float32_t *phase)
+{
+	const float32_t amplitude = 8000;
+	float32_t sum;
+
+	for (int i = 0; i < len; ++i) {
+		sum = 0;
+		for (int harmonic = 1; harmonic <= TRACK_NHARMONICS; ++harmonic)
+			sum += sinf(harmonic*(*phase));
+		samples[i] = amplitude*sum/TRACK_NHARMONICS;
+		*phase = fmodf(*phase+2*PI*frequency/(OVERSAMPLING_FACTOR*SAMPLING_RATE), 2*PI);
+	}
+}
+
+/** @brief Push a block of samples to the hops of frame length FRAME_LEN_4096. */
+static void push_block_s16(const int16_t *samples, int block_len)
+{
+	static sample_t block[256];
+
+	s16_array_to_samples(samples, block, block_len);
+	hop_samples_to_freq_bin_magnitudes_push_block(block, block_len);
+}
+
+/** @brief Lock the tracker onto a steady tone at the frequency, after pushing a window of it. */
+static void lock_on_tone(struct note_tracker *nt, float32_t frequency, int16_t *samples, int block_len, 
+			 float32_t *phase)
+{
+	hop_samples_to_freq_bin_magnitudes_init(FRAME_LEN_4096, FRAME_LEN_4096/4);
+	note_tracker_init(nt, dsp_default_ctx(), block_len);
+	for (int i = 0; i < OVERSAMPLING_FACTOR*TRACK_WINDOW_LEN/block_len; ++i) {
+		generate_tone(samples, block_len, frequency, phase);
+		push_block_s16(samples, block_len);
+	}
+	for (int i = 0; i < TRACK_LOCK_READINGS; ++i)
+		note_tracker_lock(nt, frequency);
+}
+
+/**
+ * @brief Assert the tracker follows the note in the notes files, follows synthesised plucks, a steady and
+ *        a gliding tone closely, and loses the note once the glide is over a semitone from the locked note
+ *        or the tone stops.
+ */
+static void test_note_tracker(void)
+{
+	const int block_len = 256;
+	const float32_t a2 = 110;
+	const char *note_names[] = { "E2", "A2", "D3", "G3", "B3", "E4" };
+	struct pluck pluck = {
+		.amplitude = 0.5,
+		.nr_harmonics = 12,
+		.decay_secs = 1.5,
+		.inharmonicity = 1e-4,
+		.pluck_position = 0.2,
+		.noise_rms = 2,
+		.dc_offset = 37,
+	};
+	static int16_t samples[256];
+	struct note_tracker nt;
+	float32_t phase = 0, frequency = a2, tracked_frequency = 0, cents_off;
+	int nr_blocks;
+
+	for_each_file_source(NOTE_FILES_DIR, FRAME_LEN_4096, count_tracked_notes);
+	Assert(nr_tracked_blocks > 0 && nr_correct_tracked_blocks == nr_tracked_blocks, 
+	       "tracked the note in %d of %d blocks", nr_correct_tracked_blocks, nr_tracked_blocks);
+	/*
+	 * The plucks have a known frequency, unlike the note files, where the full search itself reads the
+	 * low notes with weak fundamentals up to ~12 cents off.
+	 */
+	for (int n = 0; n < (int)(sizeof(note_names)/sizeof(note_names[0])); ++n) {
+		pluck.frequency = detune(note_frequency(note_names[n]), -17);
+		pluck.seed = n+1;
+		cents_off = max_tracked_pluck_cents_off(&pluck);
+		Assert(cents_off < 2, "tracked pluck of %.3f Hz up to %.1f cents off", pluck.frequency, cents_off);
+	}
+
+	/* A steady tone doesn't lose the lock, and is tracked to within a cent. */
+	lock_on_tone(&nt, a2, samples, block_len, &phase);
+	for (nr_blocks = 0; nr_blocks < 32 && nt.note; ++nr_blocks) {
+		generate_tone(samples, block_len, a2, &phase);
+		push_block_s16(samples, block_len);
+		tracked_frequency = note_tracker_track(&nt);
+	}
+	Assert(nt.note && fabsf(1200*log2f(tracked_frequency/a2)) <= 1, "tracked steady tone %.2f Hz as %.2f Hz, "
+								   "lost after %d blocks", a2, tracked_frequency, nr_blocks);
+	/* A glide of 10 cents a block is followed, lagging by about half a window, until it's a semitone out. */
+	while (nt.note && frequency < 2*a2) {
+		frequency *= powf(2, 10.0f/CENTS_IN_OCTAVE);
+		generate_tone(samples, block_len, frequency, &phase);
+		push_block_s16(samples, block_len);
+		note_tracker_track(&nt);
+	}
+	Assert(!nt.note && 1200*log2f(frequency/a2) > CENTS_IN_SEMITONE && 1200*log2f(frequency/a2) < 2*CENTS_IN_SEMITONE, 
+	       "gliding tone lost %.0f cents from the locked note", 1200*log2f(frequency/a2));
+	/* Once the tone stops, only noise is left and the note is lost within a window. */
+	lock_on_tone(&nt, a2, samples, block_len, &phase);
+	for (nr_blocks = 0; nr_blocks < OVERSAMPLING_FACTOR*TRACK_WINDOW_LEN/block_len && nt.note; ++nr_blocks) {
+		generate_noise(samples, block_len, 100);
+		push_block_s16(samples, block_len);
+		note_tracker_track(&nt);
+	}
+	Assert(!nt.note, "note still tracked after a window of noise");
+}
+
+static const struct pitch_detector *pitch_detector;
+static int nr_pitched_hops, nr_correct_pitched_hops;
+
+/**
+ * @brief Run pitch_detector on each hop of the note files, counting the hops strong enough to have a pitch
+ *        and of those the ones where the pitch is the nearest to the note of the file.
+ */
+static bool count_correct_pitches(const char *note_name, int i, const int16_t *samples, enum frame_length frame_len)
+{
+	const int hops_in_frame = 4;
+	const int hop_len = frame_len/hops_in_frame;
+	float32_t frequency, strength;
+	struct note_freq *nf;
+
+	if (i == 1)
+		pitch_detector->init(frame_len, hop_len);
+	for (int j = 1; j <= hops_in_frame; ++j) {
+		frequency = pitch_detector_hop_s16(pitch_detector, samples, frame_len, hop_len, &strength);
+		samples += hop_len*OVERSAMPLING_FACTOR;
+		/* Skip the hops in the first frame that are still partly zero padded. */
+		if ((i == 1 && j < hops_in_frame) || strength < pitch_detector->min_strength)
+			continue;
+		++nr_pitched_hops;
+		nf = nearest_note(frequency);
+		if (nf && strcasecmp(nf->note_name, note_name) == 0)
+			++nr_correct_pitched_hops;
+	}
+	return true;
+}
+
+/**
+ * @brief Assert the pitch detector finds the note of at least min_correct (fraction) of the hops
+ *        with a pitch in the note files.
+ */
+static void assert_pitch_detector(const struct pitch_detector *pd, enum frame_length frame_len, float32_t min_correct)
+{
+	pitch_detector = pd;
+	nr_pitched_hops = nr_correct_pitched_hops = 0;
+	for_each_file_source(NOTE_FILES_DIR, frame_len, count_correct_pitches);
+	Assert(nr_pitched_hops > 0 && nr_correct_pitched_hops >= min_correct*nr_pitched_hops, 
+	       "pitch detector %s, frame len %d, found the note in %d of %d pitched hops", pd->name, frame_len, 
+	       nr_correct_pitched_hops, nr_pitched_hops);
+}
+
+static void test_pitch_detectors(void)
+{
+	assert_pitch_detector(&hps_pitch_detector, FRAME_LEN_4096, 1);
+	/*
+	 * MPM gets some notes an octave off: the fundamentals of the lowest notes are weakened by the 
+	 * band-pass filter, and the peaks of the higher notes are only a few lags wide at the SAMPLING_RATE.
+	 * But it's about as accurate with a frame an eighth of the length.
+	 */
+#if !FIXED_POINT
+	assert_pitch_detector(&mpm_pitch_detector, FRAME_LEN_4096, 0.8);
+	assert_pitch_detector(&mpm_pitch_detector, FRAME_LEN_512, 0.8);
+#endif
+}
+
+/* Frame and hop lengths of the two pipelines of test_dsp_ctxs_independent(). */
+static const enum frame_length pipeline_frame_lens[2] = { FRAME_LEN_4096, FRAME_LEN_1024 };
+static const int pipeline_hop_lens[2] = { FRAME_LEN_4096/4, FRAME_LEN_1024/4 };
+/* Context of each pipeline, or NULL if it isn't run, and the hash of the pitches it found. */
+static struct dsp_ctx *pipeline_ctxs[2];
+static uint32_t pipeline_hashes[2];
+
+/** @brief Hash the bits of a float into an FNV-1a hash. */
+static uint32_t hash_float(uint32_t hash, float32_t value)
+{
+	uint32_t bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+	for (int i = 0; i < 4; ++i)
+		hash = (hash ^ ((bits >> 8*i) & 0xff))*16777619;
+	return hash;
+}
+
+/** @brief Push the frame to the pipelines block by block, hashing the pitch of each hop of each pipeline. */
+static bool hash_pipeline_pitches(const char *note_name, int i, const int16_t *samples, enum frame_length frame_len)
+{
+	const int block_len = 256;
+	static sample_t block[256];
+	float32_t frequency, strength;
+
+	for (int j = 0; j < OVERSAMPLING_FACTOR*frame_len; j += block_len) {
+		s16_array_to_samples(samples+j, block, block_len);
+		for (int k = 0; k < 2; ++k) {
+			if (!pipeline_ctxs[k])
+				continue;
+			dsp_ctx_push_block(pipeline_ctxs[k], block, block_len);
+			if ((j+block_len)%(OVERSAMPLING_FACTOR*pipeline_hop_lens[k]) == 0) {
+				frequency = hps_pitch_detector.finish_ctx(pipeline_ctxs[k], &strength);
+				pipeline_hashes[k] = hash_float(hash_float(pipeline_hashes[k], frequency), strength);
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Assert two pipelines of different frame lengths, each on a context of its own with their blocks
+ *        pushed interleaved, find the same pitches as each does alone on the default context.
+ */
+static void test_dsp_ctxs_independent(void)
+{
+	struct dsp_ctx ctxs[2];
+	void *mems[2];
+	uint32_t expected_hashes[2];
+
+	for (int k = 0; k < 2; ++k) {
+		pipeline_ctxs[0] = pipeline_ctxs[1] = NULL;
+		pipeline_ctxs[k] = dsp_default_ctx();
+		pipeline_hashes[k] = 2166136261u;
+		hop_samples_to_freq_bin_magnitudes_init(pipeline_frame_lens[k], pipeline_hop_lens[k]);
+		for_each_file_source(NOTE_FILES_DIR, FRAME_LEN_4096, hash_pipeline_pitches);
+		expected_hashes[k] = pipeline_hashes[k];
+	}
+	for (int k = 0; k < 2; ++k) {
+		mems[k] = malloc(dsp_ctx_mem_size(pipeline_frame_lens[k]));
+		Assert(dsp_ctx_init(&ctxs[k], pipeline_frame_lens[k], pipeline_hop_lens[k], mems[k]), 
+		       "frame len %d failed to init a context", pipeline_frame_lens[k]);
+		pipeline_ctxs[k] = &ctxs[k];
+		pipeline_hashes[k] = 2166136261u;
+	}
+	for_each_file_source(NOTE_FILES_DIR, FRAME_LEN_4096, hash_pipeline_pitches);
+	for (int k = 0; k < 2; ++k) {
+		Assert(pipeline_hashes[k] == expected_hashes[k], "frame len %d found other pitches on a context of its own "
+		       "alongside another", pipeline_frame_lens[k]);
+		dsp_ctx_destroy(&ctxs[k]);
+		free(mems[k]);
+	}
+}
+
+#define PARALLEL_TEST_NR_WORKERS  4
+
+/*
+ * Sum of the hashes of the magnitudes of each frame, so that it's the same in any order, and the number of
+ * frames. Unlike XOR, a sum doesn't cancel out a frame that's processed twice.
+ */
+static atomic_uint frame_hashes;
+static atomic_int nr_frames;
+
+/** @brief Hash the file source, frame number and magnitudes of the frame. */
+static uint32_t hash_frame(const char *filename, int i, const magnitude_t *freq_bin_magnitudes, 
+			   enum frame_length frame_len)
+{
+	uint32_t hash = 2166136261u;
+
+	for (; *filename; ++filename)
+		hash = (hash ^ (uint8_t)*filename)*16777619;
+	hash = hash_float(hash, i);
+	for (int k = 0; k < nr_bins(frame_len); ++k)
+		hash = hash_float(hash, freq_bin_magnitudes[k]);
+	return hash;
+}
+
+static bool hash_frame_magnitudes(const char *filename, int i, const int16_t *samples, enum frame_length frame_len)
+{
+	if (i == 1)
+		samples_to_freq_bin_magnitudes_init(frame_len);
+	atomic_fetch_add(&frame_hashes, hash_frame(filename, i, samples_to_freq_bin_magnitudes_s16(samples, frame_len), 
+						   frame_len));
+	atomic_fetch_add(&nr_frames, 1);
+	return true;
+}
+
+static bool hash_frame_magnitudes_worker(struct file_source_worker *worker, const char *filename, int i, 
+					 const int16_t *samples, enum frame_length frame_len)
+{
+	magnitude_t *freq_bin_magnitudes;
+
+	Assert(worker->id < PARALLEL_TEST_NR_WORKERS, "worker %d of %d", worker->id, PARALLEL_TEST_NR_WORKERS);
+	if (i == 1)
+		dsp_ctx_init(&worker->ctx, frame_len, frame_len, worker->ctx_mem);
+	freq_bin_magnitudes = dsp_ctx_samples_to_freq_bin_magnitudes_s16(&worker->ctx, samples, worker->converted_samples);
+	atomic_fetch_add(&frame_hashes, hash_frame(filename, i, freq_bin_magnitudes, frame_len));
+	atomic_fetch_add(&nr_frames, 1);
+	return true;
+}
+
+/**
+ * @brief Assert the parallel runner processes each frame once, on workers whose contexts get the same
+ *        magnitudes as the default context does run sequentially.
+ */
+static void test_for_each_file_source_parallel(void)
+{
+	uint32_t expected_hash;
+	int expected_nr_frames;
+
+	atomic_store(&frame_hashes, 0);
+	atomic_store(&nr_frames, 0);
+	for_each_file_source(NOTE_FILES_DIR, FRAME_LEN_1024, hash_frame_magnitudes);
+	expected_hash = atomic_load(&frame_hashes);
+	expected_nr_frames = atomic_load(&nr_frames);
+	for (int nr_workers = 1; nr_workers <= PARALLEL_TEST_NR_WORKERS; ++nr_workers) {
+		atomic_store(&frame_hashes, 0);
+		atomic_store(&nr_frames, 0);
+		Assert(for_each_file_source_parallel(NOTE_FILES_DIR, FRAME_LEN_1024, nr_workers, 
+						     hash_frame_magnitudes_worker), "%d workers failed", nr_workers);
+		Assert(atomic_load(&nr_frames) == expected_nr_frames, "%d workers processed %d frames, not %d", 
+		       nr_workers, atomic_load(&nr_frames), expected_nr_frames);
+		Assert(atomic_load(&frame_hashes) == expected_hash, "%d workers got other magnitudes", nr_workers);
+	}
+}
+
 /**
  * @brief Assert each pair of adjacent notes in note_freqs is CENTS_IN_SEMITONE cents apart from each other. 
  */
@@ -157,6 +940,284 @@ static void test_convert_adc_u12_sample_to_s16(void)
 	assert_convert_adc_u12_sample_to_s16(4095, INT16_MAX);
 }
 
+static void assert_convert_adc_u12_sample_to_q15(uint16_t u12_sample)
+{
+	q15_t actual_q15_sample = convert_adc_u12_sample_to_q15(u12_sample);
+	float32_t s16_sample = convert_adc_u12_sample_to_s16(u12_sample);
+
+	/* Within a step of the 12-bit value (16 in signed 16-bit) of the float version. */
+	Assert(fabsf(actual_q15_sample-s16_sample) <= 16, "convert sample %u to q15 expected about %.2f but was %d", 
+							     u12_sample, s16_sample, actual_q15_sample);
+}
+
+static void test_convert_adc_u12_sample_to_q15(void)
+{
+	assert_convert_adc_u12_sample_to_q15(0);
+	assert_convert_adc_u12_sample_to_q15(2047);
+	assert_convert_adc_u12_sample_to_q15(2048);
+	assert_convert_adc_u12_sample_to_q15(4095);
+}
+
+/** @brief Get the mean of the samples converted from a batch of raw samples. */
+static float32_t convert_adc_u12_samples_mean(struct adc_converter *conv, const uint16_t *u12_samples, int len)
+{
+	static sample_t samples[256];
+	float32_t sum = 0;
+
+	convert_adc_u12_samples(conv, u12_samples, samples, len);
+	for (int i = 0; i < len; ++i)
+		sum += samples[i];
+	return sum/len;
+}
+
+/**
+ * @brief Assert the batched conversion starts out matching the conversion of each sample, and then 
+ *        removes a DC offset off the nominal bias once it has tracked it.
+ */
+static void test_convert_adc_u12_samples(void)
+{
+	const int len = 256;
+	const float32_t dc = 2100;
+	struct adc_converter conv;
+	uint16_t u12_samples[256];
+	sample_t samples[256];
+	float32_t mean;
+	int mismatch_index = -1;
+
+	adc_converter_init(&conv);
+	for (int i = 0; i < len; ++i)
+		u12_samples[i] = i*4095/(len-1);
+	convert_adc_u12_samples(&conv, u12_samples, samples, len);
+	for (int i = 0; i < len && mismatch_index < 0; ++i) {
+		/* Within half a step of the 12-bit value, as the batch takes the bias to be 2047.5. */
+#if FIXED_POINT
+		if (abs(samples[i]-convert_adc_u12_sample_to_q15(u12_samples[i])) > 8)
+#else
+		if (fabsf(samples[i]-convert_adc_u12_sample_to_s16(u12_samples[i])) > 8)
+#endif
+			mismatch_index = i;
+	}
+	Assert(mismatch_index < 0, "batch converted sample at index %d off the conversion of each sample", mismatch_index);
+
+	/* A sine of a whole number of periods per batch about the DC offset. */
+	adc_converter_init(&conv);
+	for (int i = 0; i < len; ++i)
+		u12_samples[i] = roundf(dc + 1000*sinf(2*PI*4*i/len));
+	mean = convert_adc_u12_samples_mean(&conv, u12_samples, len);
+	Assert(fabsf(mean-(dc-2047.5f)*16) < 16, "first batch mean %.2f, expected the offset off the nominal bias", mean);
+	for (int i = 0; i < 16*(1 << ADC_DC_RATE_SHIFT); ++i)
+		mean = convert_adc_u12_samples_mean(&conv, u12_samples, len);
+	Assert(fabsf(mean) < 16, "batch mean %.2f once the DC offset was tracked", mean);
+#if FIXED_POINT
+	/* A sample far off the DC offset estimate saturates rather than wraps around. */
+	conv.dc = 0;
+	u12_samples[0] = 4095;
+	convert_adc_u12_samples(&conv, u12_samples, samples, 1);
+	Assert(samples[0] == INT16_MAX, "sample %d with the DC offset estimate at 0", samples[0]);
+#endif
+}
+
+/**
+ * @brief Read a synthesised pluck (see synth.h) through the batched ADC conversion with the HPS pitch detector.
+ * @return The frequency read.
+ */
+static float32_t read_synth_pluck(const struct pluck *pluck)
+{
+	const enum frame_length frame_len = FRAME_LEN_4096;
+	const int nr_samples = OVERSAMPLING_FACTOR*frame_len;
+	static uint16_t u12_samples[OVERSAMPLING_FACTOR*FRAME_LEN_4096];
+	static sample_t samples[OVERSAMPLING_FACTOR*FRAME_LEN_4096];
+	struct adc_converter conv;
+	float32_t strength;
+	int nr_out_of_range = 0;
+
+	synth_pluck_u12(pluck, u12_samples, nr_samples, 0, OVERSAMPLING_RATE);
+	for (int i = 0; i < nr_samples; ++i)
+		nr_out_of_range += u12_samples[i] > 4095;
+	Assert(!nr_out_of_range, "%d synthesised samples past 12 bits", nr_out_of_range);
+	adc_converter_init(&conv);
+	convert_adc_u12_samples(&conv, u12_samples, samples, nr_samples);
+	hps_pitch_detector.init(frame_len, frame_len);
+	hps_pitch_detector.push_block(samples, nr_samples);
+	return hps_pitch_detector.finish(frame_len, &strength);
+}
+
+/**
+ * @brief Assert the HPS pitch detector reads a synthesised pluck detuned off a note to within a couple 
+ *        of cents.
+ */
+static void test_synth_pluck(void)
+{
+	const struct pluck pluck = {
+		.frequency = detune(note_frequency("E2"), 20),
+		.amplitude = 0.5,
+		.nr_harmonics = 12,
+		.decay_secs = 1.5,
+		.inharmonicity = 1e-4,
+		.pluck_position = 0.2,
+		.noise_rms = 2,
+		.dc_offset = 37,
+		.seed = 1,
+	};
+	float32_t frequency = read_synth_pluck(&pluck);
+
+	Assert(fabsf(1200*log2f(frequency/pluck.frequency)) < 2, "read pluck of %.3f Hz as %.3f Hz", pluck.frequency, 
+	       frequency);
+}
+
+/**
+ * @brief Assert the HPS pitch detector reads the synthesised plucks of the notes from C5 to E6, whose 
+ *        upper harmonics are above the bandwidth, to within a couple of cents rather than an octave off.
+ */
+static void test_synth_high_plucks(void)
+{
+	struct pluck pluck = {
+		.amplitude = 0.5,
+		.nr_harmonics = 12,
+		.decay_secs = 1,
+		.inharmonicity = 1e-4,
+		.pluck_position = 0.2,
+		.noise_rms = 2,
+		.dc_offset = 37,
+	};
+	const float32_t first_freq = note_frequency("C5");
+	const float32_t last_freq = note_frequency("E6");
+
+	for (struct note_freq *nf = note_freqs; nf->note_name; ++nf) {
+		float32_t frequency;
+
+		if (nf->frequency < first_freq || nf->frequency > last_freq)
+			continue;
+		pluck.frequency = detune(nf->frequency, -10);
+		pluck.seed = nf-note_freqs;
+		frequency = read_synth_pluck(&pluck);
+		Assert(fabsf(1200*log2f(frequency/pluck.frequency)) < 2, "read pluck of %s detuned to %.3f Hz as %.3f Hz", 
+		       nf->note_name, pluck.frequency, frequency);
+	}
+}
+
+/** @brief Assert the Pareto frontier keeps exactly the points no other is at least as good as in every objective. */
+static void test_pareto_frontier(void)
+{
+	/* Pairs of objectives to minimise, e.g. RAM and processing time. */
+	const float64_t objectives[] = {
+		1, 5,
+		2, 2,
+		3, 3,  /* Dominated by (2, 2). */
+		5, 1,
+		2, 2,  /* A tie doesn't dominate. */
+		NAN, 6,  /* Dominated by (1, 5) in the objective both have. */
+	};
+	/* A NAN is left out of the comparison rather than the worst, so these tie. */
+	const float64_t incomparable_objectives[] = {
+		0, 1,
+		NAN, 1,
+	};
+	const bool expected[] = { true, true, false, true, true, false };
+	const int nr_points = sizeof(expected)/sizeof(expected[0]);
+	bool on_frontier[sizeof(expected)/sizeof(expected[0])];
+	int nr_on_frontier = pareto_frontier(objectives, nr_points, 2, on_frontier);
+
+	Assert(nr_on_frontier == 4, "%d points on the frontier, expected 4", nr_on_frontier);
+	for (int i = 0; i < nr_points; ++i)
+		Assert(on_frontier[i] == expected[i], "point %d %s on the frontier", i, expected[i] ? "not" : "wrongly");
+	nr_on_frontier = pareto_frontier(incomparable_objectives, 2, 2, on_frontier);
+	Assert(nr_on_frontier == 2, "%d of 2 points with a NAN objective on the frontier", nr_on_frontier);
+}
+
+/** 
+ * @brief Assert a full ring counts an overrun rather than publishing over unread slots, and that reads past
+ *        the published slots are counted as empty polls. 
+ */
+static void test_spsc_ring_full_and_empty(void)
+{
+	uint32_t slots[4];
+	struct spsc_ring ring;
+
+	spsc_ring_init(&ring, slots, sizeof(uint32_t), 4);
+	Assert(spsc_ring_read_slot(&ring, 0) == NULL && spsc_ring_nr_empty_polls(&ring) == 1, "read an empty ring");
+	for (uint32_t i = 0; i < 3; ++i) {
+		*(uint32_t *)spsc_ring_write_slot(&ring, 0) = i;
+		Assert(spsc_ring_publish(&ring, 1), "published %u of 3 slots", i);
+	}
+	/* The slot kept free for the producer is never one that's published. */
+	Assert(spsc_ring_write_slot(&ring, 0) != NULL && spsc_ring_write_slot(&ring, 1) == NULL, NULL);
+	Assert(!spsc_ring_publish(&ring, 1) && spsc_ring_nr_overruns(&ring) == 1, "published into a full ring");
+	Assert(*(const uint32_t *)spsc_ring_read_slot(&ring, 2) == 2, NULL);
+	spsc_ring_consume(&ring, 2);
+	Assert(spsc_ring_nr_readable(&ring) == 1 && *(const uint32_t *)spsc_ring_read_slot(&ring, 0) == 2, NULL);
+	/* A hop of 2 slots at once, wrapping around the end. */
+	*(uint32_t *)spsc_ring_write_slot(&ring, 0) = 3;
+	*(uint32_t *)spsc_ring_write_slot(&ring, 1) = 4;
+	Assert(spsc_ring_publish(&ring, 2) && spsc_ring_nr_readable(&ring) == 3, NULL);
+	Assert(*(const uint32_t *)spsc_ring_read_slot(&ring, 2) == 4, NULL);
+	Assert(spsc_ring_read_slot(&ring, 3) == NULL && spsc_ring_nr_empty_polls(&ring) == 2, "read past the published slots");
+	Assert(spsc_ring_nr_overruns(&ring) == 1, "%u overruns", spsc_ring_nr_overruns(&ring));
+}
+
+#define RING_TEST_NR_SLOTS  8
+#define RING_TEST_SLOT_LEN  64
+#define RING_TEST_NR_BLOCKS  200000
+
+static uint32_t ring_test_slots[RING_TEST_NR_SLOTS][RING_TEST_SLOT_LEN];
+static struct spsc_ring ring_test_ring;
+static atomic_bool ring_test_producer_done;
+
+/** 
+ * @brief Stand in for the ADC interrupt: fill each slot with its block number and publish it, without
+ *        waiting for the consumer, so that some blocks overrun.
+ */
+static void *ring_test_producer(void *arg)
+{
+	for (uint32_t block = 0; block < RING_TEST_NR_BLOCKS; ++block) {
+		uint32_t *slot = spsc_ring_write_slot(&ring_test_ring, 0);
+
+		for (int i = 0; i < RING_TEST_SLOT_LEN; ++i)
+			slot[i] = block;
+		spsc_ring_publish(&ring_test_ring, 1);
+	}
+	atomic_store(&ring_test_producer_done, true);
+	return NULL;
+}
+
+/**
+ * @brief Assert a consumer thread reads every block published by a producer thread whole and in order,
+ *        and that the blocks it misses are those counted as overruns.
+ */
+static void test_spsc_ring_threads(void)
+{
+	pthread_t producer;
+	uint32_t nr_consumed = 0, prev_block = 0, nr_torn = 0, nr_out_of_order = 0, nr_empty_polls = 0;
+	const uint32_t *slot;
+	bool done;
+
+	spsc_ring_init(&ring_test_ring, ring_test_slots, sizeof(ring_test_slots[0]), RING_TEST_NR_SLOTS);
+	atomic_store(&ring_test_producer_done, false);
+	pthread_create(&producer, NULL, ring_test_producer, NULL);
+	do {
+		/* Check done before reading so that the last blocks are read after the producer is done. */
+		done = atomic_load(&ring_test_producer_done);
+		while ((slot = spsc_ring_read_slot(&ring_test_ring, 0))) {
+			for (int i = 1; i < RING_TEST_SLOT_LEN; ++i)
+				nr_torn += slot[i] != slot[0];
+			nr_out_of_order += nr_consumed > 0 && slot[0] <= prev_block;
+			prev_block = slot[0];
+			++nr_consumed;
+			spsc_ring_consume(&ring_test_ring, 1);
+		}
+		++nr_empty_polls;
+	} while (!done);
+	pthread_join(producer, NULL);
+
+	Assert(nr_torn == 0 && nr_out_of_order == 0, "%u torn and %u out of order blocks", nr_torn, nr_out_of_order);
+	Assert(nr_consumed+spsc_ring_nr_overruns(&ring_test_ring) == RING_TEST_NR_BLOCKS, 
+	       "consumed %u blocks and %u overran of %u", nr_consumed, spsc_ring_nr_overruns(&ring_test_ring), 
+	       RING_TEST_NR_BLOCKS);
+	/* Only the polls that found the ring empty count, not the reads of the consumed blocks. */
+	Assert(spsc_ring_nr_empty_polls(&ring_test_ring) == nr_empty_polls, "counted %u empty polls of %u", 
+	       spsc_ring_nr_empty_polls(&ring_test_ring), nr_empty_polls);
+}
+
 void assert_bit_array_2d_copy(uint8_t *dest_bit_array, int dest_ncols, int dest_nrows,
 			      uint8_t *src_bit_array, int src_ncols, int src_nrows,
 			      struct write_coord coord,
@@ -168,6 +1229,59 @@ void assert_bit_array_2d_copy(uint8_t *dest_bit_array, int dest_ncols, int dest_
 	Assert(memcmp(dest_bit_array, expected_bit_array, (dest_ncols*dest_nrows)/BITS_IN_BYTE) == 0, NULL);
 }
 
+/** @brief The bit at a time bit_array_2d_copy() that the word-wise one replaced, to test it against. */
+static void bit_array_2d_copy_bitwise(uint8_t *dest_bit_array, int dest_ncols, int dest_nrows,
+				      uint8_t *src_bit_array, int src_ncols, int src_nrows,
+				      struct write_coord coord)
+{
+	for (int i = 0; i < src_nrows; ++i) {
+		for (int j = 0; j < src_ncols; ++j) {
+			bool bit = src_bit_array[i*src_ncols/BITS_IN_BYTE + j/BITS_IN_BYTE] & 
+				   bit_index_to_8bit_bitmask(j%BITS_IN_BYTE);
+			bit_array_2d_set(dest_bit_array, dest_ncols, dest_nrows, coord.row+i, coord.col+j, bit);
+		}
+	}
+}
+
+/** 
+ * @brief Assert bit_array_2d_copy() and bit_array_2d_fill_rect() give the same 2D bit arrays as copying and
+ *        setting a bit at a time, for random sizes and coordinates, including ones clipped on any side.
+ */
+static void test_bit_array_2d_random(void)
+{
+	enum { max_ncols = 64, max_nrows = 24, max_len = max_ncols*max_nrows/BITS_IN_BYTE };
+	uint8_t dest[max_len], expected[max_len], src[max_len];
+	int nr_copy_diffs = 0, nr_fill_diffs = 0;
+
+	srand(3);
+	for (int n = 0; n < 2000; ++n) {
+		const int dest_ncols = BITS_IN_BYTE*(1 + rand()%(max_ncols/BITS_IN_BYTE));
+		const int dest_nrows = 1 + rand()%max_nrows;
+		const int src_ncols = BITS_IN_BYTE*(1 + rand()%(max_ncols/BITS_IN_BYTE));
+		const int src_nrows = 1 + rand()%max_nrows;
+		const struct write_coord coord = { rand()%(2*max_nrows) - max_nrows, rand()%(2*max_ncols) - max_ncols };
+		const int width = rand()%max_ncols, height = rand()%max_nrows;
+		const bool value = rand()%2;
+		const int dest_len = dest_ncols*dest_nrows/BITS_IN_BYTE;
+
+		for (int i = 0; i < dest_len; ++i)
+			dest[i] = expected[i] = rand();
+		for (int i = 0; i < src_ncols*src_nrows/BITS_IN_BYTE; ++i)
+			src[i] = rand();
+		bit_array_2d_copy(dest, dest_ncols, dest_nrows, src, src_ncols, src_nrows, coord);
+		bit_array_2d_copy_bitwise(expected, dest_ncols, dest_nrows, src, src_ncols, src_nrows, coord);
+		nr_copy_diffs += memcmp(dest, expected, dest_len) != 0;
+
+		bit_array_2d_fill_rect(dest, dest_ncols, dest_nrows, coord, width, height, value);
+		for (int i = 0; i < height; ++i) {
+			for (int j = 0; j < width; ++j)
+				bit_array_2d_set(expected, dest_ncols, dest_nrows, coord.row+i, coord.col+j, value);
+		}
+		nr_fill_diffs += memcmp(dest, expected, dest_len) != 0;
+	}
+	Assert(nr_copy_diffs == 0 && nr_fill_diffs == 0, "%d copies and %d fills differed", nr_copy_diffs, nr_fill_diffs);
+}
+
 static void test_bit_array_2d_copy(void)
 {
 	/* 
@@ -197,6 +1311,276 @@ static void test_bit_array_2d_copy(void)
 	);
 }
 
+/** Mock of the I2C transfers to an SSD1306 in horizontal addressing mode, emulating its GDDRAM. */
+struct mock_ssd1306 {
+	uint8_t gddram[GDDRAM_LEN];
+	int first_col, last_col, first_page, last_page;
+	int col, page;
+	/* Bytes on the wire, counting the slave address byte of each transfer. */
+	int nbytes;
+};
+
+static void mock_ssd1306_write(void *priv, const uint8_t *payload, int len)
+{
+	struct mock_ssd1306 *ssd = priv;
+
+	ssd->nbytes += 1+len;
+	if (payload[0] == 0x40) {
+		for (int i = 1; i < len; ++i) {
+			ssd->gddram[ssd->page*GDDRAM_NCOLS + ssd->col] = payload[i];
+			if (++ssd->col > ssd->last_col) {
+				ssd->col = ssd->first_col;
+				if (++ssd->page > ssd->last_page)
+					ssd->page = ssd->first_page;
+			}
+		}
+		return;
+	}
+	for (int i = 1; i < len; i += 3) {
+		if (payload[i] == 0x21) {
+			ssd->col = ssd->first_col = payload[i+1];
+			ssd->last_col = payload[i+2];
+		} else if (payload[i] == 0x22) {
+			ssd->page = ssd->first_page = payload[i+1];
+			ssd->last_page = payload[i+2];
+		}
+	}
+}
+
+/** 
+ * @brief Assert the update of the GDDRAM to the image leaves it equal to the image and took nbytes on the
+ *        wire, or any number of bytes if nbytes is -1.
+ */
+static void assert_gddram_update(struct gddram_shadow *shadow, const uint8_t *image, struct mock_ssd1306 *ssd,
+				 int nbytes, const char *what)
+{
+	const struct gddram_i2c_transport i2c = { .write = mock_ssd1306_write, .priv = ssd };
+
+	ssd->nbytes = 0;
+	gddram_update(shadow, image, &i2c);
+	Assert(memcmp(ssd->gddram, image, GDDRAM_LEN) == 0, "GDDRAM differs from the image after %s", what);
+	Assert(nbytes == -1 || ssd->nbytes == nbytes, "%s took %d bytes but expected %d", what, ssd->nbytes, nbytes);
+}
+
+static void test_gddram_update(void)
+{
+	static struct gddram_shadow shadow;
+	static struct mock_ssd1306 ssd;
+	static uint8_t image[GDDRAM_LEN];
+
+	memset(ssd.gddram, 0xA5, GDDRAM_LEN);
+	gddram_shadow_init(&shadow);
+	/* A page each: the commands setting its range (8 bytes), then its data (2 bytes and the page). */
+	assert_gddram_update(&shadow, image, &ssd, GDDRAM_NPAGES*(8 + 2+GDDRAM_NCOLS), "the first update");
+	assert_gddram_update(&shadow, image, &ssd, 0, "an unchanged image");
+	image[3*GDDRAM_NCOLS + 64] = 0x01;
+	assert_gddram_update(&shadow, image, &ssd, 8 + 2+1, "one changed byte");
+	/* Close changes share a range, far ones don't. */
+	image[3*GDDRAM_NCOLS + 64] = 0;
+	image[3*GDDRAM_NCOLS + 70] = 0xFF;
+	assert_gddram_update(&shadow, image, &ssd, 8 + 2+7, "two close changed bytes");
+	image[3*GDDRAM_NCOLS + 70] = 0;
+	image[3*GDDRAM_NCOLS + 100] = 0xFF;
+	image[5*GDDRAM_NCOLS + 127] = 0x80;
+	assert_gddram_update(&shadow, image, &ssd, 3*(8 + 2+1), "three far changed bytes");
+	/* Random changes, of a few bytes up to about the whole image. */
+	srand(1);
+	for (int i = 0; i < 200; ++i) {
+		for (int j = rand() % (i+1) * GDDRAM_LEN/200; j >= 0; --j)
+			image[rand() % GDDRAM_LEN] = rand();
+		assert_gddram_update(&shadow, image, &ssd, -1, "random changes");
+	}
+}
+
+/**
+ * @brief Assert drawing text and a slider like that of the tuner (see ../mcu/guitar_tuner.c) to a page-major
+ *        image gives the same pixels as drawing them to a row-major 2D bit array, as the GDDRAM MCU side buffer
+ *        was before it was page-major. Both are drawn over the same random background, so that the pixels
+ *        around the text that the copies of the glyphs overwrite or keep are compared too.
+ */
+static void assert_gddram_image_same_as_bit_array_2d(const char *text, struct write_coord coord, int tic_col)
+{
+	const int slider_row = 47, slider_col = 14, slider_len = 101;
+	uint8_t bit_array[GDDRAM_LEN], image[GDDRAM_LEN];
+	uint8_t glyph_pages[FONT_GLYPH_PAGES_LEN];
+	struct write_coord glyph_coord = coord;
+	int nr_diff_pixels = 0;
+
+	for (int i = 0; i < GDDRAM_LEN; ++i)
+		bit_array[i] = rand();
+	gddram_pages_from_bit_array_2d(image, bit_array, GDDRAM_NCOLS, GDDRAM_NPAGES*BITS_IN_BYTE);
+	for (const char *c = text; *c; ++c, glyph_coord.col += FONT_PIXEL_WIDTH) {
+		uint8_t *bitmap = font_get_glyph_bitmap(*c);
+
+		bit_array_2d_copy(bit_array, GDDRAM_NCOLS, GDDRAM_NPAGES*BITS_IN_BYTE, 
+				  bitmap, FONT_PIXEL_WIDTH_PAD, FONT_PIXEL_HEIGHT, glyph_coord);
+		gddram_pages_from_bit_array_2d(glyph_pages, bitmap, FONT_PIXEL_WIDTH_PAD, FONT_PIXEL_HEIGHT);
+		gddram_image_copy(image, glyph_pages, FONT_PIXEL_WIDTH_PAD, FONT_NPAGES, glyph_coord);
+	}
+	/* The lines a pixel at a time in the 2D bit array, and filled a column byte at a time in the image. */
+	for (int j = slider_col; j < slider_col+slider_len; ++j)
+		bit_array_2d_set(bit_array, GDDRAM_NCOLS, GDDRAM_NPAGES*BITS_IN_BYTE, slider_row, j, 1);
+	gddram_image_fill_rect(image, (struct write_coord){slider_row, slider_col}, slider_len, 1, 1);
+	for (int i = slider_row-8; i <= slider_row+8; ++i)
+		bit_array_2d_set(bit_array, GDDRAM_NCOLS, GDDRAM_NPAGES*BITS_IN_BYTE, i, tic_col, 1);
+	gddram_image_fill_rect(image, (struct write_coord){slider_row-8, tic_col}, 1, 17, 1);
+	/* A cleared rectangle across pages. */
+	for (int i = 10; i < 30; ++i) {
+		for (int j = tic_col-3; j < tic_col+3; ++j)
+			bit_array_2d_set(bit_array, GDDRAM_NCOLS, GDDRAM_NPAGES*BITS_IN_BYTE, i, j, 0);
+	}
+	gddram_image_fill_rect(image, (struct write_coord){10, tic_col-3}, 6, 20, 0);
+
+	for (int i = 0; i < GDDRAM_NPAGES*BITS_IN_BYTE; ++i) {
+		for (int j = 0; j < GDDRAM_NCOLS; ++j) {
+			bool row_major = bit_array[i*GDDRAM_NCOLS/BITS_IN_BYTE + j/BITS_IN_BYTE] & 
+					 bit_index_to_8bit_bitmask(j%BITS_IN_BYTE);
+			bool page_major = image[(i/BITS_IN_BYTE)*GDDRAM_NCOLS + j] & 1<<(i%BITS_IN_BYTE);
+
+			nr_diff_pixels += row_major != page_major;
+		}
+	}
+	Assert(nr_diff_pixels == 0, "\"%s\" at (%d, %d) with the tic at %d differed in %d pixels", 
+	       text, coord.row, coord.col, tic_col, nr_diff_pixels);
+}
+
+static void test_gddram_image(void)
+{
+	srand(2);
+	assert_gddram_image_same_as_bit_array_2d("A2", (struct write_coord){0, 35}, 64);
+	assert_gddram_image_same_as_bit_array_2d("C#3", (struct write_coord){0, 20}, 14);
+	assert_gddram_image_same_as_bit_array_2d("?", (struct write_coord){0, 50}, 114);
+	/* Rows not at the top of a page, and text and tics partly off the display. */
+	assert_gddram_image_same_as_bit_array_2d("G#4", (struct write_coord){5, 30}, 0);
+	assert_gddram_image_same_as_bit_array_2d("B7", (struct write_coord){-13, -10}, -1);
+	assert_gddram_image_same_as_bit_array_2d("F#6", (struct write_coord){43, 80}, 127);
+	assert_gddram_image_same_as_bit_array_2d("DE01", (struct write_coord){-31, 5}, 128);
+}
+
+#define FILE_SOURCE_TEST_FRAME_LEN  FRAME_LEN_32
+#define FILE_SOURCE_TEST_HOP_LEN  (FILE_SOURCE_TEST_FRAME_LEN/2)
+#define FILE_SOURCE_TEST_FIRST_SAMPLE  5
+
+static int nr_first_frames, nr_second_frames;
+
+/** @brief Assert the frame is a view of the ramp at the hop of the file source given by its label. */
+static bool assert_ramp_frame(const char *label, int i, const int16_t *samples, enum frame_length frame_len)
+{
+	const bool first = strcmp(label, "first") == 0;
+	const int start = (first ? FILE_SOURCE_TEST_FIRST_SAMPLE : 0) + (i-1)*FILE_SOURCE_TEST_HOP_LEN*OVERSAMPLING_FACTOR;
+	int mismatch = -1;
+
+	for (int j = 0; j < frame_len*OVERSAMPLING_FACTOR && mismatch == -1; ++j) {
+		if (samples[j] != start+j)
+			mismatch = j;
+	}
+	Assert(mismatch == -1, "file source %s, frame %d, sample %d differs from the ramp starting at %d", label, i, 
+	       mismatch, start);
+	if (first)
+		++nr_first_frames;
+	else
+		++nr_second_frames;
+	return true;
+}
+
+/** 
+ * @brief Assert overlapping frames of a file source are views into its mapping, whether opened or listed in an
+ *        index, and that only whole frames are processed.
+ */
+static void test_file_source(void)
+{
+	const int oversize_frame_len = FILE_SOURCE_TEST_FRAME_LEN*OVERSAMPLING_FACTOR;
+	/* 3 frames and a partial frame. */
+	const int nr_samples = 3*oversize_frame_len + 5;
+	char dir[] = "/tmp/file-source-XXXXXX";
+	char raw_pathname[64], index_pathname[64];
+	struct file_source src;
+	bool opened;
+	FILE *file;
+
+	if (!mkdtemp(dir)) {
+		Assert(false, "making temporary dir for file sources");
+		return;
+	}
+	snprintf(raw_pathname, sizeof(raw_pathname), "%s/ramp.raw", dir);
+	snprintf(index_pathname, sizeof(index_pathname), "%s/index", dir);
+	file = fopen(raw_pathname, "wb");
+	for (int16_t k = 0; k < nr_samples; ++k)
+		fwrite(&k, sizeof(k), 1, file);
+	fclose(file);
+	file = fopen(index_pathname, "w");
+	fprintf(file, "# file, first sample, number of samples, label\n\nramp.raw %d %d first\nramp.raw 0 0 second\n", 
+		FILE_SOURCE_TEST_FIRST_SAMPLE, 2*oversize_frame_len);
+	fclose(file);
+
+	opened = file_source_open(&src, raw_pathname, 0, 0, NULL);
+	Assert(opened, "opening %s", raw_pathname);
+	if (opened) {
+		Assert(strcmp(src.label, "ramp") == 0 && src.nr_samples == nr_samples, "label %s, %d samples", src.label, 
+		       src.nr_samples);
+		Assert(file_source_nr_frames(&src, FILE_SOURCE_TEST_FRAME_LEN, FILE_SOURCE_TEST_FRAME_LEN) == 3, NULL);
+		Assert(file_source_nr_frames(&src, FILE_SOURCE_TEST_FRAME_LEN, FILE_SOURCE_TEST_HOP_LEN) == 5, NULL);
+		Assert(file_source_frame(&src, 3, FILE_SOURCE_TEST_HOP_LEN) == 
+		       src.samples + 3*FILE_SOURCE_TEST_HOP_LEN*OVERSAMPLING_FACTOR, "frame isn't a view of the file");
+		file_source_close(&src);
+	}
+	Assert(!file_source_open(&src, raw_pathname, nr_samples, 1, NULL), "opened samples past the end of the file");
+
+	Assert(for_each_indexed_file_source(index_pathname, FILE_SOURCE_TEST_FRAME_LEN, FILE_SOURCE_TEST_HOP_LEN, 
+					    assert_ramp_frame), "processing index %s", index_pathname);
+	Assert(nr_first_frames == 3 && nr_second_frames == 5, "processed %d and %d frames but expected 3 and 5", 
+	       nr_first_frames, nr_second_frames);
+
+	remove(raw_pathname);
+	remove(index_pathname);
+	rmdir(dir);
+}
+
+/**
+ * @brief Assert the gain of a sine wave through a half-band decimator is within [min_gain, max_gain].
+ * @param normalised_freq Frequency of the sine wave as a fraction of the sampling rate of the samples
+ *	  going into the half-band decimator.
+ */
+static void assert_halfband_decimate_sine_gain(float32_t normalised_freq, float32_t min_gain, float32_t max_gain)
+{
+	enum { nsamples = 2048 };
+	/* Half the signed 16-bit range, which the samples are in for both the float and fixed-point versions. */
+	const float32_t amplitude = 16384;
+	static sample_t state[HALFBAND_DECIMATOR_STATE_LEN(nsamples)];
+	static sample_t samples[nsamples];
+	struct halfband_decimator hbd;
+	float64_t mean_square = 0;
+	float32_t gain;
+	int n = 0;
+
+	for (int i = 0; i < nsamples; ++i)
+		samples[i] = amplitude*sinf(2*PI*normalised_freq*i);
+	halfband_decimator_init(&hbd, state);
+	/* Decimate in place, which decimate() relies on. */
+	halfband_decimate(&hbd, samples, samples, nsamples);
+	/* Skip the decimated samples that were filtered from the zeroed initial state. */
+	for (int i = HALFBAND_NR_TAPS; i < nsamples/2; ++i, ++n) 
+		mean_square += (float64_t)samples[i]*samples[i];
+	mean_square /= n;
+	/* The mean square of a sine wave of amplitude A is A^2/2. */
+	gain = sqrt(2*mean_square)/amplitude;
+
+	Assert(gain >= min_gain && gain <= max_gain, "sine at %.4f of the sampling rate had gain %f but expected gain "
+						     "in range [%f, %f]", normalised_freq, gain, min_gain, max_gain);
+}
+
+static void test_halfband_decimate(void)
+{
+	/* 
+	 * Pass-band, up to a quarter of the sampling rate of the last half-band stage, which is 
+	 * the Nyquist frequency of the SAMPLING_RATE after the last (band-pass) stage. 
+	 */
+	assert_halfband_decimate_sine_gain(0.0625, 0.99, 1.01);
+	assert_halfband_decimate_sine_gain(0.125, 0.98, 1.02);
+	/* Stop-band, which would alias into the pass-band after decimation. */
+	assert_halfband_decimate_sine_gain(0.375, 0, 0.01);
+	assert_halfband_decimate_sine_gain(0.45, 0, 0.01);
+}
 
 static struct anti_alias_sine {
 	float32_t frequency;
@@ -237,7 +1621,7 @@ static struct anti_alias_sine *anti_alias_sine_lookup_by_freq(float32_t frequenc
 static bool get_anti_alias_sine_mag(const char *sine_freq_str, int i, const int16_t *samples, enum frame_length frame_len)
 {
 	float32_t sine_freq;
-	float32_t *freq_bin_magnitudes;
+	magnitude_t *freq_bin_magnitudes;
 	int max_bin_ind;
 	struct anti_alias_sine *sine;
 
@@ -249,7 +1633,7 @@ static bool get_anti_alias_sine_mag(const char *sine_freq_str, int i, const int1
 			samples_to_freq_bin_magnitudes_init(frame_len);
 		freq_bin_magnitudes = samples_to_freq_bin_magnitudes_s16(samples, frame_len);
 		max_bin_ind = max_bin_index(freq_bin_magnitudes, frame_len);
-		sine->max_magnitude = freq_bin_magnitudes[max_bin_ind];
+		sine->max_magnitude = magnitude_to_float(freq_bin_magnitudes[max_bin_ind], frame_len);
 	}
 	return true;
 }
@@ -286,12 +1670,37 @@ static void test_sine_wave_anti_alias(void)
 
 int main(void)
 {
-	for_each_file_source(SINE_FILES_DIR "/freq-to-bin-index", FRAME_LEN_4096, assert_sine_wave_freq_to_bin_index);
+	for_each_file_source_parallel(SINE_FILES_DIR "/freq-to-bin-index", FRAME_LEN_4096, 0, 
+				      assert_sine_wave_freq_to_bin_index);
+	for_each_file_source_parallel(SINE_FILES_DIR "/freq-to-bin-index", FRAME_LEN_4096, 0, 
+				      assert_sine_wave_interpolate_peak_freq);
 	test_hps_find_harmonic_peaks();
-	for_each_file_source(NOTE_FILES_DIR, FRAME_LEN_4096, assert_hps);
+	for_each_file_source_parallel(NOTE_FILES_DIR, FRAME_LEN_4096, 0, assert_hps);
+	for_each_file_source(NOTE_FILES_DIR, FRAME_LEN_4096, assert_hop_hps);
+	for_each_file_source(NOTE_FILES_DIR, FRAME_LEN_4096, assert_pruned_hps);
+	for_each_file_source(NOTE_FILES_DIR, FRAME_LEN_4096, assert_energy_gate);
+	test_frame_lengths();
+	test_pitch_detectors();
+	test_dsp_ctxs_independent();
+	test_for_each_file_source_parallel();
+	test_onset_time_to_correct_note();
+	test_onset_first_reading_cents();
+	test_note_tracker();
 	test_cents_difference();
 	test_convert_adc_u12_sample_to_s16();
+	test_convert_adc_u12_sample_to_q15();
+	test_convert_adc_u12_samples();
+	test_synth_pluck();
+	test_synth_high_plucks();
+	test_pareto_frontier();
+	test_spsc_ring_full_and_empty();
+	test_spsc_ring_threads();
 	test_bit_array_2d_copy();
+	test_bit_array_2d_random();
+	test_gddram_update();
+	test_gddram_image();
+	test_file_source();
+	test_halfband_decimate();
 	test_sine_wave_anti_alias();
 
 	return !print_asserts_summary();
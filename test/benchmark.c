@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Benchmark finishing a hop (FFT and frequency bin magnitudes) and then its HPS and max peak over all 
+ * the bins against over only the bins that can matter (see hps_magnitude_bin_range()), on the note files.
+ * Also benchmark a refresh of the narrowband note tracker (see track.h) locked onto the HPS max peak, and
+ * the batched conversion of the raw ADC samples of a hop (see adc.h).
+ */
+#include <stdio.h>
+#include <time.h>
+#include "file_source.h"
+#include "dsp_indirect.h"
+#include "track.h"
+#include "adc.h"
+
+#define HOPS_IN_FRAME 4
+
+enum finish_variant {
+	ALL_BINS,
+	PRUNED,
+	PRUNED_APPROXIMATE,
+	NR_FINISH_VARIANTS
+};
+
+static const char *finish_variant_names[NR_FINISH_VARIANTS] = {
+	[ALL_BINS] = "all bins",
+	[PRUNED] = "pruned",
+	[PRUNED_APPROXIMATE] = "pruned, approximate mags"
+};
+
+/* Time spent in the finish, and in the HPS and max peak, of each variant. */
+static double finish_secs[NR_FINISH_VARIANTS], hps_secs[NR_FINISH_VARIANTS];
+static double track_secs, convert_secs;
+static int nr_hops;
+static struct note_tracker note_tracker;
+static struct adc_converter adc_converter;
+
+static double now_secs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+/** @brief Finish the pushed hop and get the bin index of the HPS max peak, timing each step. */
+static int finish_hop(enum finish_variant variant, enum frame_length frame_len)
+{
+	const struct bin_range range = hps_magnitude_bin_range(frame_len, SAMPLING_RATE, NHARMONICS);
+	const struct bin_range candidates = hps_candidate_bin_range(frame_len, SAMPLING_RATE, NHARMONICS);
+	magnitude_t *freq_bin_magnitudes;
+	double start = now_secs(), finished;
+	int max_bin_ind;
+
+	if (variant == ALL_BINS)
+		freq_bin_magnitudes = hop_samples_to_freq_bin_magnitudes_finish(frame_len);
+	else
+		freq_bin_magnitudes = hop_samples_to_freq_bin_magnitudes_range_finish(frame_len, range, 
+										      variant == PRUNED_APPROXIMATE);
+	finished = now_secs();
+	harmonic_product_spectrum(freq_bin_magnitudes, frame_len, SAMPLING_RATE, NHARMONICS);
+	if (variant == ALL_BINS)
+		max_bin_ind = max_bin_index(freq_bin_magnitudes, frame_len);
+	else
+		max_bin_ind = max_bin_index_in_range(freq_bin_magnitudes, candidates);
+	finish_secs[variant] += finished-start;
+	hps_secs[variant] += now_secs()-finished;
+	return max_bin_ind;
+}
+
+/** @brief Time the batched conversion of the hop of samples as if read raw from the ADC. */
+static void convert_hop(const int16_t *samples, int len)
+{
+	static uint16_t u12_samples[OVERSAMPLING_FACTOR*MAX_FRAME_LEN];
+	static sample_t converted_samples[OVERSAMPLING_FACTOR*MAX_FRAME_LEN];
+	double start;
+
+	for (int i = 0; i < len; ++i)
+		u12_samples[i] = (samples[i] >> 4)+2048;
+	start = now_secs();
+	convert_adc_u12_samples(&adc_converter, u12_samples, converted_samples, len);
+	convert_secs += now_secs()-start;
+}
+
+/** @brief Lock the tracker onto the frequency and time a refresh of it on the pushed hop. */
+static void track_hop(float32_t frequency)
+{
+	double start;
+
+	note_tracker_unlock(&note_tracker);
+	for (int i = 0; i < TRACK_LOCK_READINGS; ++i)
+		note_tracker_lock(&note_tracker, frequency);
+	if (!note_tracker.note)
+		return;
+	start = now_secs();
+	note_tracker_track(&note_tracker);
+	track_secs += now_secs()-start;
+}
+
+static bool benchmark_hops(const char *note_name, int i, const int16_t *samples, enum frame_length frame_len)
+{
+	const int hop_len = frame_len/HOPS_IN_FRAME;
+	int max_bin_ind = 0;
+
+	if (i == 1) {
+		hop_samples_to_freq_bin_magnitudes_init(frame_len, hop_len);
+		note_tracker_init(&note_tracker, dsp_default_ctx(), hop_len*OVERSAMPLING_FACTOR);
+		adc_converter_init(&adc_converter);
+	}
+	for (int j = 0; j < HOPS_IN_FRAME; ++j) {
+		convert_hop(samples, hop_len*OVERSAMPLING_FACTOR);
+		hop_samples_push_s16(samples, frame_len, hop_len);
+		samples += hop_len*OVERSAMPLING_FACTOR;
+		/* Finishing doesn't change the frame, so each variant finishes the same hop. */
+		for (enum finish_variant variant = 0; variant < NR_FINISH_VARIANTS; ++variant)
+			max_bin_ind = finish_hop(variant, frame_len);
+		track_hop(bin_index_to_freq(max_bin_ind, bin_width(frame_len, SAMPLING_RATE)));
+		++nr_hops;
+	}
+	return true;
+}
+
+int main(void)
+{
+	const struct bin_range range = hps_magnitude_bin_range(FRAME_LEN_4096, SAMPLING_RATE, NHARMONICS);
+	const struct bin_range candidates = hps_candidate_bin_range(FRAME_LEN_4096, SAMPLING_RATE, NHARMONICS);
+
+	if (!for_each_file_source(NOTE_FILES_DIR, FRAME_LEN_4096, benchmark_hops))
+		return 1;
+	printf("frame len %d, %d hops, mags of %d of %d bins, %d candidate fundamentals\n", FRAME_LEN_4096, nr_hops, 
+	       range.end-range.first, nr_bins(FRAME_LEN_4096), candidates.end-candidates.first);
+	printf("%-26s %22s %22s\n", "us per hop", "finish", "HPS and max peak");
+	for (enum finish_variant variant = 0; variant < NR_FINISH_VARIANTS; ++variant) {
+		printf("%-26s %12.2f (%5.2fx) %12.2f (%5.2fx)\n", finish_variant_names[variant], 
+		       finish_secs[variant]/nr_hops*1e6, finish_secs[ALL_BINS]/finish_secs[variant],
+		       hps_secs[variant]/nr_hops*1e6, hps_secs[ALL_BINS]/hps_secs[variant]);
+	}
+	printf("%-26s %12.2f (%5.2fx of all bins finish, HPS and max peak)\n", "track refresh", 
+	       track_secs/nr_hops*1e6, (finish_secs[ALL_BINS]+hps_secs[ALL_BINS])/track_secs);
+	printf("%-26s %12.2f\n", "raw ADC hop conversion", convert_secs/nr_hops*1e6);
+	return 0;
+}
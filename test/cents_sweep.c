@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Sweep of the accuracy of the whole pipeline over synthesised plucks (see synth.h) of every note of
+ * note_freqs, each detuned by a range of cents. Each pluck is read as raw 12-bit ADC samples by the same
+ * processing as ../mcu/guitar_tuner.c (see tuner.h): batched ADC conversion, the pitch detector streamed
+ * a block at a time, hops restarted at onsets, the energy gate, and the note tracker once locked.
+ *
+ * The readings (what would be displayed) of each pluck are checked against its true frequency, and a line
+ * of CSV output per pluck, to compare the accuracy before and after a change to the pipeline.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <unistd.h>
+#include "tuner.h"
+#include "note.h"
+#include "synth.h"
+
+/*
+ * Noise before each pluck to calibrate the energy gate on, with the pluck landing part way through a hop
+ * rather than on a hop boundary.
+ */
+#define NR_SILENT_SAMPLES  ((GATE_CALIBRATION_HOPS+1)*TUNER_OVER_HOP_LEN + TUNER_OVER_HOP_LEN/3)
+
+/* The lowest and highest notes of the file sources, see ../core/note.c:note_freqs. */
+#define TESTED_LOWEST_NOTE  "A1"
+#define TESTED_HIGHEST_NOTE  "F#4"
+
+struct sweep_result {
+	/*
+	 * Number of readings after the pluck, and of those the readings of the note, of the same note in
+	 * another octave, and of any other note.
+	 */
+	int nr_readings;
+	int nr_correct;
+	int nr_octave_errors;
+	int nr_other_errors;
+	/* Cents of the correct readings off the true frequency. */
+	float64_t sum_abs_cents_error;
+	float32_t max_abs_cents_error;
+	/* Seconds from the pluck to the end of the block of the first correct reading, or -1 if none. */
+	float32_t secs_to_lock;
+};
+
+/** @brief Check a reading of the pluck made at the end of the block ending at sample i. */
+static void check_reading(struct sweep_result *result, float32_t frequency, const struct pluck *pluck,
+			  struct note_freq *note, int i)
+{
+	const float32_t cents = 1200*log2f(frequency/pluck->frequency);
+	const float32_t octaves = roundf(cents/1200);
+
+	/* Readings of the noise before the pluck aren't of it. */
+	if (i <= NR_SILENT_SAMPLES)
+		return;
+	++result->nr_readings;
+	if (nearest_note(frequency) == note) {
+		++result->nr_correct;
+		result->sum_abs_cents_error += fabsf(cents);
+		result->max_abs_cents_error = fmaxf(result->max_abs_cents_error, fabsf(cents));
+		if (result->secs_to_lock < 0)
+			result->secs_to_lock = (float32_t)(i-NR_SILENT_SAMPLES)/OVERSAMPLING_RATE;
+	} else if (octaves != 0 && fabsf(cents - 1200*octaves) < CENTS_IN_HALF_SEMITONE) {
+		++result->nr_octave_errors;
+	} else {
+		++result->nr_other_errors;
+	}
+}
+
+/** @brief Read the raw 12-bit samples of the pluck of the note as the tuner would. */
+static void sweep_pluck(struct sweep_result *result, const uint16_t *u12_samples, int nr_samples,
+			const struct pluck *pluck, struct note_freq *note)
+{
+	static struct tuner tuner;
+	float32_t frequency;
+
+	memset(result, 0, sizeof(*result));
+	result->secs_to_lock = -1;
+	tuner_init(&tuner);
+	for (int i = 0; i+TUNER_BLOCK_LEN <= nr_samples; i += TUNER_BLOCK_LEN) {
+		if (tuner_push_block(&tuner, u12_samples+i, &frequency) && frequency)
+			check_reading(result, frequency, pluck, note, i+TUNER_BLOCK_LEN);
+	}
+}
+
+static struct note_freq *find_note(const char *note_name)
+{
+	for (struct note_freq *nf = note_freqs; nf->note_name; ++nf) {
+		if (strcasecmp(nf->note_name, note_name) == 0)
+			return nf;
+	}
+	return NULL;
+}
+
+/* Totals of the sweep results of a range of notes. */
+struct sweep_summary {
+	int nr_plucks;
+	int nr_locked_plucks;
+	int nr_readings;
+	int nr_correct;
+	int nr_octave_errors;
+	float64_t sum_abs_cents_error;
+	float32_t max_abs_cents_error;
+	float64_t sum_secs_to_lock;
+};
+
+static void summarise(struct sweep_summary *summary, const struct sweep_result *result)
+{
+	++summary->nr_plucks;
+	summary->nr_readings += result->nr_readings;
+	summary->nr_correct += result->nr_correct;
+	summary->nr_octave_errors += result->nr_octave_errors;
+	summary->sum_abs_cents_error += result->sum_abs_cents_error;
+	summary->max_abs_cents_error = fmaxf(summary->max_abs_cents_error, result->max_abs_cents_error);
+	if (result->secs_to_lock >= 0) {
+		++summary->nr_locked_plucks;
+		summary->sum_secs_to_lock += result->secs_to_lock;
+	}
+}
+
+static void print_summary(const char *name, const struct sweep_summary *summary)
+{
+	fprintf(stderr, "%-10s %4d of %4d plucks locked, mean %.3f s, %5.1f%% of readings correct, %d octave errors, "
+			"mean |cents| %.2f, max %.2f\n", name, summary->nr_locked_plucks, summary->nr_plucks,
+		summary->nr_locked_plucks ? summary->sum_secs_to_lock/summary->nr_locked_plucks : 0,
+		summary->nr_readings ? 100.0*summary->nr_correct/summary->nr_readings : 0, summary->nr_octave_errors,
+		summary->nr_correct ? summary->sum_abs_cents_error/summary->nr_correct : 0,
+		summary->max_abs_cents_error);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-n <lowest note>:<highest note>] [-c <max cents>] [-s <cents step>] [-t <secs>]\n"
+			"  -n  Notes to sweep, C0:B6 by default.\n"
+			"  -c  Detune each note from -max to +max cents, 45 by default.\n"
+			"  -s  Step of the detuning, 15 cents by default.\n"
+			"  -t  Seconds of each pluck, 3 by default.\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	struct note_freq *lowest = note_freqs, *highest = NULL;
+	struct note_freq *tested_lowest = find_note(TESTED_LOWEST_NOTE);
+	struct note_freq *tested_highest = find_note(TESTED_HIGHEST_NOTE);
+	struct sweep_summary all = { 0 }, tested = { 0 };
+	float32_t max_cents = 45, cents_step = 15, pluck_secs = 3;
+	char lowest_name[8], highest_name[8];
+	uint16_t *u12_samples;
+	int nr_samples;
+	int opt;
+
+	for (highest = note_freqs; (highest+1)->note_name; ++highest)
+		;
+	while ((opt = getopt(argc, argv, "n:c:s:t:")) != -1) {
+		switch (opt) {
+		case 'n':
+			if (sscanf(optarg, "%7[^:]:%7s", lowest_name, highest_name) != 2 ||
+			    !(lowest = find_note(lowest_name)) || !(highest = find_note(highest_name)) || lowest > highest) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'c':
+			max_cents = atof(optarg);
+			break;
+		case 's':
+			cents_step = atof(optarg);
+			break;
+		case 't':
+			pluck_secs = atof(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (max_cents < 0 || max_cents >= CENTS_IN_HALF_SEMITONE || cents_step <= 0 || pluck_secs <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+	nr_samples = NR_SILENT_SAMPLES + pluck_secs*OVERSAMPLING_RATE;
+	u12_samples = malloc(nr_samples*sizeof(uint16_t));
+	if (!u12_samples) {
+		perror("Error allocating memory for samples");
+		return 1;
+	}
+
+	printf("note,detune_cents,frequency_hz,readings,correct,octave_errors,other_errors,"
+	       "mean_abs_cents_error,max_abs_cents_error,secs_to_lock\n");
+	for (struct note_freq *note = lowest; note <= highest; ++note) {
+		for (float32_t cents = -max_cents; cents <= max_cents + cents_step/2; cents += cents_step) {
+			struct pluck pluck = {
+				.frequency = detune(note->frequency, cents),
+				.amplitude = 0.5,
+				.nr_harmonics = 12,
+				.decay_secs = 1.5,
+				.inharmonicity = 1e-4,
+				.pluck_position = 0.2,
+				.noise_rms = 2,
+				.dc_offset = 37,
+				/* A pluck of its own per note and detuning, the same every run. */
+				.seed = (note-note_freqs+1)*7919 + (int)roundf(cents+CENTS_IN_HALF_SEMITONE),
+			};
+			struct sweep_result result;
+
+			synth_pluck_u12(&pluck, u12_samples, nr_samples, NR_SILENT_SAMPLES, OVERSAMPLING_RATE);
+			sweep_pluck(&result, u12_samples, nr_samples, &pluck, note);
+			printf("%s,%.1f,%.3f,%d,%d,%d,%d,%.3f,%.3f,%.3f\n", note->note_name, cents, pluck.frequency,
+			       result.nr_readings, result.nr_correct, result.nr_octave_errors, result.nr_other_errors,
+			       result.nr_correct ? result.sum_abs_cents_error/result.nr_correct : 0,
+			       result.max_abs_cents_error, result.secs_to_lock);
+			summarise(&all, &result);
+			if (note >= tested_lowest && note <= tested_highest)
+				summarise(&tested, &result);
+		}
+	}
+	print_summary("all", &all);
+	print_summary(TESTED_LOWEST_NOTE "-" TESTED_HIGHEST_NOTE, &tested);
+	free(u12_samples);
+	return 0;
+}
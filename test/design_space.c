@@ -0,0 +1,586 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Explorer of the design space of the DSP parameters: for each configuration, its cost in processing time
+ * and RAM against its latency and accuracy, and which configurations are on the Pareto frontier of these,
+ * to pick the parameters for a budget of latency, power (processing time) and RAM from data.
+ *
+ * The frame length, hops in a frame and number of harmonics of HPS are selected at run time, so a run
+ * sweeps all their combinations. The number of taps, sampling rate and oversampling factor are compile-time
+ * (see ../core/dsp_params.mk), so a run only measures those it was built with, and the design-space target
+ * of the Makefile rebuilds it for each of a list of them then merges the CSV output of the runs with -m.
+ *
+ * Each configuration runs the hps_pitch_detector on a context of its own over synthesised plucks (see
+ * synth.h) of the notes of the file sources, detuned, and over the note file sources themselves if they
+ * were recorded at the build's OVERSAMPLING_RATE. Unlike cents_sweep.c there is no energy gate or note
+ * tracker: each hop is a reading, so that the pitch detector itself is measured.
+ */
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "adc.h"
+#include "dsp.h"
+#include "pitch.h"
+#include "tuner.h"
+#include "note.h"
+#include "synth.h"
+#include "pareto.h"
+#include "file_source.h"
+
+/* Those of the tuner (see tuner.h), the block shortened to the oversized hop when longer than it. */
+#define BLOCK_LEN  TUNER_BLOCK_LEN
+#define NR_RING_HOPS  TUNER_NR_RING_HOPS
+/* See data/note/README.md. */
+#define NOTE_FILES_OVERSAMPLING_RATE  8000
+#define MAX_NR_FRAME_LENS  8
+#define MAX_NR_HOPS_IN_FRAMES  8
+#define MAX_LINE_LEN  256
+
+/* The lowest and highest notes of the file sources, see ../core/note.c:note_freqs. */
+#define TESTED_LOWEST_NOTE  "A1"
+#define TESTED_HIGHEST_NOTE  "F#4"
+
+/* A run of samples of a note, either a synthesised pluck or a note file source. */
+struct note_source {
+	sample_t *samples;
+	int nr_samples;
+	struct note_freq *note;
+	/* True frequency of a pluck, in Hz, or 0 for a file source, which is only tuned relative to standard. */
+	float32_t frequency;
+	/* Samples of noise before a pluck. */
+	int nr_silent_samples;
+};
+
+struct design_point {
+	/* Compile-time parameters. */
+	int nr_taps;
+	int sampling_rate;
+	int oversampling_factor;
+	int fixed_point;
+	/* Run-time parameters. */
+	int frame_len;
+	int hop_len;
+	int nharmonics;
+	/* Costs. RAM is that of the context and the ADC samples of ../mcu/guitar_tuner.c. */
+	long ram_bytes;
+	float64_t host_us_per_sec;  /* Of processing per second of samples, on the host. */
+	/* Mean seconds from a pluck to the end of the hop of its first correct reading, of the plucks read. */
+	float64_t secs_to_lock;
+	/* Fractions of the readings after a pluck, and of those of the whole frames of a file source, correct. */
+	float64_t detection_rate;
+	float64_t corpus_detection_rate;  /* NAN if the file sources weren't recorded at this rate. */
+	/* Mean cents of the correct readings of the plucks off their true frequency. */
+	float64_t mean_abs_cents_error;
+	bool pareto;
+};
+
+/*
+ * The objectives of the frontier, all minimised: RAM, processing time, latency, misdetections of the plucks
+ * and of the file sources, and cents off. The file sources are NAN in builds that don't run them, so left out
+ * of comparing those builds with the others rather than counted as the worst.
+ */
+#define NR_OBJECTIVES  6
+
+static void design_point_objectives(const struct design_point *point, float64_t *objectives)
+{
+	objectives[0] = point->ram_bytes;
+	objectives[1] = point->host_us_per_sec;
+	objectives[2] = point->secs_to_lock;
+	objectives[3] = -point->detection_rate;
+	objectives[4] = -point->corpus_detection_rate;
+	objectives[5] = point->mean_abs_cents_error;
+}
+
+/** @brief Get the CPU time of the process, which unlike the wall time doesn't count time it isn't scheduled. */
+static double cpu_secs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+static struct note_freq *find_note(const char *note_name)
+{
+	for (struct note_freq *nf = note_freqs; nf->note_name; ++nf) {
+		if (strcasecmp(nf->note_name, note_name) == 0)
+			return nf;
+	}
+	return NULL;
+}
+
+/** @brief Synthesise and convert plucks of the notes from lowest to highest, each detuned from -max_cents to max_cents. */
+static struct note_source *synth_plucks(struct note_freq *lowest, struct note_freq *highest, float32_t max_cents,
+					float32_t cents_step, float32_t pluck_secs, int *nr_plucks)
+{
+	/* Enough noise for the DC offset estimate of the ADC conversion to settle, not a whole number of blocks. */
+	const int nr_silent_samples = OVERSAMPLING_RATE/2 + BLOCK_LEN/3;
+	const int nr_samples = nr_silent_samples + pluck_secs*OVERSAMPLING_RATE;
+	const int nr_detunings = floorf((2*max_cents + cents_step/2)/cents_step) + 1;
+	struct note_source *plucks = calloc((highest-lowest+1)*nr_detunings, sizeof(struct note_source));
+	uint16_t *u12_samples = malloc(nr_samples*sizeof(uint16_t));
+	int n = 0;
+
+	if (!plucks || !u12_samples)
+		goto err;
+	for (struct note_freq *note = lowest; note <= highest; ++note) {
+		for (int d = 0; d < nr_detunings; ++d) {
+			const float32_t cents = -max_cents + d*cents_step;
+			struct pluck pluck = {
+				.frequency = detune(note->frequency, cents),
+				.amplitude = 0.5,
+				.nr_harmonics = 12,
+				.decay_secs = 1.5,
+				.inharmonicity = 1e-4,
+				.pluck_position = 0.2,
+				.noise_rms = 2,
+				.dc_offset = 37,
+				.seed = (note-note_freqs+1)*7919 + d,
+			};
+			struct adc_converter adc_converter;
+			struct note_source *src = plucks+n;
+
+			src->samples = malloc(nr_samples*sizeof(sample_t));
+			if (!src->samples)
+				goto err;
+			++n;
+			synth_pluck_u12(&pluck, u12_samples, nr_samples, nr_silent_samples, OVERSAMPLING_RATE);
+			adc_converter_init(&adc_converter);
+			convert_adc_u12_samples(&adc_converter, u12_samples, src->samples, nr_samples);
+			src->nr_samples = nr_samples;
+			src->note = note;
+			src->frequency = pluck.frequency;
+			src->nr_silent_samples = nr_silent_samples;
+		}
+	}
+	free(u12_samples);
+	*nr_plucks = n;
+	return plucks;
+err:
+	perror("Error allocating memory for plucks");
+	for (int i = 0; i < n; ++i)
+		free(plucks[i].samples);
+	free(plucks);
+	free(u12_samples);
+	return NULL;
+}
+
+static int filter_raw(const struct dirent *dirent)
+{
+	const char *ext = strrchr(dirent->d_name, '.');
+
+	return ext && strcmp(ext, ".raw") == 0;
+}
+
+/**
+ * @brief Read and convert the note file sources.
+ * @return The file sources, none if they weren't recorded at the OVERSAMPLING_RATE, or NULL on error.
+ */
+static struct note_source *read_note_files(int *nr_files)
+{
+	struct dirent **dirents;
+	struct note_source *files;
+	int n;
+
+	*nr_files = 0;
+	if (OVERSAMPLING_RATE != NOTE_FILES_OVERSAMPLING_RATE) {
+		fprintf(stderr, "Skipping the note file sources, recorded at %d Hz rather than %d Hz\n",
+			NOTE_FILES_OVERSAMPLING_RATE, OVERSAMPLING_RATE);
+		return calloc(1, sizeof(struct note_source));
+	}
+	n = scandir(NOTE_FILES_DIR, &dirents, filter_raw, alphasort);
+	if (n == -1) {
+		fprintf(stderr, "Error reading directory %s: %s\n", NOTE_FILES_DIR, strerror(errno));
+		return NULL;
+	}
+	files = calloc(n ? n : 1, sizeof(struct note_source));
+	for (int i = 0; i < n; ++i) {
+		char pathname[sizeof(NOTE_FILES_DIR) + 1 + sizeof(dirents[i]->d_name)];
+		struct note_source *dst = files ? files+*nr_files : NULL;
+		struct file_source src;
+
+		sprintf(pathname, "%s/%s", NOTE_FILES_DIR, dirents[i]->d_name);
+		free(dirents[i]);
+		if (!dst || !file_source_open(&src, pathname, 0, 0, NULL))
+			continue;
+		dst->note = find_note(src.label);
+		dst->samples = malloc(src.nr_samples*sizeof(sample_t));
+		if (dst->note && dst->samples) {
+			/* The samples of the fixed-point version are q15 of the same value. */
+			for (int k = 0; k < src.nr_samples; ++k)
+				dst->samples[k] = src.samples[k];
+			dst->nr_samples = src.nr_samples;
+			++*nr_files;
+		} else {
+			fprintf(stderr, "Skipping file source %s, %s\n", pathname,
+				dst->note ? "out of memory" : "not named after a note");
+			free(dst->samples);
+		}
+		file_source_close(&src);
+	}
+	free(dirents);
+	if (!files)
+		perror("Error allocating memory for file sources");
+	return files;
+}
+
+static void free_note_sources(struct note_source *srcs, int n)
+{
+	for (int i = 0; srcs && i < n; ++i)
+		free(srcs[i].samples);
+	free(srcs);
+}
+
+/* Totals of the readings of a configuration. */
+struct readings {
+	int nr_readings;
+	int nr_correct;
+	float64_t sum_abs_cents_error;
+	int nr_locked;
+	float64_t sum_secs_to_lock;
+	float64_t processing_secs;
+	float64_t samples_secs;
+};
+
+/**
+ * @brief Run the pitch detector over the source on the context, a reading at the end of each hop once it's
+ *        of the note: after the pluck, or once the first whole frame of a file source is in.
+ */
+static void read_note_source(struct readings *readings, const struct note_source *src, struct dsp_ctx *ctx,
+			     void *ctx_mem, enum frame_length frame_len, int hop_len, int nharmonics)
+{
+	const int over_hop_len = hop_len*OVERSAMPLING_FACTOR;
+	const int block_len = over_hop_len < BLOCK_LEN ? over_hop_len : BLOCK_LEN;
+	const int first_reading = src->frequency ? src->nr_silent_samples : frame_len*OVERSAMPLING_FACTOR;
+	bool locked = false;
+	double start;
+
+	dsp_ctx_init(ctx, frame_len, hop_len, ctx_mem);
+	start = cpu_secs();
+	for (int i = 0; i+block_len <= src->nr_samples; i += block_len) {
+		float32_t frequency, strength;
+
+		dsp_ctx_push_block(ctx, src->samples+i, block_len);
+		if ((i+block_len) % over_hop_len != 0)
+			continue;
+		frequency = hps_finish_ctx_nharmonics(ctx, nharmonics, &strength);
+		if (i+block_len < first_reading)
+			continue;
+		++readings->nr_readings;
+		if (nearest_note(frequency) != src->note)
+			continue;
+		++readings->nr_correct;
+		if (!src->frequency)
+			continue;
+		readings->sum_abs_cents_error += fabsf(1200*log2f(frequency/src->frequency));
+		if (!locked) {
+			locked = true;
+			++readings->nr_locked;
+			readings->sum_secs_to_lock += (float64_t)(i+block_len-src->nr_silent_samples)/OVERSAMPLING_RATE;
+		}
+	}
+	readings->processing_secs += cpu_secs()-start;
+	readings->samples_secs += (float64_t)src->nr_samples/OVERSAMPLING_RATE;
+}
+
+/** @brief Measure the configuration of the run-time parameters over the plucks and file sources. */
+static void measure_design_point(struct design_point *point, const struct note_source *plucks, int nr_plucks,
+				 const struct note_source *files, int nr_files, struct dsp_ctx *ctx, void *ctx_mem)
+{
+	const int over_hop_len = point->hop_len*OVERSAMPLING_FACTOR;
+	const int block_len = over_hop_len < BLOCK_LEN ? over_hop_len : BLOCK_LEN;
+	struct readings pluck_readings = { 0 }, file_readings = { 0 };
+
+	point->nr_taps = NR_TAPS;
+	point->sampling_rate = SAMPLING_RATE;
+	point->oversampling_factor = OVERSAMPLING_FACTOR;
+	point->fixed_point = FIXED_POINT;
+	/* The context, the ring of raw ADC samples and the block they're converted into. */
+	point->ram_bytes = dsp_ctx_mem_size(point->frame_len) + NR_RING_HOPS*over_hop_len*sizeof(uint16_t) +
+			   block_len*sizeof(sample_t);
+
+	for (int i = 0; i < nr_plucks; ++i)
+		read_note_source(&pluck_readings, plucks+i, ctx, ctx_mem, point->frame_len, point->hop_len, point->nharmonics);
+	for (int i = 0; i < nr_files; ++i)
+		read_note_source(&file_readings, files+i, ctx, ctx_mem, point->frame_len, point->hop_len, point->nharmonics);
+	point->host_us_per_sec = 1e6*pluck_readings.processing_secs/pluck_readings.samples_secs;
+	point->secs_to_lock = pluck_readings.nr_locked ? pluck_readings.sum_secs_to_lock/pluck_readings.nr_locked : INFINITY;
+	point->detection_rate = pluck_readings.nr_readings ?
+				(float64_t)pluck_readings.nr_correct/pluck_readings.nr_readings : 0;
+	point->corpus_detection_rate = file_readings.nr_readings ?
+				       (float64_t)file_readings.nr_correct/file_readings.nr_readings : NAN;
+	point->mean_abs_cents_error = pluck_readings.nr_correct ?
+				      pluck_readings.sum_abs_cents_error/pluck_readings.nr_correct : INFINITY;
+}
+
+/** @brief Mark the points on the Pareto frontier. Return false on error. */
+static bool mark_pareto_frontier(struct design_point *points, int nr_points)
+{
+	float64_t *objectives = malloc((nr_points ? nr_points : 1)*NR_OBJECTIVES*sizeof(float64_t));
+	bool *on_frontier = malloc((nr_points ? nr_points : 1)*sizeof(bool));
+
+	if (!objectives || !on_frontier) {
+		perror("Error allocating memory for the Pareto frontier");
+		free(objectives);
+		free(on_frontier);
+		return false;
+	}
+	for (int i = 0; i < nr_points; ++i)
+		design_point_objectives(points+i, objectives+i*NR_OBJECTIVES);
+	pareto_frontier(objectives, nr_points, NR_OBJECTIVES, on_frontier);
+	for (int i = 0; i < nr_points; ++i)
+		points[i].pareto = on_frontier[i];
+	free(objectives);
+	free(on_frontier);
+	return true;
+}
+
+#define CSV_HEADER  "nr_taps,sampling_rate,oversampling_factor,fixed_point,frame_len,hop_len,nharmonics," \
+		    "ram_bytes,host_us_per_sec,secs_to_lock,detection_rate,corpus_detection_rate," \
+		    "mean_abs_cents_error,pareto"
+
+static void print_design_point(FILE *f, const struct design_point *p)
+{
+	fprintf(f, "%d,%d,%d,%d,%d,%d,%d,%ld,%.1f,%.3f,%.4f,%.4f,%.3f,%d\n", p->nr_taps, p->sampling_rate,
+		p->oversampling_factor, p->fixed_point, p->frame_len, p->hop_len, p->nharmonics, p->ram_bytes,
+		p->host_us_per_sec, p->secs_to_lock, p->detection_rate, p->corpus_detection_rate,
+		p->mean_abs_cents_error, p->pareto);
+}
+
+static bool parse_design_point(const char *line, struct design_point *p)
+{
+	int pareto;
+
+	if (sscanf(line, "%d,%d,%d,%d,%d,%d,%d,%ld,%lf,%lf,%lf,%lf,%lf,%d", &p->nr_taps, &p->sampling_rate,
+		   &p->oversampling_factor, &p->fixed_point, &p->frame_len, &p->hop_len, &p->nharmonics,
+		   &p->ram_bytes, &p->host_us_per_sec, &p->secs_to_lock, &p->detection_rate,
+		   &p->corpus_detection_rate, &p->mean_abs_cents_error, &pareto) != 14)
+		return false;
+	p->pareto = pareto;
+	return true;
+}
+
+/** @brief Output all the points as CSV to stdout, and those on the frontier, fastest first, to stderr. */
+static void print_design_points(struct design_point *points, int nr_points)
+{
+	int nr_on_frontier = 0;
+
+	printf(CSV_HEADER "\n");
+	for (int i = 0; i < nr_points; ++i) {
+		print_design_point(stdout, points+i);
+		nr_on_frontier += points[i].pareto;
+	}
+	fprintf(stderr, "%d of %d configurations on the Pareto frontier:\n", nr_on_frontier, nr_points);
+	fprintf(stderr, "%5s %5s %3s %5s %5s %3s %8s %9s %7s %7s %7s %7s\n", "taps", "rate", "os", "frame", "hop",
+		"nh", "RAM", "us/sec", "lock s", "detect", "corpus", "|cents|");
+	for (;;) {
+		struct design_point *fastest = NULL;
+
+		/* Selection sort of the few on the frontier, unmarking each once output. */
+		for (int i = 0; i < nr_points; ++i) {
+			if (points[i].pareto && (!fastest || points[i].host_us_per_sec < fastest->host_us_per_sec))
+				fastest = points+i;
+		}
+		if (!fastest)
+			break;
+		fprintf(stderr, "%5d %5d %3d %5d %5d %3d %8ld %9.1f %7.3f %7.4f %7.4f %7.3f\n", fastest->nr_taps,
+			fastest->sampling_rate, fastest->oversampling_factor, fastest->frame_len, fastest->hop_len,
+			fastest->nharmonics, fastest->ram_bytes, fastest->host_us_per_sec, fastest->secs_to_lock,
+			fastest->detection_rate, fastest->corpus_detection_rate, fastest->mean_abs_cents_error);
+		fastest->pareto = false;
+	}
+}
+
+/** @brief Read the points of the CSV files output by runs of other builds, and mark the frontier of them all. */
+static int merge(char **pathnames, int nr_pathnames)
+{
+	struct design_point *points = NULL;
+	int nr_points = 0, cap = 0;
+	char line[MAX_LINE_LEN];
+	int ret = 0;
+
+	for (int i = 0; i < nr_pathnames && !ret; ++i) {
+		FILE *f = fopen(pathnames[i], "r");
+
+		if (!f) {
+			fprintf(stderr, "Error opening %s: %s\n", pathnames[i], strerror(errno));
+			ret = 1;
+			break;
+		}
+		while (fgets(line, sizeof(line), f)) {
+			if (strncmp(line, CSV_HEADER, strlen(CSV_HEADER)) == 0)
+				continue;
+			if (nr_points == cap) {
+				struct design_point *grown = realloc(points, (cap = cap ? 2*cap : 64)*sizeof(*points));
+
+				if (!grown) {
+					perror("Error allocating memory for configurations");
+					ret = 1;
+					break;
+				}
+				points = grown;
+			}
+			if (!parse_design_point(line, points+nr_points)) {
+				fprintf(stderr, "Error parsing configuration of %s: %s", pathnames[i], line);
+				ret = 1;
+				break;
+			}
+			++nr_points;
+		}
+		fclose(f);
+	}
+	if (!ret && mark_pareto_frontier(points, nr_points))
+		print_design_points(points, nr_points);
+	else
+		ret = 1;
+	free(points);
+	return ret;
+}
+
+/** @brief Parse a comma separated list of at most max ints into list. Return the number of them, or 0 on error. */
+static int parse_int_list(const char *s, int *list, int max)
+{
+	int n = 0;
+
+	for (const char *tok = s; n < max; ++tok) {
+		char *end;
+
+		list[n++] = strtol(tok, &end, 10);
+		if (end == tok || list[n-1] <= 0 || (*end != ',' && *end != '\0'))
+			return 0;
+		if (*end == '\0')
+			return n;
+		tok = end;
+	}
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-f <frame lens>] [-o <hops in frames>] [-k <min>:<max>] [-n <lowest>:<highest>]\n"
+			"       [-c <max cents>] [-s <cents step>] [-t <secs>]\n"
+			"       %s -m <csv file>...\n"
+			"  -f  Comma separated frame lengths to sweep, 512,1024,2048,4096 by default.\n"
+			"  -o  Comma separated numbers of hops in a frame to sweep, 1,2,4,8 by default.\n"
+			"  -k  Range of numbers of harmonics of HPS to sweep, 2:6 by default.\n"
+			"  -n  Notes of the plucks, " TESTED_LOWEST_NOTE ":" TESTED_HIGHEST_NOTE " by default.\n"
+			"  -c  Detune each note from -max to +max cents, 30 by default.\n"
+			"  -s  Step of the detuning, 30 cents by default.\n"
+			"  -t  Seconds of each pluck, 2 by default.\n"
+			"  -m  Merge the CSV output of runs of builds of other compile-time parameters, and mark the\n"
+			"      Pareto frontier of them all.\n", prog, prog);
+}
+
+int main(int argc, char **argv)
+{
+	int frame_lens[MAX_NR_FRAME_LENS] = { FRAME_LEN_512, FRAME_LEN_1024, FRAME_LEN_2048, FRAME_LEN_4096 };
+	int hops_in_frames[MAX_NR_HOPS_IN_FRAMES] = { 1, 2, 4, 8 };
+	int nr_frame_lens = 4, nr_hops_in_frames = 4;
+	int min_nharmonics = 2, max_nharmonics = 6;
+	struct note_freq *lowest = find_note(TESTED_LOWEST_NOTE), *highest = find_note(TESTED_HIGHEST_NOTE);
+	float32_t max_cents = 30, cents_step = 30, pluck_secs = 2;
+	char lowest_name[8], highest_name[8];
+	struct note_source *plucks = NULL, *files = NULL;
+	struct design_point *points = NULL;
+	int nr_plucks = 0, nr_files = 0, nr_points = 0;
+	struct dsp_ctx ctx;
+	void *ctx_mem = NULL;
+	int ret = 1;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "f:o:k:n:c:s:t:m")) != -1) {
+		switch (opt) {
+		case 'f':
+			if (!(nr_frame_lens = parse_int_list(optarg, frame_lens, MAX_NR_FRAME_LENS)))
+				goto usage;
+			break;
+		case 'o':
+			if (!(nr_hops_in_frames = parse_int_list(optarg, hops_in_frames, MAX_NR_HOPS_IN_FRAMES)))
+				goto usage;
+			break;
+		case 'k':
+			if (sscanf(optarg, "%d:%d", &min_nharmonics, &max_nharmonics) != 2 || min_nharmonics < 1 ||
+			    min_nharmonics > max_nharmonics)
+				goto usage;
+			break;
+		case 'n':
+			if (sscanf(optarg, "%7[^:]:%7s", lowest_name, highest_name) != 2 ||
+			    !(lowest = find_note(lowest_name)) || !(highest = find_note(highest_name)) || lowest > highest)
+				goto usage;
+			break;
+		case 'c':
+			max_cents = atof(optarg);
+			break;
+		case 's':
+			cents_step = atof(optarg);
+			break;
+		case 't':
+			pluck_secs = atof(optarg);
+			break;
+		case 'm':
+			if (optind >= argc)
+				goto usage;
+			return merge(argv+optind, argc-optind);
+		default:
+			goto usage;
+		}
+	}
+	if (max_cents < 0 || max_cents >= CENTS_IN_HALF_SEMITONE || cents_step <= 0 || pluck_secs <= 0)
+		goto usage;
+
+	plucks = synth_plucks(lowest, highest, max_cents, cents_step, pluck_secs, &nr_plucks);
+	files = read_note_files(&nr_files);
+	points = malloc(nr_frame_lens*nr_hops_in_frames*(max_nharmonics-min_nharmonics+1)*sizeof(struct design_point));
+	ctx_mem = malloc(dsp_ctx_mem_size(MAX_LINKED_FRAME_LEN));
+	if (!plucks || !files || !points || !ctx_mem) {
+		if (plucks && files)
+			perror("Error allocating memory for configurations");
+		goto out;
+	}
+	for (int f = 0; f < nr_frame_lens; ++f) {
+		const enum frame_length frame_len = frame_lens[f];
+
+		if (frame_len > MAX_LINKED_FRAME_LEN || !dsp_ctx_init(&ctx, frame_len, frame_len, ctx_mem)) {
+			fprintf(stderr, "Skipping frame len %d, its FFT tables aren't linked\n", frame_len);
+			continue;
+		}
+		for (int h = 0; h < nr_hops_in_frames; ++h) {
+			const int hop_len = frame_len/hops_in_frames[h];
+
+			/* The hop has to be a whole number of blocks of whole decimated samples. */
+			if (hop_len < 1 || hop_len*hops_in_frames[h] != frame_len) {
+				fprintf(stderr, "Skipping %d hops in frame len %d\n", hops_in_frames[h], frame_len);
+				continue;
+			}
+			fprintf(stderr, "Measuring frame len %d, hop len %d\n", frame_len, hop_len);
+			for (int nharmonics = min_nharmonics; nharmonics <= max_nharmonics; ++nharmonics) {
+				struct design_point *point = points+nr_points++;
+
+				point->frame_len = frame_len;
+				point->hop_len = hop_len;
+				point->nharmonics = nharmonics;
+				measure_design_point(point, plucks, nr_plucks, files, nr_files, &ctx, ctx_mem);
+			}
+		}
+	}
+	if (mark_pareto_frontier(points, nr_points)) {
+		print_design_points(points, nr_points);
+		ret = 0;
+	}
+out:
+	free_note_sources(plucks, nr_plucks);
+	free_note_sources(files, nr_files);
+	free(points);
+	free(ctx_mem);
+	return ret;
+usage:
+	usage(argv[0]);
+	return 1;
+}
@@ -4,16 +4,72 @@
  */
 #include "dsp_indirect.h"
 
-static void s16_array_to_f32(const int16_t *src, float32_t *dest, int len)
+void s16_array_to_samples(const int16_t *src, sample_t *dest, int len)
 {
 	for (int i = 0; i < len; ++i) 
-		dest[i] = (float32_t)src[i];
+		dest[i] = (sample_t)src[i];
 }
 
-float32_t *samples_to_freq_bin_magnitudes_s16(const int16_t *samples, enum frame_length frame_len)
+/**
+ * @brief Get the signed 16-bit samples as sample_t. They're already q15 in the FIXED_POINT pipeline, so
+ *        the frame view (see file_source.h) is pushed as is, as the push only reads it, rather than copied.
+ */
+static const sample_t *s16_samples(const int16_t *samples, sample_t *converted_samples, int len)
+{
+#if FIXED_POINT
+	return samples;
+#else
+	s16_array_to_samples(samples, converted_samples, len);
+	return converted_samples;
+#endif
+}
+
+magnitude_t *samples_to_freq_bin_magnitudes_s16(const int16_t *samples, enum frame_length frame_len)
+{
+	static sample_t converted_samples[OVERSAMPLING_FACTOR*MAX_FRAME_LEN]; 
+	return samples_to_freq_bin_magnitudes(s16_samples(samples, converted_samples, OVERSAMPLING_FACTOR*frame_len), 
+					      frame_len);
+}
+
+magnitude_t *dsp_ctx_samples_to_freq_bin_magnitudes_s16(struct dsp_ctx *ctx, const int16_t *samples, 
+							sample_t *converted_samples)
+{
+	const struct bin_range all_bins = { 0, nr_bins(ctx->frame_len) };
+
+	dsp_ctx_push_block(ctx, s16_samples(samples, converted_samples, OVERSAMPLING_FACTOR*ctx->frame_len), 
+			   OVERSAMPLING_FACTOR*ctx->frame_len);
+	return dsp_ctx_finish(ctx, all_bins, false);
+}
+
+magnitude_t *hop_samples_to_freq_bin_magnitudes_s16(const int16_t *samples, enum frame_length frame_len, int hop_len)
+{
+	static sample_t converted_samples[OVERSAMPLING_FACTOR*MAX_FRAME_LEN]; 
+	return hop_samples_to_freq_bin_magnitudes(s16_samples(samples, converted_samples, OVERSAMPLING_FACTOR*hop_len), 
+						  frame_len, hop_len);
+}
+
+magnitude_t *samples_to_freq_bin_magnitudes_blocks_s16(const int16_t *samples, enum frame_length frame_len, 
+						       int block_len)
+{
+	static sample_t converted_samples[OVERSAMPLING_FACTOR*MAX_FRAME_LEN]; 
+	const sample_t *frame = s16_samples(samples, converted_samples, OVERSAMPLING_FACTOR*frame_len);
+
+	for (int i = 0; i < OVERSAMPLING_FACTOR*frame_len; i += block_len)
+		samples_to_freq_bin_magnitudes_push_block(frame+i, block_len);
+	return samples_to_freq_bin_magnitudes_finish(frame_len);
+}
+
+void hop_samples_push_s16(const int16_t *samples, enum frame_length frame_len, int hop_len)
 {
-	static float32_t float_samples[OVERSAMPLING_FACTOR*MAX_FRAME_LEN]; 
-	s16_array_to_f32(samples, float_samples, OVERSAMPLING_FACTOR*frame_len); 
-	return samples_to_freq_bin_magnitudes(float_samples, frame_len);
+	static sample_t converted_samples[OVERSAMPLING_FACTOR*MAX_FRAME_LEN]; 
+	hop_samples_to_freq_bin_magnitudes_push_block(s16_samples(samples, converted_samples, OVERSAMPLING_FACTOR*hop_len), 
+						      OVERSAMPLING_FACTOR*hop_len);
 }
 
+float32_t pitch_detector_hop_s16(const struct pitch_detector *pd, const int16_t *samples, enum frame_length frame_len, 
+				 int hop_len, float32_t *strength)
+{
+	static sample_t converted_samples[OVERSAMPLING_FACTOR*MAX_FRAME_LEN]; 
+	pd->push_block(s16_samples(samples, converted_samples, OVERSAMPLING_FACTOR*hop_len), OVERSAMPLING_FACTOR*hop_len);
+	return pd->finish(frame_len, strength);
+}
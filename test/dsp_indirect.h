@@ -4,16 +4,41 @@
  *
  * Some test sources include this to indirectly include dsp.h from 
  * the core library as they require the signed 16-bit integer version 
- * of samples_to_freq_bin_magnitudes().
+ * of samples_to_freq_bin_magnitudes() (and its variants). The signed 16-bit
+ * samples have the same value as sample_t in both the float and FIXED_POINT versions.
  *
- * Function samples_to_freq_bin_magnitudes_s16() is not defined in the 
+ * The *_s16() functions are not defined in the 
  * core library to not waste MCU RAM space.
  */
 #ifndef DSP_INDIRECT
 #define DSP_INDIRECT
 
 #include "dsp.h"
+#include "pitch.h"
 
-float32_t *samples_to_freq_bin_magnitudes_s16(const int16_t *samples, enum frame_length frame_len);
+/** @brief Convert signed 16-bit samples to sample_t, which have the same value. */
+void s16_array_to_samples(const int16_t *src, sample_t *dest, int len);
+magnitude_t *samples_to_freq_bin_magnitudes_s16(const int16_t *samples, enum frame_length frame_len);
+/**
+ * @brief Same as samples_to_freq_bin_magnitudes_s16() but on a context of a hop of the frame length, e.g.
+ *        of a worker thread, converting to the converted_samples of an oversized frame of its own.
+ */
+magnitude_t *dsp_ctx_samples_to_freq_bin_magnitudes_s16(struct dsp_ctx *ctx, const int16_t *samples, 
+							sample_t *converted_samples);
+magnitude_t *hop_samples_to_freq_bin_magnitudes_s16(const int16_t *samples, enum frame_length frame_len, int hop_len);
+/** 
+ * @brief Same as samples_to_freq_bin_magnitudes_s16() but the oversized frame is pushed 
+ *        in blocks of block_len samples with samples_to_freq_bin_magnitudes_push_block().
+ */
+magnitude_t *samples_to_freq_bin_magnitudes_blocks_s16(const int16_t *samples, enum frame_length frame_len, 
+						       int block_len);
+/** 
+ * @brief Push a hop of samples as a single block with hop_samples_to_freq_bin_magnitudes_push_block(), 
+ *        without finishing it.
+ */
+void hop_samples_push_s16(const int16_t *samples, enum frame_length frame_len, int hop_len);
+/** @brief Push a hop of samples to the pitch detector as a single block and finish it. */
+float32_t pitch_detector_hop_s16(const struct pitch_detector *pd, const int16_t *samples, enum frame_length frame_len, 
+				 int hop_len, float32_t *strength);
 
 #endif
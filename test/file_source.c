@@ -4,6 +4,7 @@
  */
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <dirent.h>
 #include <fcntl.h>
 #include <stdint.h>
@@ -12,7 +13,6 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
-#include <libgen.h>
 #include "file_source.h"
 
 static bool str_has_suffix(const char *str, const char *suffix)
@@ -29,90 +29,155 @@ static bool str_has_suffix(const char *str, const char *suffix)
 	return true;
 }
 
-/** @brief Get the size of a file in bytes, or -1 on error. */
-static int file_size(int fd)
+/** @brief Concatenate dir, "/" and name into a newly allocated pathname, or NULL on error. */
+static char *path_join(const char *dir, const char *name)
 {
-	struct stat stat;
+	char *pathname = malloc(strlen(dir) + 1 + strlen(name) + 1);
 
-	if (fstat(fd, &stat) == -1)
-		return -1;
-	return stat.st_size;
+	if (!pathname) {
+		fprintf(stderr, "Error allocating memory for pathname: %s\n", strerror(errno));
+		return NULL;
+	}
+	sprintf(pathname, "%s/%s", dir, name);
+	return pathname;
 }
 
-/**
- * @brief Run a function on a stream of samples sourced from a file. 
- *
- * See data/{note,sine}/README.md for an explanation of the format of a file source.
- * The samples in the file are split into oversized frames of length 
- * frame_len*OVERSAMPLING_FACTOR samples, and process_samples called once on each 
- * frame until there aren't enough samples left in the file to fill a whole frame.
- */
-static bool file_source(char *pathname, enum frame_length frame_len,
-			process_samples_fn process_samples)
+/** @brief Map the whole file at pathname read only. An empty file has a NULL map of length 0. */
+static bool map_file(const char *pathname, void **map, size_t *map_len)
 {
-	int fd, fsz, sample_size = sizeof(int16_t);
-	int16_t *samples;
-	char *filename;
-	int remaining_samples;
-	bool ret = true;
-	const int oversize_frame_len = frame_len*OVERSAMPLING_FACTOR;
+	struct stat stat;
+	int fd;
 
 	fd = open(pathname, O_RDONLY);
 	if (fd == -1) {
 		fprintf(stderr, "Error opening file %s for reading: %s\n", pathname, strerror(errno));
 		return false;
 	}
-	fsz = file_size(fd);
-	if (fsz == -1) {
+	if (fstat(fd, &stat) == -1) {
 		fprintf(stderr, "Error getting size of file %s: %s\n", pathname, strerror(errno));
 		close(fd);
 		return false;
 	}
-	samples = malloc(oversize_frame_len*sample_size);
-	if (!samples) {
-		fprintf(stderr, "Error allocating memory to store samples in: %s\n", strerror(errno));
-		close(fd);
+	*map = NULL;
+	*map_len = stat.st_size;
+	if (*map_len) {
+		*map = mmap(NULL, *map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (*map == MAP_FAILED) {
+			fprintf(stderr, "Error mapping file %s: %s\n", pathname, strerror(errno));
+			close(fd);
+			return false;
+		}
+		/* The frames are processed from the start to the end, so read ahead of them. */
+		madvise(*map, *map_len, MADV_SEQUENTIAL);
+	}
+	/* The mapping holds its own reference to the file. */
+	close(fd);
+	return true;
+}
+
+/**
+ * @brief View the samples of a mapped file, without taking ownership of the mapping.
+ * @see file_source_open() for the parameters.
+ */
+static bool file_source_view(struct file_source *src, const char *pathname, const void *map, size_t map_len,
+			     long first_sample, int nr_samples, const char *label)
+{
+	const long file_nr_samples = map_len/sizeof(int16_t);
+	const char *name;
+
+	if (first_sample < 0 || first_sample > file_nr_samples || nr_samples < 0 ||
+	    nr_samples > file_nr_samples-first_sample) {
+		fprintf(stderr, "Error: samples [%ld, %ld) out of the %ld samples of file %s\n", first_sample,
+			first_sample+nr_samples, file_nr_samples, pathname);
 		return false;
 	}
-	/* Extract name from pathname, excluding .raw extension, e.g. "E2" from "data/E2.raw" */
-	filename = basename(pathname);
-	*(strrchr(filename, '.')) = '\0';  /* Chop off .raw extension. */
+	if (label) {
+		src->label = strdup(label);
+	} else {
+		/* Extract name from pathname, excluding .raw extension, e.g. "E2" from "data/E2.raw" */
+		name = strrchr(pathname, '/');
+		name = name ? name+1 : pathname;
+		src->label = strndup(name, str_has_suffix(name, ".raw") ? strlen(name)-strlen(".raw") : strlen(name));
+	}
+	if (!src->label) {
+		fprintf(stderr, "Error allocating memory for label: %s\n", strerror(errno));
+		return false;
+	}
+	src->samples = (const int16_t *)map + first_sample;
+	src->nr_samples = nr_samples ? nr_samples : file_nr_samples-first_sample;
+	src->map = NULL;
+	src->map_len = 0;
+	return true;
+}
 
-	remaining_samples = fsz/sample_size;
+bool file_source_open(struct file_source *src, const char *pathname, long first_sample, int nr_samples,
+		      const char *label)
+{
+	void *map;
+	size_t map_len;
 
-	for (int i = 1; remaining_samples >= oversize_frame_len; ++i) {
-		/* Read frame of samples. */
-		int bytes_read = read(fd, samples, oversize_frame_len*sample_size);
-		if (bytes_read == -1) {
-			fprintf(stderr, "Error reading from file source %s: %s\n", filename, strerror(errno));
-			ret = false;
-			break;
-		}
-		if (bytes_read != oversize_frame_len*sample_size) {
-			fprintf(stderr, "Error: failed to read full frame of samples\n");
-			ret = false;
-			break;
-		}
+	if (!map_file(pathname, &map, &map_len))
+		return false;
+	if (!file_source_view(src, pathname, map, map_len, first_sample, nr_samples, label)) {
+		if (map)
+			munmap(map, map_len);
+		return false;
+	}
+	src->map = map;
+	src->map_len = map_len;
+	return true;
+}
 
-		if (!process_samples(filename, i, samples, frame_len)) {
-			ret = false;
-			break;
-		}
-		remaining_samples -= oversize_frame_len;
+void file_source_close(struct file_source *src)
+{
+	if (src->map)
+		munmap(src->map, src->map_len);
+	free(src->label);
+	src->label = NULL;
+	src->map = NULL;
+}
+
+int file_source_nr_frames(const struct file_source *src, enum frame_length frame_len, int hop_len)
+{
+	const int oversize_frame_len = frame_len*OVERSAMPLING_FACTOR;
+
+	if (src->nr_samples < oversize_frame_len)
+		return 0;
+	return 1 + (src->nr_samples-oversize_frame_len) / (hop_len*OVERSAMPLING_FACTOR);
+}
+
+const int16_t *file_source_frame(const struct file_source *src, int i, int hop_len)
+{
+	return src->samples + (long)i*hop_len*OVERSAMPLING_FACTOR;
+}
+
+/** @brief Run process_samples on each whole oversized frame of the file source. */
+static bool file_source_process(const struct file_source *src, enum frame_length frame_len, int hop_len,
+				process_samples_fn process_samples)
+{
+	const int nr_frames = file_source_nr_frames(src, frame_len, hop_len);
+	int nr_left_over = src->nr_samples;
+
+	for (int i = 0; i < nr_frames; ++i) {
+		if (!process_samples(src->label, i+1, file_source_frame(src, i, hop_len), frame_len))
+			return false;
 	}
-	free(samples);
-	close(fd);
-	return ret;
+	if (nr_frames)
+		nr_left_over -= (nr_frames-1)*hop_len*OVERSAMPLING_FACTOR + frame_len*OVERSAMPLING_FACTOR;
+	if (nr_left_over) {
+		fprintf(stderr, "Note: %d samples of file source %s after its last whole frame left over\n",
+			nr_left_over, src->label);
+	}
+	return true;
 }
 
-bool for_each_file_source(const char *file_source_dir, enum frame_length frame_len, 
-			  process_samples_fn process_samples)
+bool for_each_file_source_hop(const char *file_source_dir, enum frame_length frame_len, int hop_len,
+			      process_samples_fn process_samples)
 {
 	DIR *dir;
 	struct dirent *dirent;
 	bool ret = true;
-	char pathname[64];
-	
+
 	dir = opendir(file_source_dir);
 	if (!dir) {
 		fprintf(stderr, "Error opening directory %s: %s\n", file_source_dir, strerror(errno));
@@ -120,11 +185,25 @@ bool for_each_file_source(const char *file_source_dir, enum frame_length frame_l
 	}
 	errno = 0;
 	while (dirent = readdir(dir)) {
+		struct file_source src;
+		char *pathname;
+		bool processed;
+
 		if (!str_has_suffix(dirent->d_name, ".raw"))
 			continue;
-		snprintf(pathname, sizeof(pathname), "%s/%s", file_source_dir, dirent->d_name);
-		if (!file_source(pathname, frame_len, process_samples))
+		pathname = path_join(file_source_dir, dirent->d_name);
+		if (!pathname || !file_source_open(&src, pathname, 0, 0, NULL)) {
+			free(pathname);
+			ret = false;
 			break;
+		}
+		processed = file_source_process(&src, frame_len, hop_len, process_samples);
+		file_source_close(&src);
+		free(pathname);
+		if (!processed) {
+			ret = false;
+			break;
+		}
 		errno = 0;
 	}
 	if (errno) {
@@ -135,3 +214,95 @@ bool for_each_file_source(const char *file_source_dir, enum frame_length frame_l
 	return ret;
 }
 
+bool for_each_file_source(const char *file_source_dir, enum frame_length frame_len,
+			  process_samples_fn process_samples)
+{
+	return for_each_file_source_hop(file_source_dir, frame_len, frame_len, process_samples);
+}
+
+bool for_each_indexed_file_source(const char *index_pathname, enum frame_length frame_len, int hop_len,
+				  process_samples_fn process_samples)
+{
+	FILE *index;
+	char *line = NULL, *index_dir, *slash;
+	size_t line_cap = 0;
+	/* The file of the previous line and its mapping, shared with the next lines of the same file. */
+	char *mapped_pathname = NULL;
+	void *map = NULL;
+	size_t map_len = 0;
+	bool ret = true;
+
+	index = fopen(index_pathname, "r");
+	if (!index) {
+		fprintf(stderr, "Error opening index %s for reading: %s\n", index_pathname, strerror(errno));
+		return false;
+	}
+	index_dir = strdup(index_pathname);
+	if (!index_dir) {
+		fprintf(stderr, "Error allocating memory for pathname: %s\n", strerror(errno));
+		fclose(index);
+		return false;
+	}
+	slash = strrchr(index_dir, '/');
+	if (slash)
+		*slash = '\0';
+	else
+		strcpy(index_dir, ".");
+
+	for (int line_nr = 1; getline(&line, &line_cap, index) != -1; ++line_nr) {
+		char name[256], label[256];
+		long first_sample;
+		int nr_samples;
+		struct file_source src;
+		char *pathname;
+		bool processed;
+
+		if (line[strspn(line, " \t\r\n")] == '\0' || line[strspn(line, " \t")] == '#')
+			continue;
+		if (sscanf(line, "%255s %ld %d %255s", name, &first_sample, &nr_samples, label) != 4) {
+			fprintf(stderr, "Error: line %d of index %s isn't \"<file> <first sample> <number of samples> "
+				"<label>\"\n", line_nr, index_pathname);
+			ret = false;
+			break;
+		}
+		pathname = name[0] == '/' ? strdup(name) : path_join(index_dir, name);
+		if (!pathname) {
+			ret = false;
+			break;
+		}
+		if (!mapped_pathname || strcmp(pathname, mapped_pathname) != 0) {
+			if (map)
+				munmap(map, map_len);
+			free(mapped_pathname);
+			mapped_pathname = pathname;
+			if (!map_file(pathname, &map, &map_len)) {
+				map = NULL;
+				ret = false;
+				break;
+			}
+		} else {
+			free(pathname);
+		}
+		if (!file_source_view(&src, mapped_pathname, map, map_len, first_sample, nr_samples, label)) {
+			ret = false;
+			break;
+		}
+		processed = file_source_process(&src, frame_len, hop_len, process_samples);
+		file_source_close(&src);
+		if (!processed) {
+			ret = false;
+			break;
+		}
+	}
+	if (ret && ferror(index)) {
+		fprintf(stderr, "Error reading from index %s: %s\n", index_pathname, strerror(errno));
+		ret = false;
+	}
+	if (map)
+		munmap(map, map_len);
+	free(mapped_pathname);
+	free(line);
+	free(index_dir);
+	fclose(index);
+	return ret;
+}
@@ -1,31 +1,82 @@
 /*
  * Copyright (C) 2024 Petar Turukalo
  * SPDX-License-Identifier: GPL-2.0
+ *
+ * Reader of the corpus of file sources (see data/{note,sine}/README.md). Each file is memory mapped
+ * once and its oversized frames handed out as views into the mapping, rather than read and copied
+ * into a buffer a frame at a time, so that reading an hours long corpus costs little more than the
+ * page faults of touching it.
  */
 #ifndef FILE_SOURCE_H
 #define FILE_SOURCE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "dsp.h"
 
 #define NOTE_FILES_DIR "data/note"
 #define SINE_FILES_DIR "data/sine"
 
 /**
- * Function that processes an oversized frame of samples from a file source. 
+ * Function that processes an oversized frame of samples from a file source.
  * Return false on error.
  */
 typedef bool (*process_samples_fn)(
-	const char *filename,  /**< Excluding .raw extension. */
+	const char *filename,  /**< Excluding .raw extension, or the label of the file source in an index. */
 	int i,  /**< 1-indexed frame number from the start of the file source. */
-	const int16_t *samples, 
+	const int16_t *samples,  /**< View into the mapped file, only valid during the call. */
 	enum frame_length frame_len);  /**< Number of samples is frame_len*OVERSAMPLING_FACTOR. */
 
+/** A run of samples of a memory mapped file. */
+struct file_source {
+	char *label;
+	const int16_t *samples;
+	int nr_samples;
+	void *map;
+	size_t map_len;
+};
+
+/**
+ * @brief Map the file at pathname and view nr_samples of its samples starting at first_sample.
+ * @param nr_samples If 0, the rest of the file from first_sample.
+ * @param label If NULL, the filename excluding the .raw extension, e.g. "E2" from "data/note/E2.raw".
+ * @return false on error, having printed it.
+ */
+bool file_source_open(struct file_source *src, const char *pathname, long first_sample, int nr_samples,
+		      const char *label);
+void file_source_close(struct file_source *src);
+
+/**
+ * @brief Number of whole oversized frames of the file source, a frame starting every hop_len*OVERSAMPLING_FACTOR
+ *        samples. The samples after the last whole frame, if any, are left over.
+ */
+int file_source_nr_frames(const struct file_source *src, enum frame_length frame_len, int hop_len);
+/** @brief View of the oversized frame starting at the ith hop (0-indexed) of the file source. */
+const int16_t *file_source_frame(const struct file_source *src, int i, int hop_len);
+
 /**
- * @brief Run file_source() on each file source in the `file_source_dir` directory. 
- * @see file_source() for more info.
+ * @brief Run process_samples on each whole oversized frame of each file source in the `file_source_dir`
+ *        directory, the frames not overlapping.
  */
-bool for_each_file_source(const char *file_source_dir, enum frame_length frame_len, 
+bool for_each_file_source(const char *file_source_dir, enum frame_length frame_len,
 			  process_samples_fn process_samples);
 
+/**
+ * @brief Same as for_each_file_source() but a frame starts every hop_len*OVERSAMPLING_FACTOR samples, so
+ *        that frames overlap if hop_len is less than frame_len.
+ */
+bool for_each_file_source_hop(const char *file_source_dir, enum frame_length frame_len, int hop_len,
+			      process_samples_fn process_samples);
+
+/**
+ * @brief Same as for_each_file_source_hop() but on the file sources listed in an index file.
+ *
+ * Each line of the index is the pathname of a .raw file (relative to the directory of the index), the
+ * first sample and number of samples of the file source in it (0 for the rest of the file) and its label,
+ * separated by whitespace, e.g. "E2.raw 8192 16384 E2". Blank lines and lines starting with # are skipped.
+ * Consecutive lines of the same file share its mapping.
+ */
+bool for_each_indexed_file_source(const char *index_pathname, enum frame_length frame_len, int hop_len,
+				  process_samples_fn process_samples);
+
 #endif
@@ -0,0 +1,260 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ */
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "parallel_file_source.h"
+#include "file_source.h"
+#include "assert.h"
+
+struct work_item {
+	char *pathname;
+	struct assert_log log;
+	bool logged;
+	bool ok;
+};
+
+/*
+ * The run of work items of a worker, the indices [front, back) packed into one word so that the
+ * worker taking from the front and the thieves taking from the back agree on who gets the last one.
+ */
+struct work_run {
+	_Atomic uint64_t range;
+};
+
+struct worker_pool {
+	struct work_item *items;
+	int nr_items;
+	struct work_run *runs;
+	int nr_workers;
+	enum frame_length frame_len;
+	process_samples_worker_fn process_samples;
+	/* Set on the first error, to stop the workers taking more work. */
+	atomic_bool failed;
+};
+
+struct worker_arg {
+	struct worker_pool *pool;
+	struct file_source_worker worker;
+};
+
+static uint64_t run_range(uint32_t front, uint32_t back)
+{
+	return (uint64_t)front<<32 | back;
+}
+
+/**
+ * @brief Take a work item from the front of the run, or from the back if stealing it.
+ * @return Index of the item, or -1 if the run is empty.
+ */
+static int work_run_take(struct work_run *run, bool steal)
+{
+	uint64_t range = atomic_load(&run->range);
+
+	for (;;) {
+		const uint32_t front = range>>32;
+		const uint32_t back = range;
+
+		if (front >= back)
+			return -1;
+		/* On failure range is reloaded with that of the winner, to try again. */
+		if (steal && atomic_compare_exchange_weak(&run->range, &range, run_range(front, back-1)))
+			return back-1;
+		if (!steal && atomic_compare_exchange_weak(&run->range, &range, run_range(front+1, back)))
+			return front;
+	}
+}
+
+/** @brief Take the next work item of the worker, stealing it from the other workers once its own run out. */
+static int worker_take(struct worker_pool *pool, int id)
+{
+	int item = work_run_take(&pool->runs[id], false);
+
+	for (int k = 1; item == -1 && k < pool->nr_workers; ++k)
+		item = work_run_take(&pool->runs[(id+k) % pool->nr_workers], true);
+	return item;
+}
+
+static bool process_work_item(struct worker_pool *pool, struct file_source_worker *worker, struct work_item *item)
+{
+	struct file_source src;
+	int nr_frames;
+
+	if (!file_source_open(&src, item->pathname, 0, 0, NULL))
+		return false;
+	nr_frames = file_source_nr_frames(&src, pool->frame_len, pool->frame_len);
+	for (int i = 0; i < nr_frames; ++i) {
+		if (!pool->process_samples(worker, src.label, i+1, file_source_frame(&src, i, pool->frame_len),
+					   pool->frame_len)) {
+			file_source_close(&src);
+			return false;
+		}
+	}
+	file_source_close(&src);
+	return true;
+}
+
+static void *worker_thread(void *arg)
+{
+	struct worker_pool *pool = ((struct worker_arg *)arg)->pool;
+	struct file_source_worker *worker = &((struct worker_arg *)arg)->worker;
+	int i;
+
+	while (!atomic_load(&pool->failed) && (i = worker_take(pool, worker->id)) != -1) {
+		struct work_item *item = pool->items+i;
+
+		item->logged = assert_log_begin(&item->log);
+		if (!item->logged) {
+			fprintf(stderr, "Error opening assert log of file source %s\n", item->pathname);
+			atomic_store(&pool->failed, true);
+			break;
+		}
+		item->ok = process_work_item(pool, worker, item);
+		assert_log_end();
+		if (!item->ok)
+			atomic_store(&pool->failed, true);
+	}
+	return NULL;
+}
+
+static int filter_raw(const struct dirent *dirent)
+{
+	const char *ext = strrchr(dirent->d_name, '.');
+
+	return ext && strcmp(ext, ".raw") == 0;
+}
+
+/**
+ * @brief List the pathnames of the file sources in the directory as work items, sorted by name so that
+ *        their asserts are merged in the same order every time.
+ * @return Number of items, or -1 on error.
+ */
+static int list_work_items(const char *file_source_dir, struct work_item **items)
+{
+	struct dirent **dirents;
+	int n = scandir(file_source_dir, &dirents, filter_raw, alphasort);
+	bool allocated;
+
+	if (n == -1) {
+		fprintf(stderr, "Error reading directory %s: %s\n", file_source_dir, strerror(errno));
+		return -1;
+	}
+	*items = calloc(n ? n : 1, sizeof(struct work_item));
+	allocated = *items;
+	for (int i = 0; i < n; ++i) {
+		if (allocated) {
+			char *pathname = malloc(strlen(file_source_dir) + 1 + strlen(dirents[i]->d_name) + 1);
+
+			if (pathname)
+				sprintf(pathname, "%s/%s", file_source_dir, dirents[i]->d_name);
+			(*items)[i].pathname = pathname;
+			allocated = pathname;
+		}
+		free(dirents[i]);
+	}
+	free(dirents);
+	if (!allocated) {
+		fprintf(stderr, "Error allocating memory for file sources: %s\n", strerror(errno));
+		for (int i = 0; *items && i < n; ++i)
+			free((*items)[i].pathname);
+		free(*items);
+		return -1;
+	}
+	return n;
+}
+
+bool for_each_file_source_parallel(const char *file_source_dir, enum frame_length frame_len, int nr_workers,
+				   process_samples_worker_fn process_samples)
+{
+	struct worker_pool pool = { .frame_len = frame_len, .process_samples = process_samples };
+	struct worker_arg *args;
+	pthread_t *threads;
+	int nr_started = 0;
+	bool ret = true;
+
+	pool.nr_items = list_work_items(file_source_dir, &pool.items);
+	if (pool.nr_items == -1)
+		return false;
+	if (nr_workers <= 0)
+		nr_workers = sysconf(_SC_NPROCESSORS_ONLN);
+	/* No more workers than there's work for. */
+	if (nr_workers > pool.nr_items)
+		nr_workers = pool.nr_items;
+	if (nr_workers < 1)
+		nr_workers = 1;
+	pool.nr_workers = nr_workers;
+	atomic_init(&pool.failed, false);
+	pool.runs = malloc(nr_workers*sizeof(struct work_run));
+	args = calloc(nr_workers, sizeof(struct worker_arg));
+	threads = malloc(nr_workers*sizeof(pthread_t));
+	if (!pool.runs || !args || !threads) {
+		fprintf(stderr, "Error allocating memory for workers: %s\n", strerror(errno));
+		ret = false;
+		goto out;
+	}
+
+	for (int k = 0; k < nr_workers; ++k) {
+		struct file_source_worker *worker = &args[k].worker;
+
+		atomic_init(&pool.runs[k].range, run_range((long)k*pool.nr_items/nr_workers,
+							   (long)(k+1)*pool.nr_items/nr_workers));
+		args[k].pool = &pool;
+		worker->id = k;
+		worker->ctx_mem = malloc(dsp_ctx_mem_size(frame_len));
+		worker->converted_samples = malloc(OVERSAMPLING_FACTOR*frame_len*sizeof(sample_t));
+		if (!worker->ctx_mem || !worker->converted_samples) {
+			fprintf(stderr, "Error allocating memory for worker: %s\n", strerror(errno));
+			ret = false;
+			goto out;
+		}
+		/*
+		 * Initialise the contexts before starting any worker, as the first initialisation also sets up
+		 * state shared by all contexts (see decimate_init()).
+		 */
+		if (!dsp_ctx_init(&worker->ctx, frame_len, frame_len, worker->ctx_mem)) {
+			fprintf(stderr, "Error initialising DSP context of frame len %d\n", frame_len);
+			ret = false;
+			goto out;
+		}
+	}
+	for (; nr_started < nr_workers; ++nr_started) {
+		int err = pthread_create(threads+nr_started, NULL, worker_thread, args+nr_started);
+
+		if (err) {
+			fprintf(stderr, "Error starting worker: %s\n", strerror(err));
+			atomic_store(&pool.failed, true);
+			break;
+		}
+	}
+	for (int k = 0; k < nr_started; ++k)
+		pthread_join(threads[k], NULL);
+
+	for (int i = 0; i < pool.nr_items; ++i) {
+		if (pool.items[i].logged) {
+			assert_log_merge(&pool.items[i].log);
+			ret = ret && pool.items[i].ok;
+		}
+	}
+	if (atomic_load(&pool.failed))
+		ret = false;
+out:
+	for (int k = 0; args && k < nr_workers; ++k) {
+		free(args[k].worker.ctx_mem);
+		free(args[k].worker.converted_samples);
+	}
+	for (int i = 0; i < pool.nr_items; ++i)
+		free(pool.items[i].pathname);
+	free(pool.items);
+	free(pool.runs);
+	free(args);
+	free(threads);
+	return ret;
+}
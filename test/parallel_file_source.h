@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Parallel version of for_each_file_source() (see file_source.h), spreading the file sources across
+ * a pool of worker threads, e.g. one per core of the host. The frames of a file source are processed
+ * in order on the same worker, as the pipelines carry state from one frame to the next, but different
+ * file sources are processed at the same time on different workers.
+ *
+ * The file sources are dealt out in order to the workers up front, a contiguous run each. A worker
+ * takes the next file source from the front of its own run, and once it runs out steals one from the
+ * back of the run of another worker, so that the workers stay busy however long each file source
+ * takes to process.
+ *
+ * As the functions of dsp.h without a context share one, each worker has its own context and
+ * process_samples must only use it. The asserts (see assert.h) of each file source are logged apart
+ * and merged in the order of the file sources once all are processed, so that the output doesn't
+ * depend on the scheduling of the workers.
+ */
+#ifndef PARALLEL_FILE_SOURCE_H
+#define PARALLEL_FILE_SOURCE_H
+
+#include <stdbool.h>
+#include "dsp.h"
+
+struct file_source_worker {
+	int id;
+	/* Initialised to the frame length, and a hop of it, before the worker starts. */
+	struct dsp_ctx ctx;
+	void *ctx_mem;
+	/* Of an oversized frame, for the samples converted from signed 16-bit (see dsp_indirect.h). */
+	sample_t *converted_samples;
+};
+
+/**
+ * Same as process_samples_fn of file_source.h but run on a worker.
+ * Return false on error.
+ */
+typedef bool (*process_samples_worker_fn)(struct file_source_worker *worker, const char *filename, int i,
+					  const int16_t *samples, enum frame_length frame_len);
+
+/**
+ * @brief Run process_samples on each whole oversized frame of each file source in the `file_source_dir`
+ *        directory, the file sources processed in parallel on nr_workers workers.
+ * @param nr_workers If 0, the number of online cores of the host.
+ */
+bool for_each_file_source_parallel(const char *file_source_dir, enum frame_length frame_len, int nr_workers,
+				   process_samples_worker_fn process_samples);
+
+#endif
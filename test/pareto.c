@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ */
+#include <math.h>
+#include "pareto.h"
+
+/**
+ * @brief Compare two values of an objective: -1 if a is better, 1 if b is, else 0, as when either is NAN
+ *        and they can't be compared.
+ */
+static int compare_objective(float64_t a, float64_t b)
+{
+	if (isnan(a) || isnan(b))
+		return 0;
+	return a < b ? -1 : a > b;
+}
+
+/**
+ * @brief Whether point a dominates point b: no worse in any objective and better in at least one, of the
+ *        objectives that both have.
+ */
+static bool dominates(const float64_t *a, const float64_t *b, int nr_objectives)
+{
+	bool better = false;
+
+	for (int k = 0; k < nr_objectives; ++k) {
+		const int cmp = compare_objective(a[k], b[k]);
+
+		if (cmp > 0)
+			return false;
+		better = better || cmp < 0;
+	}
+	return better;
+}
+
+int pareto_frontier(const float64_t *objectives, int nr_points, int nr_objectives, bool *on_frontier)
+{
+	int nr_on_frontier = 0;
+
+	for (int i = 0; i < nr_points; ++i) {
+		on_frontier[i] = true;
+		for (int j = 0; j < nr_points && on_frontier[i]; ++j) {
+			if (dominates(objectives+j*nr_objectives, objectives+i*nr_objectives, nr_objectives))
+				on_frontier[i] = false;
+		}
+		nr_on_frontier += on_frontier[i];
+	}
+	return nr_on_frontier;
+}
@@ -0,0 +1,25 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Pareto frontier of a set of points with several objectives each, e.g. the configurations of the DSP
+ * measured by design-space (see design_space.c): a point is on the frontier if no other point is at least
+ * as good in every objective and better in one, i.e. if no other point dominates it.
+ */
+#ifndef PARETO_H
+#define PARETO_H
+
+#include <stdbool.h>
+#include <arm_math_types.h>
+
+/**
+ * @brief Mark which of the points are on the Pareto frontier.
+ * @param objectives nr_objectives values per point, the objectives of point i from objectives[i*nr_objectives],
+ *	  all to be minimised: negate those to be maximised. A NAN is an objective the point wasn't measured
+ *	  on, left out of the comparisons of the point with the others.
+ * @param on_frontier Of nr_points, set to whether each point is on the frontier.
+ * @return Number of points on the frontier.
+ */
+int pareto_frontier(const float64_t *objectives, int nr_points, int nr_objectives, bool *on_frontier);
+
+#endif
@@ -2,100 +2,213 @@
  * Copyright (C) 2024 Petar Turukalo
  * SPDX-License-Identifier: GPL-2.0
  */
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <math.h>
+#include <unistd.h>
 #include "file_source.h"
+#include "parallel_file_source.h"
 #include "dsp_indirect.h"
 
 #define XTICS_INCR 100
 
-/**
- * Plot magnitudes, drawing a box of width bin_width() for each. 
- * Metadata keyentries are also drawn to the key/legend here because it can only
- * be done with the plot command.
- */
-static void plot_magnitudes(FILE *gnuplot, float32_t *freq_bin_magnitudes, enum frame_length frame_len)
-{
-	const int nbins = nr_bins(frame_len);
-	const float32_t binwidth = bin_width(frame_len, SAMPLING_RATE);
-	/* 
-	 * Boxes (bins) are drawn centred about this x-position, and is the same as the frequency of
-	 * the bin that is being drawn at it.
-	 */
-	float bin_centre_xpos = binwidth;
+/* Options of the plots, set from the command line before the workers start. */
+static const char *image_file_format = "svg";
+static bool multiplot = false;
+/* Range of the frequencies plotted, in Hz. */
+static float32_t min_freq, max_freq;
 
-	fprintf(gnuplot, "set key noautotitle\n");  /* Remove default keyentry. */
-	fprintf(gnuplot, "set key inside right top\n");
+/*
+ * The gnuplot session of each worker, kept open across all the plots of the worker rather than
+ * started for each, and closed when the worker exits.
+ */
+static pthread_key_t gnuplot_key;
 
-	fprintf(gnuplot, "plot '-' with boxes, ");
-	/* Add keyentries for metadata. */
-	fprintf(gnuplot, "keyentry title 'frame len %d', ", frame_len);
-	fprintf(gnuplot, "keyentry title 'nbins %d', ", nbins);
-	fprintf(gnuplot, "keyentry title 'bin width %.3f Hz'\n", binwidth);
-	/* Plot magnitudes. Start at 1 to skip DC. */
-	for (int i = 1; i < nbins; ++i) {
-		fprintf(gnuplot, "%.9f %a\n", bin_centre_xpos, freq_bin_magnitudes[i]);
-		bin_centre_xpos += binwidth;
-	}
-	fprintf(gnuplot, "e\n");
+static void close_gnuplot(void *gnuplot)
+{
+	pclose(gnuplot);
 }
 
-/**
- * @brief Save a plot of the frequency bin magnitudes of a note to file 'plot/<note_name><name_suffix>-<i>.svg'.
- */
-static bool _plot_note_freq_bin_magnitudes(const char *note_name, char *name_suffix, int i, 
-					   float32_t *freq_bin_magnitudes, enum frame_length frame_len) 
+/** @brief Get the gnuplot session of the calling worker, starting it if it hasn't one yet. */
+static FILE *worker_gnuplot(void)
 {
-	FILE *gnuplot;
-	const char *image_file_format = "svg";
-	char plot_pathname[64];
+	FILE *gnuplot = pthread_getspecific(gnuplot_key);
 
+	if (gnuplot)
+		return gnuplot;
 	gnuplot = popen("gnuplot", "w");
 	if (!gnuplot) {
 		fprintf(stderr, "Error opening gnuplot: %s\n", strerror(errno));
-		return false;
+		return NULL;
 	}
-	fprintf(gnuplot, "set term %s size 1024,768 dynamic mouse\n", image_file_format); 
-	snprintf(plot_pathname, sizeof(plot_pathname), "plot/%s%s-%d.%s", note_name, name_suffix, i, image_file_format);
-	fprintf(gnuplot, "set output '%s'\n", plot_pathname);
-
-	fprintf(gnuplot, "set title '%s'\n", note_name);
+	if (strcmp(image_file_format, "png") == 0)
+		fprintf(gnuplot, "set term pngcairo size 1024,%d\n", multiplot ? 1536 : 768);
+	else
+		fprintf(gnuplot, "set term svg size 1024,%d dynamic mouse\n", multiplot ? 1536 : 768);
 	fprintf(gnuplot, "set xlabel 'Frequency (Hz)'\n");
-	fprintf(gnuplot, "set ylabel 'Magnitude'\n"); 
 	fprintf(gnuplot, "set xtics out nomirror %d\n", XTICS_INCR);
 	fprintf(gnuplot, "set ytics out nomirror\n");
 	fprintf(gnuplot, "set style fill solid\n");
+	fprintf(gnuplot, "set key noautotitle\n");  /* Remove default keyentry. */
+	fprintf(gnuplot, "set key inside right top\n");
+	pthread_setspecific(gnuplot_key, gnuplot);
+	return gnuplot;
+}
 
-	plot_magnitudes(gnuplot, freq_bin_magnitudes, frame_len);
+/**
+ * @brief Get the bins plotted of the frame: those in the frequency range, less DC, and after HPS only the
+ *        candidate fundamentals, the other bins having no magnitude.
+ */
+static struct bin_range plotted_bin_range(enum frame_length frame_len, bool hps)
+{
+	const float32_t binwidth = bin_width(frame_len, SAMPLING_RATE);
+	/* Start at 1 to skip DC. */
+	struct bin_range range = { fmaxf(1, ceilf(min_freq/binwidth)),
+				   fminf(nr_bins(frame_len), floorf(max_freq/binwidth)+1) };
 
-	pclose(gnuplot);
-	printf("Wrote plot to %s\n", plot_pathname);
-	return true;
+	if (hps) {
+		const struct bin_range candidates = hps_candidate_bin_range(frame_len, SAMPLING_RATE, NHARMONICS);
+
+		range.first = range.first > candidates.first ? range.first : candidates.first;
+		range.end = range.end < candidates.end ? range.end : candidates.end;
+	}
+	if (range.end < range.first)
+		range.end = range.first;
+	return range;
 }
 
-static bool plot_note_freq_bin_magnitudes(const char *note_name, int i, 
-					  const int16_t *samples, enum frame_length frame_len) 
+/**
+ * Plot the magnitudes of the bins of plotted_bin_range(), drawing a box of width bin_width() for each.
+ * Metadata keyentries are also drawn to the key/legend here because it can only
+ * be done with the plot command.
+ *
+ * The magnitudes are sent inline as binary records of a float32 frequency and magnitude, rather than as
+ * text, so that gnuplot needn't parse them.
+ */
+static void plot_magnitudes(FILE *gnuplot, const char *title, bool hps, float32_t *freq_bin_magnitudes,
+			    enum frame_length frame_len)
 {
-	if (i == 1)
-		samples_to_freq_bin_magnitudes_init(frame_len);
-	float32_t *freq_bin_magnitudes = samples_to_freq_bin_magnitudes_s16(samples, frame_len);
-	return _plot_note_freq_bin_magnitudes(note_name, "", i, freq_bin_magnitudes, frame_len);
+	const float32_t binwidth = bin_width(frame_len, SAMPLING_RATE);
+	const struct bin_range range = plotted_bin_range(frame_len, hps);
+	const int first = range.first, end = range.end;
+
+	fprintf(gnuplot, "set title '%s'\n", title);
+	fprintf(gnuplot, "set ylabel '%s'\n", hps ? "Log magnitude" : "Magnitude");
+	fprintf(gnuplot, "set xrange [%f:%f]\n", first*binwidth - binwidth/2, (end-1)*binwidth + binwidth/2);
+	fprintf(gnuplot, "set boxwidth %f absolute\n", binwidth);
+	fprintf(gnuplot, "plot '-' binary record=%d format='%%float32%%float32' using 1:2 with boxes, ", end-first);
+	/* Add keyentries for metadata. */
+	fprintf(gnuplot, "keyentry title 'frame len %d', ", frame_len);
+	fprintf(gnuplot, "keyentry title 'nbins %d', ", nr_bins(frame_len));
+	fprintf(gnuplot, "keyentry title 'bin width %.3f Hz'\n", binwidth);
+	/* Boxes (bins) are drawn centred about the frequency of the bin. */
+	for (int i = first; i < end; ++i) {
+		const float record[2] = { bin_index_to_freq(i, binwidth), freq_bin_magnitudes[i] };
+
+		fwrite(record, sizeof(record), 1, gnuplot);
+	}
+}
+
+/** @brief Set the output of the plots to file 'plot/<note_name><name_suffix>-<i>.<image_file_format>'. */
+static void set_plot_output(FILE *gnuplot, const char *note_name, const char *name_suffix, int i)
+{
+	fprintf(gnuplot, "set output 'plot/%s%s-%d.%s'\n", note_name, name_suffix, i, image_file_format);
+	printf("Writing plot to plot/%s%s-%d.%s\n", note_name, name_suffix, i, image_file_format);
 }
 
-static bool plot_note_freq_bin_magnitudes_hps(const char *note_name, int i, 
-					      const int16_t *samples, enum frame_length frame_len) 
+/**
+ * @brief Plot the frequency bin magnitudes of a frame of a note before and after HPS, either to two files
+ *        'plot/<note_name>-<i>' and 'plot/<note_name>-hps-<i>', or stacked to one 'plot/<note_name>-<i>'
+ *        if multiplot.
+ */
+static bool plot_note_freq_bin_magnitudes(struct file_source_worker *worker, const char *note_name, int i,
+					  const int16_t *samples, enum frame_length frame_len)
 {
+	FILE *gnuplot = worker_gnuplot();
+	float32_t *freq_bin_magnitudes;
+
+	if (!gnuplot)
+		return false;
 	if (i == 1)
-		samples_to_freq_bin_magnitudes_init(frame_len);
-	float32_t *freq_bin_magnitudes = samples_to_freq_bin_magnitudes_s16(samples, frame_len);
-	harmonic_product_spectrum(freq_bin_magnitudes, frame_len, SAMPLING_RATE);
-	return _plot_note_freq_bin_magnitudes(note_name, "-hps", i, freq_bin_magnitudes, frame_len);
+		dsp_ctx_init(&worker->ctx, frame_len, frame_len, worker->ctx_mem);
+	freq_bin_magnitudes = dsp_ctx_samples_to_freq_bin_magnitudes_s16(&worker->ctx, samples,
+									  worker->converted_samples);
+	set_plot_output(gnuplot, note_name, "", i);
+	if (multiplot)
+		fprintf(gnuplot, "set multiplot layout 2,1\n");
+	plot_magnitudes(gnuplot, note_name, false, freq_bin_magnitudes, frame_len);
+	/* The magnitudes have been sent, so HPS can overwrite them. */
+	dsp_ctx_harmonic_product_spectrum(&worker->ctx, freq_bin_magnitudes, NHARMONICS);
+	if (!multiplot)
+		set_plot_output(gnuplot, note_name, "-hps", i);
+	plot_magnitudes(gnuplot, note_name, true, freq_bin_magnitudes, frame_len);
+	if (multiplot)
+		fprintf(gnuplot, "unset multiplot\n");
+	return !ferror(gnuplot);
 }
 
-int main(void)
+static void usage(const char *prog)
 {
-	return !for_each_file_source(NOTE_FILES_DIR, FRAME_LEN_4096, plot_note_freq_bin_magnitudes) ||
-	       !for_each_file_source(NOTE_FILES_DIR, FRAME_LEN_4096, plot_note_freq_bin_magnitudes_hps);
+	fprintf(stderr, "Usage: %s [-t svg|png] [-m] [-f <min Hz>:<max Hz>]\n"
+			"  -t  Image file format, svg by default.\n"
+			"  -m  Plot the magnitudes before and after HPS stacked in one image.\n"
+			"  -f  Range of the frequencies plotted, by default that of the bins HPS reads.\n", prog);
 }
 
+int main(int argc, char **argv)
+{
+	const float32_t binwidth = bin_width(FRAME_LEN_4096, SAMPLING_RATE);
+	const struct bin_range range = hps_magnitude_bin_range(FRAME_LEN_4096, SAMPLING_RATE, NHARMONICS);
+	bool ret;
+	int opt;
+
+	min_freq = bin_index_to_freq(range.first, binwidth);
+	max_freq = bin_index_to_freq(range.end-1, binwidth);
+	while ((opt = getopt(argc, argv, "t:mf:")) != -1) {
+		switch (opt) {
+		case 't':
+			if (strcmp(optarg, "svg") != 0 && strcmp(optarg, "png") != 0) {
+				usage(argv[0]);
+				return 1;
+			}
+			image_file_format = optarg;
+			break;
+		case 'm':
+			multiplot = true;
+			break;
+		case 'f':
+			if (sscanf(optarg, "%f:%f", &min_freq, &max_freq) != 2 || min_freq > max_freq) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	/* 
+	 * The bins plotted don't depend on the frame, so check up front that neither plot of a frame is empty,
+	 * rather than leave gnuplot with empty files or half a multiplot.
+	 */
+	for (int hps = 0; hps <= 1; ++hps) {
+		const struct bin_range range = plotted_bin_range(FRAME_LEN_4096, hps);
+
+		if (range.first == range.end) {
+			fprintf(stderr, "No %sbins in %.1f-%.1f Hz to plot\n", hps ? "HPS candidate " : "", min_freq,
+				max_freq);
+			return 1;
+		}
+	}
+	if (pthread_key_create(&gnuplot_key, close_gnuplot)) {
+		fprintf(stderr, "Error creating key of gnuplot sessions\n");
+		return 1;
+	}
+	/* The note file sources are plotted in parallel, on a worker and gnuplot session per core. */
+	ret = for_each_file_source_parallel(NOTE_FILES_DIR, FRAME_LEN_4096, 0, plot_note_freq_bin_magnitudes);
+	pthread_key_delete(gnuplot_key);
+	return !ret;
+}
@@ -0,0 +1,370 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Micro-benchmark each stage of the DSP pipeline on its own, across the frame lengths (or, for the
+ * filter, tap counts) it's run at, and optionally compare the timings against a baseline saved from
+ * an earlier run to catch regressions in the hot path. Meant to be run natively on the host (see the
+ * native build in README.md), where the timings are stable enough to compare.
+ *
+ * Each stage is timed in NR_SAMPLES samples of a batch of calls, the batch sized so that a sample
+ * takes at least MIN_SAMPLE_SECS, and the median time per call over the samples is reported along with
+ * the minimum and the spread, the median absolute deviation from the median.
+ *
+ * Usage: stage-benchmark [baseline]
+ *
+ * The output is itself a baseline: save it to a file and pass that file to a later run, which then
+ * exits with 1 if any stage got slower than the baseline by more than REGRESSION_THRESHOLD. The
+ * minimums are compared rather than the medians, as other load on the host only ever adds time, and
+ * a stage that looks slower is timed again up to NR_RETRIES times before it counts as a regression.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <dsp/filtering_functions.h>
+#include <dsp/complex_math_functions.h>
+#include "dsp.h"
+#include "note.h"
+
+#define NR_SAMPLES 15
+#define MIN_SAMPLE_SECS 0.002
+/* Slowdown over the minimum of the baseline that counts as a regression. */
+#define REGRESSION_THRESHOLD 1.10
+#define NR_RETRIES 2
+
+/* Oversampled samples per call of the filter, as per block pushed on the MCU. */
+#define FIR_BLOCK_LEN 256
+#define MAX_NR_TAPS 256
+#define NR_NEAREST_NOTE_FREQS 64
+
+struct stage {
+	const char *name;
+	/* Frame lengths, or tap counts, to time the stage at, 0 terminated. */
+	const int *params;
+	/** @brief Set up to run at the param. Return false if it can't, e.g. its FFT tables weren't linked. */
+	bool (*setup)(int param);
+	/** @brief Optionally restore what a run trashes before each run, untimed. */
+	void (*prepare)(int param);
+	void (*run)(int param);
+};
+
+static const int frame_lens[] = {
+	FRAME_LEN_32, FRAME_LEN_64, FRAME_LEN_128, FRAME_LEN_256,
+	FRAME_LEN_512, FRAME_LEN_1024, FRAME_LEN_2048, FRAME_LEN_4096, 0
+};
+static const int nr_taps[] = { 32, 64, 128, MAX_NR_TAPS, 0 };
+static const int no_params[] = { 1, 0 };
+
+/* A note with harmonics, as filtered and decimated samples in the signed 16-bit range. */
+static sample_t frame[MAX_FRAME_LEN];
+static sample_t oversampled_block[FIR_BLOCK_LEN], decimated_block[FIR_BLOCK_LEN];
+static magnitude_t fft_input[MAX_FRAME_LEN];
+/* The q31 FFT outputs the whole mirrored spectrum, twice that of the float FFT. */
+static magnitude_t fft_output[2*MAX_FRAME_LEN];
+static magnitude_t magnitudes[MAX_FRAME_LEN], hps_input[MAX_FRAME_LEN];
+static float32_t nearest_note_freqs[NR_NEAREST_NOTE_FREQS];
+#if FIXED_POINT
+static arm_rfft_instance_q31 rfft_instance;
+static arm_fir_decimate_instance_q15 fir_instance;
+static q15_t fir_coeffs[MAX_NR_TAPS];
+static q15_t fir_state[MAX_NR_TAPS+FIR_BLOCK_LEN-1];
+#else
+static arm_rfft_fast_instance_f32 rfft_instance;
+static arm_fir_decimate_instance_f32 fir_instance;
+static float32_t fir_coeffs[MAX_NR_TAPS];
+static float32_t fir_state[MAX_NR_TAPS+FIR_BLOCK_LEN-1];
+#endif
+/* Sink of the results of the stages that return one, so that the calls aren't optimised out. */
+static volatile int sink;
+
+static double now_secs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+static bool fir_decimate_setup(int nr_taps)
+{
+	for (int i = 0; i < nr_taps; ++i) {
+#if FIXED_POINT
+		fir_coeffs[i] = 32767/nr_taps;
+#else
+		fir_coeffs[i] = 1.0f/nr_taps;
+#endif
+	}
+	for (int i = 0; i < FIR_BLOCK_LEN; ++i)
+		oversampled_block[i] = frame[i];
+#if FIXED_POINT
+	return arm_fir_decimate_init_q15(&fir_instance, nr_taps, 2, fir_coeffs, fir_state, FIR_BLOCK_LEN) == ARM_MATH_SUCCESS;
+#else
+	return arm_fir_decimate_init_f32(&fir_instance, nr_taps, 2, fir_coeffs, fir_state, FIR_BLOCK_LEN) == ARM_MATH_SUCCESS;
+#endif
+}
+
+static void fir_decimate_run(int nr_taps)
+{
+#if FIXED_POINT
+	arm_fir_decimate_q15(&fir_instance, oversampled_block, decimated_block, FIR_BLOCK_LEN);
+#else
+	arm_fir_decimate_f32(&fir_instance, oversampled_block, decimated_block, FIR_BLOCK_LEN);
+#endif
+}
+
+static bool rfft_setup(int frame_len)
+{
+#if FIXED_POINT
+	return arm_rfft_init_q31(&rfft_instance, frame_len, 0, 1) == ARM_MATH_SUCCESS;
+#else
+	return arm_rfft_fast_init_f32(&rfft_instance, frame_len) == ARM_MATH_SUCCESS;
+#endif
+}
+
+/** @brief Copy the frame to the input of the FFT, which the FFT trashes. */
+static void rfft_prepare(int frame_len)
+{
+	for (int i = 0; i < frame_len; ++i) {
+#if FIXED_POINT
+		fft_input[i] = frame[i] << 16;
+#else
+		fft_input[i] = frame[i];
+#endif
+	}
+}
+
+static void rfft_run(int frame_len)
+{
+#if FIXED_POINT
+	arm_rfft_q31(&rfft_instance, fft_input, fft_output);
+#else
+	arm_rfft_fast_f32(&rfft_instance, fft_input, fft_output, 0);
+#endif
+}
+
+/** @brief Set up the FFT output of the frame, as the input of the magnitudes. */
+static bool cmplx_mag_setup(int frame_len)
+{
+	if (!rfft_setup(frame_len))
+		return false;
+	rfft_prepare(frame_len);
+	rfft_run(frame_len);
+	return true;
+}
+
+static void cmplx_mag_run(int frame_len)
+{
+#if FIXED_POINT
+	arm_cmplx_mag_q31(fft_output, magnitudes, nr_bins(frame_len));
+#else
+	arm_cmplx_mag_f32(fft_output, magnitudes, nr_bins(frame_len));
+#endif
+}
+
+/** @brief Set up the magnitudes of the frame, as the input of HPS and the max peak. */
+static bool magnitudes_setup(int frame_len)
+{
+	if (!cmplx_mag_setup(frame_len))
+		return false;
+	cmplx_mag_run(frame_len);
+	memcpy(hps_input, magnitudes, nr_bins(frame_len)*sizeof(magnitude_t));
+	return true;
+}
+
+/** @brief Restore the magnitudes, which HPS trashes. */
+static void hps_prepare(int frame_len)
+{
+	memcpy(magnitudes, hps_input, nr_bins(frame_len)*sizeof(magnitude_t));
+}
+
+static void hps_run(int frame_len)
+{
+	harmonic_product_spectrum(magnitudes, frame_len, SAMPLING_RATE, NHARMONICS);
+}
+
+static void max_bin_index_run(int frame_len)
+{
+	sink = max_bin_index(magnitudes, frame_len);
+}
+
+static bool nearest_note_setup(int param)
+{
+	/* Across the range of the guitar, and a bit either side of it. */
+	for (int i = 0; i < NR_NEAREST_NOTE_FREQS; ++i)
+		nearest_note_freqs[i] = 70.0f + i*(1400.0f-70.0f)/NR_NEAREST_NOTE_FREQS;
+	return true;
+}
+
+static void nearest_note_run(int param)
+{
+	static int i;
+
+	sink = nearest_note(nearest_note_freqs[i++ % NR_NEAREST_NOTE_FREQS]) != NULL;
+}
+
+static const struct stage stages[] = {
+	{ "fir_decimate", nr_taps, fir_decimate_setup, NULL, fir_decimate_run },
+	{ "rfft", frame_lens, rfft_setup, rfft_prepare, rfft_run },
+	{ "cmplx_mag", frame_lens, cmplx_mag_setup, NULL, cmplx_mag_run },
+	{ "harmonic_product_spectrum", frame_lens, magnitudes_setup, hps_prepare, hps_run },
+	{ "max_bin_index", frame_lens, magnitudes_setup, NULL, max_bin_index_run },
+	{ "nearest_note", no_params, nearest_note_setup, NULL, nearest_note_run }
+};
+
+/**
+ * @brief Get the seconds per run of a batch of nruns runs of the stage, excluding the prepares. Those of
+ *        a batch of prepares alone are taken off those of a batch of prepares and runs, rather than each
+ *        run being timed on its own, as reading the clock takes about as long as the shortest stages.
+ */
+static double time_batch(const struct stage *stage, int param, int nruns)
+{
+	double secs, start;
+
+	start = now_secs();
+	for (int i = 0; i < nruns; ++i) {
+		if (stage->prepare)
+			stage->prepare(param);
+		stage->run(param);
+	}
+	secs = now_secs()-start;
+	if (stage->prepare) {
+		start = now_secs();
+		for (int i = 0; i < nruns; ++i)
+			stage->prepare(param);
+		secs -= now_secs()-start;
+	}
+	/* The noise of the host could leave a negative time. */
+	return fmax(secs, 0)/nruns;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+	const double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+static double median(double *values, int len)
+{
+	qsort(values, len, sizeof(double), compare_doubles);
+	return len%2 ? values[len/2] : (values[len/2-1]+values[len/2])/2;
+}
+
+struct timing {
+	double median_ns;
+	double min_ns;
+	/* Median absolute deviation from the median, as a percentage of it. */
+	double spread;
+};
+
+static struct timing time_stage(const struct stage *stage, int param)
+{
+	double samples[NR_SAMPLES], deviations[NR_SAMPLES];
+	struct timing timing;
+	int nruns = 1;
+
+	/* Size the batch, which also warms up the caches and branch predictors. */
+	while (time_batch(stage, param, nruns)*nruns < MIN_SAMPLE_SECS)
+		nruns *= 2;
+	for (int i = 0; i < NR_SAMPLES; ++i)
+		samples[i] = time_batch(stage, param, nruns)*1e9;
+	timing.median_ns = median(samples, NR_SAMPLES);
+	timing.min_ns = samples[0];
+	for (int i = 0; i < NR_SAMPLES; ++i)
+		deviations[i] = fabs(samples[i]-timing.median_ns);
+	timing.spread = 100*median(deviations, NR_SAMPLES)/timing.median_ns;
+	return timing;
+}
+
+/* A line of a baseline, as output by a run. */
+struct baseline_entry {
+	char name[32];
+	int param;
+	double median_ns;
+	double min_ns;
+};
+
+#define MAX_BASELINE_ENTRIES 64
+
+static int read_baseline(const char *path, struct baseline_entry *entries)
+{
+	char line[256];
+	int n = 0;
+	FILE *f = fopen(path, "r");
+
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	while (n < MAX_BASELINE_ENTRIES && fgets(line, sizeof(line), f)) {
+		if (line[0] != '#' && sscanf(line, "%31s %d %lf %lf", entries[n].name, &entries[n].param,
+					     &entries[n].median_ns, &entries[n].min_ns) == 4)
+			++n;
+	}
+	fclose(f);
+	return n;
+}
+
+static const struct baseline_entry *find_baseline_entry(const struct baseline_entry *entries, int n,
+							const char *name, int param)
+{
+	for (int i = 0; i < n; ++i) {
+		if (strcmp(entries[i].name, name) == 0 && entries[i].param == param)
+			return &entries[i];
+	}
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	struct baseline_entry baseline[MAX_BASELINE_ENTRIES];
+	int nbaseline = 0, nregressions = 0;
+
+	if (argc > 1 && (nbaseline = read_baseline(argv[1], baseline)) < 0)
+		return 1;
+	for (int i = 0; i < MAX_FRAME_LEN; ++i) {
+		frame[i] = 0;
+		/* A 110 Hz A2 and its harmonics, falling off in amplitude. */
+		for (int harmonic = 1; harmonic <= 6; ++harmonic)
+			frame[i] += 8000.0f/harmonic*sinf(2*PI*110*harmonic*i/SAMPLING_RATE);
+	}
+
+	printf("# %-25s %6s %12s %12s %8s", "stage", "param", "median ns", "min ns", "spread");
+	if (argc > 1)
+		printf(" %12s %8s", "base min ns", "change");
+	printf("\n");
+	for (size_t s = 0; s < sizeof(stages)/sizeof(stages[0]); ++s) {
+		for (const int *param = stages[s].params; *param; ++param) {
+			const struct baseline_entry *entry = find_baseline_entry(baseline, nbaseline, stages[s].name, *param);
+			struct timing timing, retry;
+			double change;
+
+			if (!stages[s].setup(*param))
+				continue;
+			timing = time_stage(&stages[s], *param);
+			for (int r = 0; entry && r < NR_RETRIES && timing.min_ns > REGRESSION_THRESHOLD*entry->min_ns; ++r) {
+				retry = time_stage(&stages[s], *param);
+				if (retry.min_ns < timing.min_ns)
+					timing = retry;
+			}
+			printf("  %-25s %6d %12.1f %12.1f %7.1f%%", stages[s].name, *param, timing.median_ns,
+			       timing.min_ns, timing.spread);
+			if (entry) {
+				change = timing.min_ns/entry->min_ns;
+				printf(" %12.1f %+7.1f%%", entry->min_ns, 100*(change-1));
+				if (change > REGRESSION_THRESHOLD) {
+					printf(" REGRESSION");
+					++nregressions;
+				}
+			}
+			printf("\n");
+		}
+	}
+	if (argc > 1) {
+		printf("# %d regressions of more than %.0f%% against %s\n", nregressions,
+		       100*(REGRESSION_THRESHOLD-1), argv[1]);
+	}
+	return nregressions > 0;
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ */
+#include <math.h>
+#include "synth.h"
+
+#define SYNTH_MAX_HARMONICS 64
+#define ADC_U12_MAX 4095
+#define ADC_U12_MID_SCALE 2047.5f
+
+/** @brief Get the next of a xorshift32 sequence of pseudo-random numbers, never 0 for a seed other than 0. */
+static uint32_t xorshift32(uint32_t *state)
+{
+	uint32_t x = *state;
+
+	x ^= x<<13;
+	x ^= x>>17;
+	x ^= x<<5;
+	return *state = x;
+}
+
+/** @brief Get a uniformly distributed random number in (0, 1]. */
+static float64_t uniform(uint32_t *state)
+{
+	return (xorshift32(state) >> 8) / (float64_t)(1<<24) + 1.0/(1<<25);
+}
+
+/** @brief Get a normally distributed random number of mean 0 and variance 1, with the Box-Muller transform. */
+static float64_t gaussian(uint32_t *state)
+{
+	/* Drawn in order, as the order of calls in an expression is unspecified, to reproduce the same noise. */
+	const float64_t u1 = uniform(state);
+	const float64_t u2 = uniform(state);
+
+	return sqrt(-2*log(u1)) * cos(2*M_PI*u2);
+}
+
+float32_t detune(float32_t frequency, float32_t cents)
+{
+	return frequency*exp2f(cents/1200);
+}
+
+void synth_pluck_u12(const struct pluck *pluck, uint16_t *u12_samples, int nr_samples, int nr_silent_samples,
+		     int sampling_rate)
+{
+	float64_t freqs[SYNTH_MAX_HARMONICS], amplitudes[SYNTH_MAX_HARMONICS], phases[SYNTH_MAX_HARMONICS];
+	float64_t decay_rates[SYNTH_MAX_HARMONICS];
+	float64_t sum_of_amplitudes = 0;
+	uint32_t state = pluck->seed ? pluck->seed : 1;
+	int nr_harmonics = 0;
+
+	for (int n = 1; n <= pluck->nr_harmonics && n <= SYNTH_MAX_HARMONICS; ++n) {
+		const float64_t freq = n*pluck->frequency*sqrt(1 + pluck->inharmonicity*n*n);
+
+		/* Harmonics past the Nyquist frequency would alias. */
+		if (freq >= sampling_rate/2.0)
+			break;
+		freqs[nr_harmonics] = freq;
+		amplitudes[nr_harmonics] = fabs(sin(n*M_PI*pluck->pluck_position))/n;
+		phases[nr_harmonics] = 2*M_PI*uniform(&state);
+		decay_rates[nr_harmonics] = (n+1)/(2*pluck->decay_secs);
+		sum_of_amplitudes += amplitudes[nr_harmonics];
+		++nr_harmonics;
+	}
+	/* Scale the harmonics so that the peak can't be past the amplitude, as when they all peak together. */
+	for (int k = 0; k < nr_harmonics; ++k)
+		amplitudes[k] *= pluck->amplitude*ADC_U12_MID_SCALE/sum_of_amplitudes;
+
+	for (int i = 0; i < nr_samples; ++i) {
+		float64_t sample = ADC_U12_MID_SCALE + pluck->dc_offset + pluck->noise_rms*gaussian(&state);
+
+		if (i >= nr_silent_samples) {
+			const float64_t t = (float64_t)(i-nr_silent_samples)/sampling_rate;
+
+			for (int k = 0; k < nr_harmonics; ++k)
+				sample += amplitudes[k]*exp(-decay_rates[k]*t)*sin(2*M_PI*freqs[k]*t + phases[k]);
+		}
+		sample = round(sample);
+		u12_samples[i] = sample < 0 ? 0 : sample > ADC_U12_MAX ? ADC_U12_MAX : sample;
+	}
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2024 Petar Turukalo
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Synthesiser of plucked string like notes, as read by the 12-bit ADC of the MCU (see adc.h), to test
+ * the pipeline at any pitch and detuning rather than only at those of the recorded file sources.
+ *
+ * A pluck is a series of harmonics that each start at a random phase and decay exponentially, the higher
+ * harmonics decaying faster, at the frequencies of a stiff string: the nth harmonic of a fundamental f is
+ * at n*f*sqrt(1 + B*n^2) for an inharmonicity coefficient B, e.g. around 1e-4 for a guitar string. The
+ * amplitude of each harmonic is that of a string plucked at a fraction of its length from the bridge.
+ * The signal is biased to the mid-scale of the ADC, offset by a DC error, has white noise added, and is
+ * rounded and clipped to 12 bits.
+ */
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <stdint.h>
+#include <arm_math_types.h>
+
+struct pluck {
+	float32_t frequency;  /* Of the fundamental, in Hz. */
+	/* Peak amplitude as a fraction of full scale, i.e. of half the 12-bit range. */
+	float32_t amplitude;
+	int nr_harmonics;
+	/* Time constant of the decay of the fundamental, in seconds. The nth harmonic decays (n+1)/2 times faster. */
+	float32_t decay_secs;
+	float32_t inharmonicity;  /* B above. */
+	/* Fraction of the length of the string from the bridge that it's plucked at, e.g. 0.2. */
+	float32_t pluck_position;
+	/* RMS of the white noise and the DC offset from the mid-scale of the ADC, in 12-bit codes. */
+	float32_t noise_rms;
+	float32_t dc_offset;
+	uint32_t seed;  /* Of the random phases and noise, so that a pluck can be reproduced. */
+};
+
+/**
+ * @brief Fill u12_samples with the pluck sampled at the rate, starting nr_silent_samples before it with
+ *        only the noise and DC offset.
+ */
+void synth_pluck_u12(const struct pluck *pluck, uint16_t *u12_samples, int nr_samples, int nr_silent_samples,
+		     int sampling_rate);
+
+/** @brief Get the frequency of a note detuned by a number of cents. */
+float32_t detune(float32_t frequency, float32_t cents);
+
+#endif